@@ -0,0 +1,352 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "cpu.h"
+#include "perf_counters.h"
+
+/*
+ * Pilot core benchmarks
+ *
+ * Each guest program below is copied into HRAM and run for a fixed number of guest cycles in both
+ * execution modes, from a freshly reset machine every run; the fastest run is the one reported. Then
+ * every one of the 65536 opcode words is put through the fast mode decoder. The results go to
+ * stdout as a single JSON object.
+ *
+ * Host time per guest instruction is only meaningful for programs that are still running their loop at
+ * the end (in_program) and still taking instructions (running). Both are reported alongside it; if either
+ * is false, it's reported as null and the benchmark exits with 1.
+ */
+
+// Build from this directory with
+//   cc -O2 -I../pilot-cpu -o pilot-bench bench.c ../pilot-cpu/*.c -pthread
+// and run as
+//   pilot-bench [cycles per run] [runs]
+
+#define BENCH_LOAD_ADDR	0xfff400
+#define BENCH_HRAM_START	0xfff400
+#define BENCH_DEFAULT_CYCLES	2000000
+#define BENCH_DEFAULT_RUNS	5
+#define BENCH_DECODE_PASSES	16
+// After a timed run, a program that's still looping takes at least one instruction in this many cycles
+#define BENCH_CHECK_CYCLES	10000
+
+typedef struct
+{
+	const char *name;
+	const uint16_t *code;
+	uint16_t num_words;
+} bench_program;
+
+/*
+ * Guest programs
+ */
+
+static const uint16_t bench_alu_[] =
+{
+	0xc801,			// ldq r0, 1
+	0xc903,			// ldq r1, 3
+	// top:
+	0x7004,			// add.w r1, r0
+	0x7948,			// xor.w r2, r1
+	0xb08c,			// sub.p r3, r0
+	0x3910,			// and.b r4, r1
+	0x7a94,			// or.w r5, r2
+	0xb358,			// adx.p r6, r3
+	0xeefa			// jr top
+};
+
+static const uint16_t bench_djnz_[] =
+{
+	0xc801,			// ldq r0, 1
+	// top:
+	0xc27f, 0xffff,		// ld.p r2, $7fffff
+	// inner:
+	0x7004,			// add.w r1, r0
+	0xf2ff,			// djnz r2, inner
+	0xeefc			// jr top
+};
+
+static const uint16_t bench_repi_[] =
+{
+	// top:
+	0xc000, 0x0100,		// ld.p r0, $000100
+	0xc100, 0x0400,		// ld.p r1, $000400
+	0xfe0f,			// repi 15
+	0x5920,			// ld.w (r1+), (r0+)
+	0xeefa			// jr top
+};
+
+static const uint16_t bench_repr_[] =
+{
+	// top:
+	0xc000, 0x0100,		// ld.p r0, $000100
+	0xc100, 0x0400,		// ld.p r1, $000400
+	0xcc0f,			// ldq r4, 15
+	0xf400,			// repr r4
+	0x5920,			// ld.w (r1+), (r0+)
+	0xeef9			// jr top
+};
+
+static const uint16_t bench_mul_[] =
+{
+	0xca05,			// ldq r2, 5
+	// top:
+	0xc907,			// ldq r1, 7
+	0x4908,			// mulu.w r1, r2
+	0xcbfd,			// ldq r3, -3
+	0x4b48,			// muls.w r3, r2
+	0xeefc			// jr top
+};
+
+static const uint16_t bench_div_[] =
+{
+	0xca07,			// ldq r2, 7
+	// top:
+	0xc800,			// ldq r0, 0
+	0xc964,			// ldq r1, 100
+	0x4988,			// divu.w r1, r2
+	0xc8ff,			// ldq r0, -1
+	0xcb9c,			// ldq r3, -100
+	0x4bc8,			// divs.w r3, r2
+	0xeefa			// jr top
+};
+
+// Every addressing mode as the source of an add that discards its result. (r5+) and -(r5) cancel out, so
+// r5 only needs setting once
+static const uint16_t bench_rm_modes_[] =
+{
+	0xc500, 0x0200,		// ld.p r5, $000200
+	// top:
+	0x6304,			// add.w r3, <register direct>
+	0x6316,			// add.w r3, <register indirect>
+	0x6334,			// add.w r3, <post-increment>
+	0x6336,			// add.w r3, <pre-decrement>
+	0x6315,			// add.w r3, <register relative>
+	0x6339, 0x0500,		// add.w r3, <register indexed>
+	0x633d, 0x0000, 0x0100,	// add.w r3, <absolute indexed>
+	0x6331, 0x0010,		// add.w r3, <16-bit PGC relative>
+	0x6335, 0x0010, 0x0000,	// add.w r3, <24-bit PGC relative>
+	0x6329, 0x0100,		// add.w r3, <16-bit absolute>
+	0x632d, 0x0000, 0x0100,	// add.w r3, <24-bit absolute>
+	0x6321, 0x1234,		// add.w r3, <16-bit immediate>
+	0x6325, 0x0012, 0x3456,	// add.w r3, <24-bit immediate>
+	0x6307,			// add.w r3, <short immediate>
+	0xeee6			// jr top
+};
+
+// Every JR is predicted taken. The JR Z falls through on every other pass and mispredicts then; the
+// unconditional ones, forward and backward, are always predicted right
+static const uint16_t bench_branch_[] =
+{
+	0xc801,			// ldq r0, 1
+	// top:
+	0x7844,			// xor.w r1, r0
+	0xecff,			// jr z, top
+	0xee01,			// jr next
+	// next:
+	0xeefd			// jr top
+};
+
+#define BENCH_PROGRAM_(name)	{#name, bench_##name##_, sizeof(bench_##name##_) / sizeof(uint16_t)}
+
+static const bench_program bench_programs_[] =
+{
+	BENCH_PROGRAM_(alu),
+	BENCH_PROGRAM_(djnz),
+	BENCH_PROGRAM_(repi),
+	BENCH_PROGRAM_(repr),
+	BENCH_PROGRAM_(mul),
+	BENCH_PROGRAM_(div),
+	BENCH_PROGRAM_(rm_modes),
+	BENCH_PROGRAM_(branch)
+};
+
+#define BENCH_NUM_PROGRAMS	(sizeof(bench_programs_) / sizeof(bench_program))
+
+/*
+ * Core hooks
+ */
+
+// The core calls these on paths it doesn't implement yet, which it can't carry on from
+void
+decode_unreachable_ (void)
+{
+	fprintf(stderr, "pilot-bench: the decoder reached a path it doesn't implement\n");
+	exit(1);
+}
+
+void
+execute_unreachable_ (void)
+{
+	fprintf(stderr, "pilot-bench: the execute unit reached a path it doesn't implement\n");
+	exit(1);
+}
+
+/*
+ * Benchmarks
+ */
+
+static uint64_t
+bench_now_ns_ (void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+bench_load_ (Pilot_cpu *cpu, const uint16_t *code, uint16_t num_words)
+{
+	uint16_t offset = BENCH_LOAD_ADDR - BENCH_HRAM_START;
+	
+	for (uint16_t i = 0; i < num_words; i++)
+	{
+		cpu->sys.hram[offset + 2 * i] = code[i] & 0xff;
+		cpu->sys.hram[offset + 2 * i + 1] = code[i] >> 8;
+	}
+}
+
+// Prints a JSON number, or null if there's nothing to divide by
+static void
+bench_print_ratio_ (const char *key, uint64_t num, uint64_t den)
+{
+	if (den)
+	{
+		printf("\"%s\": %.4f", key, (double)num / den);
+	}
+	else
+	{
+		printf("\"%s\": null", key);
+	}
+}
+
+// Returns FALSE if the program had left its code or stopped taking instructions by the end of a run
+static bool
+bench_run_program_ (Pilot_cpu *cpu, const bench_program *prog, Pilot_exec_mode mode, uint64_t num_cycles, int num_runs)
+{
+	uint64_t best_ns = UINT64_MAX;
+	uint64_t cycles = 0;
+	Pilot_perf_counters perf = {0};
+	bool in_program = TRUE;
+	bool running = TRUE;
+	
+	for (int run = 0; run < num_runs; run++)
+	{
+		Pilot_cpu_init(cpu, BENCH_LOAD_ADDR);
+		bench_load_(cpu, prog->code, prog->num_words);
+		Pilot_set_exec_mode(cpu, mode);
+		Pilot_perf_reset(&cpu->sys);
+		
+		uint64_t start = bench_now_ns_();
+		uint64_t cycles_run = Pilot_run_cycles(cpu, num_cycles);
+		uint64_t elapsed = bench_now_ns_() - start;
+		
+		if (elapsed < best_ns)
+		{
+			best_ns = elapsed;
+			cycles = cycles_run;
+			Pilot_perf_snapshot(&cpu->sys, &perf);
+		}
+		
+		uint32_t pgc = cpu->sys.core.pgc;
+		in_program = in_program && (pgc >= BENCH_LOAD_ADDR && pgc < BENCH_LOAD_ADDR + 2u * prog->num_words);
+		
+#if PILOT_PERF_COUNTERS
+		// untimed: a program stuck on the bus or halted stays in its code without getting anywhere
+		uint64_t insts = cpu->sys.perf.insts;
+		Pilot_run_cycles(cpu, BENCH_CHECK_CYCLES);
+		running = running && (cpu->sys.perf.insts != insts);
+#endif
+	}
+	
+	bool valid = in_program && running;
+	
+	printf("\t\t{\"program\": \"%s\", \"mode\": \"%s\", \"cycles\": %llu, \"instructions\": %llu, \"host_ns\": %llu, ",
+		prog->name, (mode == PILOT_EXEC_FAST) ? "fast" : "cycle",
+		(unsigned long long)cycles, (unsigned long long)perf.insts, (unsigned long long)best_ns);
+	bench_print_ratio_("ns_per_cycle", best_ns, cycles);
+	printf(", ");
+	bench_print_ratio_("ns_per_instruction", best_ns, valid ? perf.insts : 0);
+	printf(", \"branch_mispredicts\": %llu, \"in_program\": %s, \"running\": %s}",
+		(unsigned long long)perf.branch_mispredicts, in_program ? "true" : "false", running ? "true" : "false");
+	
+	return valid;
+}
+
+// Raw decoder throughput: every opcode word, followed by zero operand words, decoded straight out of HRAM
+static void
+bench_decode_ (Pilot_cpu *cpu)
+{
+	static const uint16_t operands[3] = {0, 0, 0};
+	uint64_t best_ns = UINT64_MAX;
+	uint32_t decoded = 0, illegal = 0;
+	
+	Pilot_cpu_init(cpu, BENCH_LOAD_ADDR);
+	bench_load_(cpu, operands, 3);
+	
+	for (int pass = 0; pass < BENCH_DECODE_PASSES; pass++)
+	{
+		decoded = 0;
+		illegal = 0;
+		
+		uint64_t start = bench_now_ns_();
+		for (uint32_t opcode = 0; opcode < 0x10000; opcode++)
+		{
+			uint16_t word = opcode;
+			bench_load_(cpu, &word, 1);
+			if (pilot_decode_inst_sync(&cpu->decode, BENCH_LOAD_ADDR))
+			{
+				decoded++;
+				illegal += cpu->decode.work_regs.illegal;
+			}
+		}
+		uint64_t elapsed = bench_now_ns_() - start;
+		
+		if (elapsed < best_ns)
+		{
+			best_ns = elapsed;
+		}
+	}
+	
+	printf("\t\"decode\": {\"opcodes\": 65536, \"passes\": %d, \"host_ns\": %llu, ", BENCH_DECODE_PASSES, (unsigned long long)best_ns);
+	bench_print_ratio_("ns_per_opcode", best_ns, 0x10000);
+	printf(", \"decoded\": %u, \"illegal\": %u}\n", decoded, illegal);
+}
+
+int
+main (int argc, char **argv)
+{
+	uint64_t num_cycles = (argc > 1) ? strtoull(argv[1], NULL, 0) : BENCH_DEFAULT_CYCLES;
+	int num_runs = (argc > 2) ? atoi(argv[2]) : BENCH_DEFAULT_RUNS;
+	bool valid = TRUE;
+	
+	if (!num_cycles || num_runs <= 0)
+	{
+		fprintf(stderr, "usage: %s [cycles per run] [runs]\n", argv[0]);
+		return 1;
+	}
+	
+	Pilot_cpu *cpu = aligned_alloc(_Alignof(Pilot_cpu), sizeof(Pilot_cpu));
+	if (!cpu)
+	{
+		return 1;
+	}
+	
+	printf("{\n\t\"cycles_per_run\": %llu,\n\t\"runs\": %d,\n\t\"programs\": [\n", (unsigned long long)num_cycles, num_runs);
+	for (size_t i = 0; i < BENCH_NUM_PROGRAMS; i++)
+	{
+		valid = bench_run_program_(cpu, &bench_programs_[i], PILOT_EXEC_CYCLE, num_cycles, num_runs) && valid;
+		printf(",\n");
+		valid = bench_run_program_(cpu, &bench_programs_[i], PILOT_EXEC_FAST, num_cycles, num_runs) && valid;
+		printf((i + 1 < BENCH_NUM_PROGRAMS) ? ",\n" : "\n");
+	}
+	printf("\t],\n");
+	
+	bench_decode_(cpu);
+	printf("}\n");
+	
+	free(cpu);
+	return valid ? 0 : 1;
+}
@@ -0,0 +1,263 @@
+#define _GNU_SOURCE
+#include "batch.h"
+#include "memory.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Batch runner
+ *
+ * Every worker owns one Pilot_cpu for its whole life and reinitializes it for each job, so jobs share
+ * nothing but the (read-only) microcode ROM. The jobs are split into one contiguous range per worker;
+ * a worker takes jobs from the front of its own range, and once that's empty, moves the back half of
+ * another worker's range over to its own. Jobs are big enough that a lock per range costs nothing.
+ */
+
+typedef struct
+{
+	pthread_mutex_t lock;
+	// Jobs still to be taken: [next, end)
+	size_t next;
+	size_t end;
+} pilot_batch_queue;
+
+typedef struct
+{
+	Pilot_batch_job *jobs;
+	pilot_batch_queue *queues;
+	int num_workers;
+} pilot_batch;
+
+typedef struct
+{
+	pilot_batch *batch;
+	int index;
+	pthread_t thread;
+	bool started;
+	size_t jobs_done;
+} pilot_batch_worker;
+
+static bool
+batch_take_own_ (pilot_batch_queue *queue, size_t *job)
+{
+	bool taken = FALSE;
+	
+	pthread_mutex_lock(&queue->lock);
+	if (queue->next < queue->end)
+	{
+		*job = queue->next++;
+		taken = TRUE;
+	}
+	pthread_mutex_unlock(&queue->lock);
+	
+	return taken;
+}
+
+// Moves the back half of another worker's jobs over to this one
+static bool
+batch_steal_ (pilot_batch *batch, int thief)
+{
+	for (int i = 1; i < batch->num_workers; i++)
+	{
+		pilot_batch_queue *victim = &batch->queues[(thief + i) % batch->num_workers];
+		size_t start = 0, end = 0;
+		
+		pthread_mutex_lock(&victim->lock);
+		if (victim->next < victim->end)
+		{
+			end = victim->end;
+			start = end - (victim->end - victim->next + 1) / 2;
+			victim->end = start;
+		}
+		pthread_mutex_unlock(&victim->lock);
+		
+		if (start < end)
+		{
+			pilot_batch_queue *own = &batch->queues[thief];
+			pthread_mutex_lock(&own->lock);
+			own->next = start;
+			own->end = end;
+			pthread_mutex_unlock(&own->lock);
+			return TRUE;
+		}
+	}
+	
+	return FALSE;
+}
+
+static void
+batch_run_job_ (Pilot_cpu *cpu, Pilot_batch_job *job)
+{
+	Pilot_cpu_init(cpu, job->start_addr);
+	if (job->rom && job->rom_size)
+	{
+		// mapped read-only, so the ROM is never written through this pointer
+		Pilot_mem_map_direct(&cpu->sys, job->rom_addr, job->rom_addr + job->rom_size - 1, (uint8_t *)job->rom, FALSE);
+	}
+	Pilot_set_exec_mode(cpu, job->exec_mode);
+	
+	if (job->setup)
+	{
+		job->setup(job, cpu);
+	}
+	
+	job->cycles_run = 0;
+	job->frames_run = 0;
+	if (!job->num_frames)
+	{
+		job->cycles_run = Pilot_run_cycles(cpu, job->num_cycles);
+	}
+	
+	while (job->frames_run < job->num_frames)
+	{
+		job->cycles_run += Pilot_run_cycles(cpu, job->cycles_per_frame);
+		uint32_t frame = job->frames_run++;
+		if (job->frame && !job->frame(job, cpu, frame))
+		{
+			break;
+		}
+	}
+	
+	if (job->result)
+	{
+		job->result(job, cpu);
+	}
+}
+
+// Pins the calling thread to the index-th of the cores it's allowed to run on (which needn't be numbered
+// from 0, or contiguously, under taskset or a cpuset)
+static void
+batch_pin_ (int index)
+{
+#ifdef __linux__
+	cpu_set_t allowed;
+	int cpus[CPU_SETSIZE];
+	int num_cpus = 0;
+	
+	if (sched_getaffinity(0, sizeof(allowed), &allowed))
+	{
+		return;
+	}
+	for (int i = 0; i < CPU_SETSIZE; i++)
+	{
+		if (CPU_ISSET(i, &allowed))
+		{
+			cpus[num_cpus++] = i;
+		}
+	}
+	
+	if (num_cpus > 0)
+	{
+		cpu_set_t pinned;
+		CPU_ZERO(&pinned);
+		CPU_SET(cpus[index % num_cpus], &pinned);
+		pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned);
+	}
+#else
+	(void)index;
+#endif
+}
+
+// Number of cores the process may run on
+static int
+batch_num_cpus_ (void)
+{
+#ifdef __linux__
+	cpu_set_t allowed;
+	if (!sched_getaffinity(0, sizeof(allowed), &allowed))
+	{
+		return CPU_COUNT(&allowed);
+	}
+#endif
+	long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return (num_cpus > 0) ? num_cpus : 1;
+}
+
+static void *
+batch_worker_ (void *arg)
+{
+	pilot_batch_worker *worker = arg;
+	pilot_batch *batch = worker->batch;
+	
+	batch_pin_(worker->index);
+	
+	// allocated on the worker's own core; far too big for a thread stack anyway
+	Pilot_cpu *cpu = aligned_alloc(_Alignof(Pilot_cpu), sizeof(Pilot_cpu));
+	if (!cpu)
+	{
+		return NULL;
+	}
+	
+	size_t job;
+	while (batch_take_own_(&batch->queues[worker->index], &job) || (batch_steal_(batch, worker->index) && batch_take_own_(&batch->queues[worker->index], &job)))
+	{
+		batch_run_job_(cpu, &batch->jobs[job]);
+		worker->jobs_done++;
+	}
+	
+	free(cpu);
+	return NULL;
+}
+
+bool
+Pilot_batch_run (Pilot_batch_job *jobs, size_t num_jobs, int num_threads)
+{
+	if (!num_jobs)
+	{
+		return TRUE;
+	}
+	
+	if (num_threads <= 0)
+	{
+		num_threads = batch_num_cpus_();
+	}
+	if ((size_t)num_threads > num_jobs)
+	{
+		num_threads = num_jobs;
+	}
+	
+	pilot_batch batch = {jobs, calloc(num_threads, sizeof(pilot_batch_queue)), num_threads};
+	pilot_batch_worker *workers = calloc(num_threads, sizeof(pilot_batch_worker));
+	if (!batch.queues || !workers)
+	{
+		free(batch.queues);
+		free(workers);
+		return FALSE;
+	}
+	
+	for (int i = 0; i < num_threads; i++)
+	{
+		pthread_mutex_init(&batch.queues[i].lock, NULL);
+		batch.queues[i].next = num_jobs * i / num_threads;
+		batch.queues[i].end = num_jobs * (i + 1) / num_threads;
+		workers[i].batch = &batch;
+		workers[i].index = i;
+	}
+	
+	// a worker that fails to start simply has its share stolen by the others
+	for (int i = 0; i < num_threads; i++)
+	{
+		workers[i].started = (pthread_create(&workers[i].thread, NULL, batch_worker_, &workers[i]) == 0);
+	}
+	
+	size_t jobs_done = 0;
+	for (int i = 0; i < num_threads; i++)
+	{
+		if (workers[i].started)
+		{
+			pthread_join(workers[i].thread, NULL);
+			jobs_done += workers[i].jobs_done;
+		}
+	}
+	
+	for (int i = 0; i < num_threads; i++)
+	{
+		pthread_mutex_destroy(&batch.queues[i].lock);
+	}
+	free(workers);
+	free(batch.queues);
+	
+	return jobs_done == num_jobs;
+}
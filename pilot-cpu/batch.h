@@ -0,0 +1,48 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "types.h"
+#include "cpu.h"
+
+typedef struct Pilot_batch_job_ Pilot_batch_job;
+
+// Called on the worker thread that ran the job; cpu is only valid during the call
+typedef void (*Pilot_batch_callback) (Pilot_batch_job *job, Pilot_cpu *cpu);
+// Called on the worker thread after every frame; returning FALSE ends the job early
+typedef bool (*Pilot_batch_frame_callback) (Pilot_batch_job *job, Pilot_cpu *cpu, uint32_t frame);
+
+// One independent run: a fresh machine with rom mapped read-only at rom_addr, started at start_addr
+struct Pilot_batch_job_
+{
+	const uint8_t *rom;
+	size_t rom_size;
+	// Must be page aligned (cartridge ROM starts at 0x200000)
+	uint32_t rom_addr;
+	uint32_t start_addr;
+	Pilot_exec_mode exec_mode;
+	
+	// The budget: num_frames frames of cycles_per_frame cycles each, or num_cycles cycles if num_frames is 0
+	uint64_t num_cycles;
+	uint32_t num_frames;
+	uint64_t cycles_per_frame;
+	
+	// All optional. setup runs after the machine is initialized, to install handlers, events and so on
+	Pilot_batch_callback setup;
+	Pilot_batch_frame_callback frame;
+	Pilot_batch_callback result;
+	void *ctx;
+	
+	// Filled in by the runner
+	uint64_t cycles_run;
+	uint32_t frames_run;
+};
+
+// Runs every job to completion over a pool of num_threads workers (0: one per core the process may run
+// on), each pinned to its own one of those cores where the platform allows it. Workers start on an even share of the jobs and steal
+// from each other once their own share runs out.
+// Returns FALSE unless every job was run (if workers couldn't be started or couldn't allocate a machine)
+bool Pilot_batch_run (Pilot_batch_job *jobs, size_t num_jobs, int num_threads);
+
+#endif
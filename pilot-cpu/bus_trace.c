@@ -0,0 +1,158 @@
+#include "bus_trace.h"
+
+// longest line: "18446744073709551615 WR16 $ffff -> $ffffff\n"
+#define TEXT_LINE_MAX	48
+
+void
+Pilot_bus_trace_off (Pilot_system *sys)
+{
+	Pilot_bus_trace_flush(sys);
+	sys->trace.mode = BTRACE_OFF;
+}
+
+void
+Pilot_bus_trace_to_ring (Pilot_system *sys, Pilot_bus_trace_record *ring, uint32_t num_records)
+{
+	Pilot_bus_trace_flush(sys);
+	
+	// round down to a power of 2
+	while (num_records & (num_records - 1))
+	{
+		num_records &= num_records - 1;
+	}
+	
+	sys->trace.ring = ring;
+	sys->trace.ring_mask = num_records - 1;
+	sys->trace.ring_head = 0;
+	sys->trace.mode = (ring && num_records) ? BTRACE_RING : BTRACE_OFF;
+}
+
+void
+Pilot_bus_trace_to_text (Pilot_system *sys, FILE *out, char *buf, size_t size)
+{
+	Pilot_bus_trace_flush(sys);
+	
+	sys->trace.text_out = out;
+	sys->trace.text_buf = buf;
+	sys->trace.text_size = size;
+	sys->trace.text_len = 0;
+	sys->trace.mode = (out && buf && size >= TEXT_LINE_MAX) ? BTRACE_TEXT : BTRACE_OFF;
+}
+
+void
+Pilot_bus_trace_flush (Pilot_system *sys)
+{
+	if (sys->trace.mode == BTRACE_TEXT && sys->trace.text_len)
+	{
+		fwrite(sys->trace.text_buf, 1, sys->trace.text_len, sys->trace.text_out);
+		sys->trace.text_len = 0;
+	}
+}
+
+static inline char *
+text_put_hex_ (char *p, uint32_t value, int digits)
+{
+	static const char hex[] = "0123456789abcdef";
+	for (int i = digits - 1; i >= 0; i--)
+	{
+		p[i] = hex[value & 0xf];
+		value >>= 4;
+	}
+	return p + digits;
+}
+
+static inline char *
+text_put_dec_ (char *p, uint64_t value)
+{
+	char digits[20];
+	int n = 0;
+	
+	do
+	{
+		digits[n++] = '0' + (value % 10);
+		value /= 10;
+	} while (value);
+	
+	while (n)
+	{
+		*p++ = digits[--n];
+	}
+	return p;
+}
+
+static inline char *
+text_put_str_ (char *p, const char *str)
+{
+	while (*str)
+	{
+		*p++ = *str++;
+	}
+	return p;
+}
+
+static void
+text_emit_ (Pilot_bus_trace *trace, const Pilot_bus_trace_record *rec)
+{
+	if (trace->text_size - trace->text_len < TEXT_LINE_MAX)
+	{
+		fwrite(trace->text_buf, 1, trace->text_len, trace->text_out);
+		trace->text_len = 0;
+	}
+	
+	char *p = trace->text_buf + trace->text_len;
+	
+	p = text_put_dec_(p, rec->cycle);
+	*p++ = ' ';
+	
+	switch (rec->dir)
+	{
+		case BTRACE_READ:
+			p = text_put_str_(p, rec->is_16bit ? "RD16 $" : "RD08 $");
+			p = text_put_hex_(p, rec->addr, 6);
+			p = text_put_str_(p, " -> $");
+			p = text_put_hex_(p, rec->data, rec->is_16bit ? 4 : 2);
+			break;
+		case BTRACE_WRITE:
+			p = text_put_str_(p, rec->is_16bit ? "WR16 $" : "WR08 $");
+			p = text_put_hex_(p, rec->data, rec->is_16bit ? 4 : 2);
+			p = text_put_str_(p, " -> $");
+			p = text_put_hex_(p, rec->addr, 6);
+			break;
+		default:
+			p = text_put_str_(p, "WAIT");
+			break;
+	}
+	*p++ = '\n';
+	
+	trace->text_len = p - trace->text_buf;
+}
+
+void
+Pilot_bus_trace_emit (Pilot_system *sys, Pilot_bus_trace_dir dir, bool is_16bit, uint32_t addr, uint16_t data)
+{
+	Pilot_bus_trace *trace = &sys->trace;
+	Pilot_bus_trace_record rec;
+	
+	if (dir == BTRACE_IDLE && !trace->record_idle)
+	{
+		return;
+	}
+	
+	rec.cycle = sys->cycles;
+	rec.addr = addr;
+	rec.data = is_16bit ? data : (data & 0xff);
+	rec.is_16bit = is_16bit;
+	rec.dir = dir;
+	
+	switch (trace->mode)
+	{
+		case BTRACE_RING:
+			trace->ring[trace->ring_head++ & trace->ring_mask] = rec;
+			break;
+		case BTRACE_TEXT:
+			text_emit_(trace, &rec);
+			break;
+		default:
+			break;
+	}
+}
@@ -0,0 +1,29 @@
+#ifndef __BUS_TRACE_H__
+#define __BUS_TRACE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pilot.h"
+
+// Set PILOT_BUS_TRACE to 0 to compile out every trace hook on the memory bus
+#ifndef PILOT_BUS_TRACE
+#define PILOT_BUS_TRACE 1
+#endif
+
+void Pilot_bus_trace_off (Pilot_system *sys);
+void Pilot_bus_trace_to_ring (Pilot_system *sys, Pilot_bus_trace_record *ring, uint32_t num_records);
+void Pilot_bus_trace_to_text (Pilot_system *sys, FILE *out, char *buf, size_t size);
+
+// Writes out any buffered text (does nothing in the other modes)
+void Pilot_bus_trace_flush (Pilot_system *sys);
+
+void Pilot_bus_trace_emit (Pilot_system *sys, Pilot_bus_trace_dir dir, bool is_16bit, uint32_t addr, uint16_t data);
+
+#if PILOT_BUS_TRACE
+#define PILOT_BUS_TRACE_(sys, dir, is_16bit, addr, data) \
+	do { if ((sys)->trace.mode != BTRACE_OFF) Pilot_bus_trace_emit((sys), (dir), (is_16bit), (addr), (data)); } while (0)
+#else
+#define PILOT_BUS_TRACE_(sys, dir, is_16bit, addr, data) do { } while (0)
+#endif
+
+#endif
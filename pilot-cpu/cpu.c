@@ -0,0 +1,403 @@
+#include "cpu.h"
+#include "cpu_mucode.h"
+#include "memory.h"
+#include "scheduler.h"
+#include "bus_trace.h"
+#include <string.h>
+
+// Estimated cost of each part of a fast mode step, in memory controller cycles. Instruction words are
+// prefetched while earlier instructions execute, so they only cost anything after the fetch unit has been
+// sent elsewhere: to a predicted branch target, or, later still, away from a mispredicted one
+enum
+{
+	FAST_COST_CONTROL_WORD = 0,
+	FAST_COST_BUS_ACCESS,
+	FAST_COST_INST_WORD,
+	FAST_COST_BRANCH,
+	FAST_COST_MISPREDICT,
+	FAST_COST_BUS_RETRY,
+	
+	FAST_NUM_COSTS
+};
+
+static const uint8_t fast_timing_[FAST_NUM_COSTS] =
+{
+	[FAST_COST_CONTROL_WORD] = 1,
+	[FAST_COST_BUS_ACCESS] = 1,
+	[FAST_COST_INST_WORD] = 0,
+	[FAST_COST_BRANCH] = 2,
+	[FAST_COST_MISPREDICT] = 5,
+	[FAST_COST_BUS_RETRY] = 1
+};
+
+// Points an empty fetch unit and decoder at addr
+static void
+cpu_restart_fetch_ (Pilot_cpu *cpu, uint32_t addr)
+{
+	pilot_interconnect *interconnects = &cpu->sys.interconnects;
+	
+	cpu->fetch.queue_full = 0;
+	cpu->fetch.queue_head = cpu->fetch.queue_tail;
+	cpu->fetch.mem_access_waiting = FALSE;
+	cpu->fetch.fetch_phase = FETCH_HALF1_READY;
+	cpu->decode.decoding_phase = DECODER_HALF1_READY;
+	
+	interconnects->fetch_word_semaph = FALSE;
+	interconnects->decode_branch = FALSE;
+	interconnects->decode_stall = FALSE;
+	interconnects->execute_branch = FALSE;
+	interconnects->execute_memory_backoff = FALSE;
+	
+	// the fetch unit advances fetch_addr as each word is dequeued
+	cpu->fetch.mem_addr = addr & 0xfffffe;
+	interconnects->fetch_addr = (addr - 2) & 0xfffffe;
+}
+
+void
+Pilot_cpu_init (Pilot_cpu *cpu, uint32_t start_addr)
+{
+	memset(cpu, 0, sizeof(*cpu));
+	
+	cpu->fetch.sys = &cpu->sys;
+	cpu->decode.sys = &cpu->sys;
+	cpu->execute.sys = &cpu->sys;
+	
+	mucode_rom_init();
+	Pilot_mem_map_init(&cpu->sys);
+	Pilot_sched_init(&cpu->sys);
+	cpu->sys.memctl.data_cycle = UINT64_MAX;
+	
+	cpu_restart_fetch_(cpu, start_addr);
+	cpu->fast_pgc = start_addr & 0xfffffe;
+}
+
+// One full cycle; only valid while the clock is enabled
+static inline void
+cpu_cycle_ (Pilot_cpu *cpu)
+{
+	Pilot_memctl_tick(&cpu->sys);
+	
+	pilot_fetch_half1_clocked(&cpu->fetch);
+	pilot_decode_half1_clocked(&cpu->decode);
+	pilot_execute_half1_clocked(&cpu->execute);
+	
+	pilot_fetch_half2_clocked(&cpu->fetch);
+	pilot_decode_half2_clocked(&cpu->decode);
+	// the only stage that can disable the clock, so checking once per cycle is enough
+	pilot_execute_half2_clocked(&cpu->execute);
+}
+
+static inline void
+cpu_dispatch_events_ (Pilot_cpu *cpu)
+{
+	if (cpu->sys.cycles >= cpu->sys.sched.next_cycle)
+	{
+		// event handlers are host code, which may look at the flags
+		pilot_execute_flags_sync(&cpu->execute);
+		Pilot_sched_dispatch(&cpu->sys);
+	}
+}
+
+// Advances a halted core by at most max_cycles: a memory access still in flight is clocked normally,
+// otherwise nothing can change before the next event, so time skips straight to it
+static inline void
+cpu_halted_step_ (Pilot_cpu *cpu, uint64_t max_cycles)
+{
+	Pilot_system *sys = &cpu->sys;
+	
+	if (sys->memctl.state != MCTL_READY)
+	{
+		Pilot_memctl_tick(sys);
+	}
+	else if (sys->sched.next_cycle > sys->cycles)
+	{
+		uint64_t skip = sys->sched.next_cycle - sys->cycles;
+		Pilot_memctl_tick_idle(sys, (skip < max_cycles) ? skip : max_cycles);
+	}
+	
+	cpu_dispatch_events_(cpu);
+}
+
+// Switches from the pipeline to fast mode right after the execute stage has taken a new instruction;
+// the fetch unit and decoder are simply abandoned
+static void
+cpu_try_enter_fast_ (Pilot_cpu *cpu)
+{
+	Pilot_system *sys = &cpu->sys;
+	
+	if (!cpu->execute.inst_latched || cpu->execute.mem_access_waiting || sys->memctl.state != MCTL_READY)
+	{
+		cpu->execute.inst_latched = FALSE;
+		return;
+	}
+	
+	// where the decoder went on from; the execute unit corrects that at the end of the instruction if need be
+	cpu->fast_pgc = cpu->execute.decoded_inst.next_pgc;
+	
+	cpu_restart_fetch_(cpu, cpu->fast_pgc);
+	cpu->exec_mode = PILOT_EXEC_FAST;
+}
+
+// Lanes in lockstep usually run the same code out of the same host memory; when the instruction a lane
+// needs next is the one leader last decoded, from the same bytes, it can be copied instead
+static bool
+cpu_share_decode_ (Pilot_cpu *cpu, const Pilot_cpu *leader)
+{
+	const inst_decoded_flags *inst = leader->sys.interconnects.decoded_inst;
+	uint32_t pgc = cpu->fast_pgc;
+	
+	if (!inst || inst->illegal || inst->inst_pgc != pgc)
+	{
+		return FALSE;
+	}
+#if PILOT_BUS_TRACE
+	if (cpu->sys.trace.mode != BTRACE_OFF)
+	{
+		// instruction fetches have to show up in the trace
+		return FALSE;
+	}
+#endif
+	
+	const Pilot_mem_page *page = &cpu->sys.mem_map.pages[pgc >> MEM_PAGE_SHIFT];
+	const Pilot_mem_page *leader_page = &leader->sys.mem_map.pages[pgc >> MEM_PAGE_SHIFT];
+	if (!page->mem || page->mem != leader_page->mem || (pgc & MEM_PAGE_MASK) + 2 * leader->decode.inst_length > page->read_limit)
+	{
+		return FALSE;
+	}
+	
+	cpu->decode.decoded_inst = *inst;
+	pilot_decode_dispatch_inst(&cpu->decode, pgc, leader->decode.inst_length, &cpu->decode.decoded_inst);
+	return TRUE;
+}
+
+// Runs one control word in fast mode, sharing leader's decoding if there is a leader; iterations of a
+// repeated instruction may be skipped ahead as long as they're over before cycle_limit
+static void
+cpu_fast_step_ (Pilot_cpu *cpu, const Pilot_cpu *leader, uint64_t cycle_limit)
+{
+	Pilot_system *sys = &cpu->sys;
+	pilot_interconnect *interconnects = &sys->interconnects;
+	uint64_t cost = 0;
+	
+	// like the real decoder, keep the next instruction ready for the sequencer
+	if (!interconnects->decoded_inst_semaph)
+	{
+		bool dispatched = FALSE;
+#if PILOT_DECODE_CACHE
+		dispatched = pilot_decode_inst_cached(&cpu->decode, cpu->fast_pgc);
+#endif
+		if (!dispatched && leader)
+		{
+			dispatched = cpu_share_decode_(cpu, leader);
+		}
+		if (!dispatched && !pilot_decode_inst_sync(&cpu->decode, cpu->fast_pgc))
+		{
+			sys->cycles += fast_timing_[FAST_COST_BUS_RETRY];
+			return;
+		}
+		
+		// the decoder follows its own branch predictions, so fast mode runs into the same mispredictions
+		uint32_t fall_through = (cpu->fast_pgc + 2 * cpu->decode.inst_length) & 0xfffffe;
+		cpu->fast_pgc = interconnects->decoded_inst->next_pgc;
+		cost += cpu->decode.inst_length * fast_timing_[FAST_COST_INST_WORD];
+		if (cpu->fast_pgc != fall_through)
+		{
+			cost += fast_timing_[FAST_COST_BRANCH];
+		}
+	}
+	
+	int accesses = pilot_execute_step_sync(&cpu->execute);
+	if (accesses < 0)
+	{
+		sys->cycles += cost + fast_timing_[FAST_COST_BUS_RETRY];
+		return;
+	}
+	
+	cost += fast_timing_[FAST_COST_CONTROL_WORD] + accesses * fast_timing_[FAST_COST_BUS_ACCESS];
+	
+	if (interconnects->execute_branch)
+	{
+		interconnects->execute_branch = FALSE;
+		interconnects->decode_stall = FALSE;
+		cpu->fast_pgc = interconnects->execute_branch_addr;
+		cost += fast_timing_[FAST_COST_MISPREDICT];
+	}
+	
+	sys->cycles += cost;
+	
+#if PILOT_HOST_MULDIV
+	// the control words skipped make no bus accesses, but events and cycle_limit must still find them done,
+	// and the next instruction must already be decoded, as the first of them would otherwise do that
+	if (cpu->execute.sequencer_phase == EXEC_SEQ_RUN_AFTER && interconnects->decoded_inst_semaph)
+	{
+		uint64_t limit = (sys->sched.next_cycle < cycle_limit) ? sys->sched.next_cycle : cycle_limit;
+		if (limit > sys->cycles)
+		{
+			uint64_t max_words = (limit - sys->cycles) / fast_timing_[FAST_COST_CONTROL_WORD];
+			sys->cycles += pilot_execute_muldiv(&cpu->execute, (max_words < UINT32_MAX) ? max_words : UINT32_MAX) * fast_timing_[FAST_COST_CONTROL_WORD];
+		}
+	}
+#endif
+	
+#if PILOT_REPEAT_BULK
+	if (cpu->execute.repeat_latched)
+	{
+		// nothing the host can see may happen in between: no events and, while tracing, no bus accesses
+		cpu->execute.repeat_latched = FALSE;
+		if (sys->sched.next_cycle < cycle_limit)
+		{
+			cycle_limit = sys->sched.next_cycle;
+		}
+#if PILOT_BUS_TRACE
+		if (sys->trace.mode != BTRACE_OFF)
+		{
+			cycle_limit = 0;
+		}
+#endif
+		pilot_execute_repeat_bulk(&cpu->execute, cycle_limit);
+	}
+#else
+	(void)cycle_limit;
+#endif
+	
+	if (cpu->exec_mode_requested != PILOT_EXEC_FAST && cpu->execute.inst_latched)
+	{
+		// back to the pipeline, which picks up right after the instruction that was just taken
+		pilot_execute_sync_flush(&cpu->execute);
+		cpu_restart_fetch_(cpu, cpu->fast_pgc);
+		cpu->exec_mode = PILOT_EXEC_CYCLE;
+	}
+	cpu->execute.inst_latched = FALSE;
+}
+
+void
+Pilot_set_exec_mode (Pilot_cpu *cpu, Pilot_exec_mode mode)
+{
+	cpu->exec_mode_requested = mode;
+	cpu->execute.inst_latched = FALSE;
+	
+	if (cpu->execute.execution_phase == EXEC_START && !cpu->sys.interconnects.decoded_inst_semaph)
+	{
+		// nothing has been decoded yet, so both engines are still at the start address
+		if (mode == PILOT_EXEC_FAST && cpu->exec_mode != PILOT_EXEC_FAST)
+		{
+			cpu->fast_pgc = cpu->fetch.mem_addr;
+		}
+		else if (mode == PILOT_EXEC_CYCLE && cpu->exec_mode != PILOT_EXEC_CYCLE)
+		{
+			cpu_restart_fetch_(cpu, cpu->fast_pgc);
+		}
+		cpu->exec_mode = mode;
+	}
+}
+
+// Runs one step of whichever engine is in effect
+static inline void
+cpu_step_ (Pilot_cpu *cpu, const Pilot_cpu *leader, uint64_t cycle_limit)
+{
+	if (cpu->exec_mode == PILOT_EXEC_FAST)
+	{
+		cpu_fast_step_(cpu, leader, cycle_limit);
+	}
+	else
+	{
+		cpu_cycle_(cpu);
+		if (cpu->exec_mode_requested != PILOT_EXEC_CYCLE)
+		{
+			cpu_try_enter_fast_(cpu);
+		}
+	}
+}
+
+void
+Pilot_cpu_step (Pilot_cpu *cpu, const Pilot_cpu *leader, uint64_t max_cycles)
+{
+	Pilot_system *sys = &cpu->sys;
+	
+	if (sys->core.disable_clk)
+	{
+		cpu_halted_step_(cpu, max_cycles);
+		return;
+	}
+	
+	cpu_step_(cpu, leader, (max_cycles < UINT64_MAX - sys->cycles) ? sys->cycles + max_cycles : UINT64_MAX);
+	cpu_dispatch_events_(cpu);
+}
+
+uint64_t
+Pilot_run_cycles (Pilot_cpu *cpu, uint64_t num_cycles)
+{
+	Pilot_system *sys = &cpu->sys;
+	uint64_t start = sys->cycles;
+	// UINT64_MAX runs for good rather than wrapping around
+	uint64_t end = (num_cycles < UINT64_MAX - start) ? start + num_cycles : UINT64_MAX;
+	
+	while (sys->cycles < end)
+	{
+		if (sys->core.disable_clk)
+		{
+			cpu_halted_step_(cpu, end - sys->cycles);
+		}
+		else if (cpu->exec_mode == PILOT_EXEC_FAST)
+		{
+			do
+			{
+				cpu_fast_step_(cpu, NULL, end);
+				cpu_dispatch_events_(cpu);
+			}
+			while (sys->cycles < end && !sys->core.disable_clk && cpu->exec_mode == PILOT_EXEC_FAST);
+		}
+		else
+		{
+			do
+			{
+				cpu_cycle_(cpu);
+				cpu_dispatch_events_(cpu);
+				if (cpu->exec_mode_requested != PILOT_EXEC_CYCLE)
+				{
+					cpu_try_enter_fast_(cpu);
+				}
+			}
+			while (sys->cycles < end && !sys->core.disable_clk && cpu->exec_mode == PILOT_EXEC_CYCLE);
+		}
+	}
+	
+	pilot_execute_flags_sync(&cpu->execute);
+	return sys->cycles - start;
+}
+
+uint64_t
+Pilot_run_until (Pilot_cpu *cpu, Pilot_run_predicate predicate, void *ctx)
+{
+	Pilot_system *sys = &cpu->sys;
+	uint64_t start = sys->cycles;
+	
+	do
+	{
+		if (!sys->core.disable_clk)
+		{
+			// the predicate has to see every iteration go by
+			cpu_step_(cpu, NULL, 0);
+			cpu_dispatch_events_(cpu);
+		}
+		else if (sys->sched.num_events)
+		{
+			cpu_halted_step_(cpu, UINT64_MAX);
+		}
+		else
+		{
+			// nothing will ever wake the core; keep ticking in case the predicate is watching the clock
+			Pilot_memctl_tick(sys);
+		}
+	}
+	while (!predicate(cpu, ctx));
+	
+	pilot_execute_flags_sync(&cpu->execute);
+	return sys->cycles - start;
+}
+
+uint16_t
+Pilot_cpu_wf (const Pilot_cpu *cpu)
+{
+	return pilot_execute_flags_value(&cpu->execute);
+}
@@ -0,0 +1,58 @@
+#ifndef __CPU_H__
+#define __CPU_H__
+
+#include <stdint.h>
+#include "types.h"
+#include "pilot.h"
+#include "cpu_fetch.h"
+#include "cpu_decode.h"
+#include "cpu_execute.h"
+
+typedef enum
+{
+	// Cycle-accurate: every stage of the pipeline is clocked each half-cycle
+	PILOT_EXEC_CYCLE = 0,
+	// Functional: one control word at a time with synchronous memory, cycles estimated from a timing table
+	PILOT_EXEC_FAST
+} Pilot_exec_mode;
+
+// A complete machine: the system state plus the pipeline stages clocking it
+typedef struct
+{
+	Pilot_system sys;
+	pilot_fetch_state fetch;
+	pilot_decode_state decode;
+	pilot_execute_state execute;
+	
+	Pilot_exec_mode exec_mode;
+	// Switches only happen at instruction boundaries, so a requested mode may not be in effect yet
+	Pilot_exec_mode exec_mode_requested;
+	// Fast mode: where the next instruction is decoded from
+	uint32_t fast_pgc;
+} Pilot_cpu;
+
+// Returns TRUE to stop Pilot_run_until; called after every cycle (every control word in fast mode),
+// or after every skip while the core is halted. sys.core.wf may be behind then; use Pilot_cpu_wf
+typedef bool (*Pilot_run_predicate) (Pilot_cpu *cpu, void *ctx);
+
+// Resets the machine and points the fetch unit at start_addr
+void Pilot_cpu_init (Pilot_cpu *cpu, uint32_t start_addr);
+
+// Takes effect at the next instruction boundary (immediately if the machine hasn't started yet)
+void Pilot_set_exec_mode (Pilot_cpu *cpu, Pilot_exec_mode mode);
+
+// One step of whichever engine is in effect (a skip of at most max_cycles if the core is halted, and in fast
+// mode, never more than max_cycles' worth of iterations of a repeated instruction carried out at once).
+// In fast mode, an instruction that leader has just decoded out of the same host memory is copied
+// rather than decoded again; leader may be NULL. sys.core.wf may be behind afterwards; use Pilot_cpu_wf
+void Pilot_cpu_step (Pilot_cpu *cpu, const Pilot_cpu *leader, uint64_t max_cycles);
+
+// Both return the number of cycles actually run, with sys.core.wf up to date
+uint64_t Pilot_run_cycles (Pilot_cpu *cpu, uint64_t num_cycles);
+uint64_t Pilot_run_until (Pilot_cpu *cpu, Pilot_run_predicate predicate, void *ctx);
+
+// WF including the flags of the last ALU operation, which the execute stage only writes to sys.core.wf
+// when something outside it needs them
+uint16_t Pilot_cpu_wf (const Pilot_cpu *cpu);
+
+#endif
@@ -1,7 +1,11 @@
 #include "cpu_regs.h"
 #include "cpu_decode.h"
 #include "cpu_decode_rm.h"
+#include "cpu_execute.h"
 #include "memory.h"
+#include "perf_counters.h"
+#include "bus_trace.h"
+#include <string.h>
 
 /*
  * Pipeline stages:
@@ -82,11 +86,6 @@
  * 
  */
 
-void decode_not_implemented_ (void)
-{
-	decode_unreachable_();
-}
-
 static void
 decode_invalid_opcode_ (pilot_decode_state *state)
 {
@@ -251,7 +250,7 @@ decode_inst_branch_ (pilot_decode_state *state, uint16_t opcode)
 		run_after->reg_select = (opcode >> 8) & 0xf;
 		
 		state->sys->interconnects.decode_branch = TRUE;
-		state->sys->interconnects.decode_branch_addr = state->pgc + (0xffffff00 | ((opcode & 0x00ff) * 2));
+		state->sys->interconnects.decode_branch_addr = (state->pgc + 2 * (int8_t)(opcode & 0x00ff)) & 0xfffffe;
 		
 		return;
 	}
@@ -1025,10 +1024,10 @@ decode_inst_other_ (pilot_decode_state *state, uint16_t opcode)
 		
 		run_after->entry_idx = MU_MUL_LD_FACTOR_A;
 		run_after->size = size;
-		run_after->reg_select = ((opcode >> 3) & 0x8) | ((opcode >> 2) & 0x10);
+		run_after->reg_select = (opcode >> 3) & 0x8;
 		return;
 	}
-	if ((opcode & 0x38c0) == 0x0880)
+	if ((opcode & 0x3880) == 0x0880)
 	{
 		// DIVU / DIVS
 		rm_spec rm_src = opcode & 0x3f;
@@ -1041,12 +1040,9 @@ decode_inst_other_ (pilot_decode_state *state, uint16_t opcode)
 		decode_rm_specifier(state, rm_src, FALSE, FALSE, size);
 		core_op->dest.location = DATA_LATCH_FACTOR_B;
 		
-		run_after->entry_idx = MU_DIV_TEST_DIVIDEND_HI;
+		run_after->entry_idx = MU_DIV_TEST_FACTOR_B;
 		run_after->size = size;
-		
-		// relevant microcode isn't implemented yet
-		decode_not_implemented_();
-		
+		run_after->reg_select = (opcode >> 3) & 0x8;
 		return;
 	}
 	
@@ -1088,6 +1084,8 @@ decode_inst_ (pilot_decode_state *state)
 	work_regs->core_op.latch_aux_mode = LATCH_AUX_NONE;
 	work_regs->core_op.mem_latch_ctl = MEM_NO_LATCH;
 	work_regs->core_op.mem_access_suppress = FALSE;
+	work_regs->core_op.is_24bit = FALSE;
+	work_regs->core_op.is_24bit_high = FALSE;
 	
 	work_regs->run_after.entry_idx = MU_NONE;
 	work_regs->run_after.reg_select = 0;
@@ -1116,35 +1114,101 @@ decode_inst_ (pilot_decode_state *state)
 	if ((opcode & 0xf000) >= 0xe000)
 	{
 		// Branch instructions
+		work_regs->inst_class = INST_CLASS_BRANCH;
 		decode_inst_branch_(state, opcode);
 	}
 	else if ((opcode & 0xf000) == 0xd000)
 	{
 		// Bit operations
+		work_regs->inst_class = INST_CLASS_BIT;
 		decode_inst_bit_(state, opcode);
 	}
 	else if ((opcode & 0xf000) == 0xc000)
 	{
 		// Two miscellaneous LD instructions
+		work_regs->inst_class = INST_CLASS_LD_OTHER;
 		decode_inst_ld_other_(state, opcode);
 	}
 	else if ((opcode & 0x2000) == 0x2000)
 	{
 		// Arithmetic/logic instructions
+		work_regs->inst_class = INST_CLASS_ARITHLOGIC;
 		decode_inst_arithlogic_(state, opcode);
 	}
 	else if ((opcode & 0x3000) == 0x1000)
 	{
 		// Main group of LD instructions
+		work_regs->inst_class = INST_CLASS_LD_GROUP;
 		decode_inst_ld_group_(state, opcode);
 	}
 	else if ((opcode & 0x3000) == 0x0000)
 	{
 		// Everything else
+		work_regs->inst_class = INST_CLASS_OTHER;
 		decode_inst_other_(state, opcode);
 	}
+	
+	pilot_execute_compile_control(&work_regs->core_op);
 }
 
+#if PILOT_DECODE_CACHE
+// Same as decode_inst_, but reuses the result from the last time this word was decoded at this address
+static void
+decode_inst_cached_ (pilot_decode_state *state)
+{
+	pilot_interconnect *interconnects = &state->sys->interconnects;
+	uint16_t opcode = state->work_regs.imm_words[0];
+	Pilot_mem_page *page = &state->sys->mem_map.pages[(state->pgc >> MEM_PAGE_SHIFT) & (MEM_NUM_PAGES - 1)];
+	decode_cache_entry *entry = &state->cache[(state->pgc >> 1) & (DECODE_CACHE_SIZE - 1)];
+	
+	if (entry->valid && entry->pgc == state->pgc && entry->opcode == opcode && entry->code_gen == page->code_gen)
+	{
+		uint16_t imm_words[5];
+		memcpy(imm_words, state->work_regs.imm_words, sizeof(imm_words));
+		state->work_regs = entry->work_regs;
+		memcpy(state->work_regs.imm_words, imm_words, sizeof(imm_words));
+		
+		state->words_to_read += entry->words_to_read;
+		state->rm_ops = entry->rm_ops;
+		if (entry->decode_branch)
+		{
+			interconnects->decode_branch = TRUE;
+			interconnects->decode_branch_addr = entry->decode_branch_addr;
+		}
+		return;
+	}
+	
+	bool decode_branch = interconnects->decode_branch;
+	uint8_t words_to_read = state->words_to_read;
+	
+	interconnects->decode_branch = FALSE;
+	state->no_cache = FALSE;
+	decode_inst_(state);
+	
+	// only code in directly mapped memory is cached; anything else may change without being written
+	if (!state->no_cache && (state->pgc & MEM_PAGE_MASK) < page->read_limit)
+	{
+		entry->valid = TRUE;
+		entry->complete = FALSE;
+		entry->opcode = opcode;
+		entry->pgc = state->pgc;
+		entry->code_gen = page->code_gen;
+		entry->words_to_read = state->words_to_read - words_to_read;
+		entry->rm_ops = state->rm_ops;
+		entry->decode_branch = interconnects->decode_branch;
+		entry->decode_branch_addr = interconnects->decode_branch_addr;
+		entry->work_regs = state->work_regs;
+		
+		page->has_code = TRUE;
+	}
+	
+	if (!interconnects->decode_branch)
+	{
+		interconnects->decode_branch = decode_branch;
+	}
+}
+#endif
+
 void
 decode_queue_read_word (pilot_decode_state *state)
 {
@@ -1155,6 +1219,13 @@ static bool
 decode_try_read_word_ (pilot_decode_state *state)
 {
 	bool *fetch_word_semaph = &state->sys->interconnects.fetch_word_semaph;
+	
+	// until the fetch unit has been sent to a new address, the word it's holding is from the old one
+	if (state->sys->interconnects.decode_branch || state->sys->interconnects.execute_branch)
+	{
+		return FALSE;
+	}
+	
 	if (*fetch_word_semaph) {
 		*fetch_word_semaph = FALSE;
 		state->work_regs.imm_words[state->inst_length++] = state->sys->interconnects.fetch_word;
@@ -1164,6 +1235,56 @@ decode_try_read_word_ (pilot_decode_state *state)
 	return FALSE;
 }
 
+// Where decoding goes on from after the instruction in work_regs
+static inline uint32_t
+decode_next_pgc_ (pilot_decode_state *state)
+{
+	if (state->branch_predicted)
+	{
+		return state->sys->interconnects.decode_branch_addr & 0xfffffe;
+	}
+	
+	return (state->pgc + 2 * state->inst_length) & 0xfffffe;
+}
+
+#if PILOT_DECODE_CACHE
+// Once every word of a cached instruction has been read from its page, the entry can hold all of it
+static void
+decode_cache_complete_ (pilot_decode_state *state)
+{
+	Pilot_mem_page *page = &state->sys->mem_map.pages[(state->pgc >> MEM_PAGE_SHIFT) & (MEM_NUM_PAGES - 1)];
+	decode_cache_entry *entry = &state->cache[(state->pgc >> 1) & (DECODE_CACHE_SIZE - 1)];
+	
+	if (entry->complete || !entry->valid || entry->pgc != state->pgc || entry->code_gen != page->code_gen
+		|| state->work_regs.illegal || (state->pgc & MEM_PAGE_MASK) + 2 * state->inst_length > page->read_limit)
+	{
+		return;
+	}
+	
+	entry->work_regs = state->work_regs;
+	entry->complete = TRUE;
+}
+#endif
+
+static inline void
+decode_dispatch_ (pilot_decode_state *state)
+{
+	if (!state->work_regs.illegal)
+	{
+		state->work_regs.inst_pgc = state->pgc;
+	}
+	state->work_regs.inst_length = state->inst_length;
+	state->work_regs.next_pgc = decode_next_pgc_(state);
+	pilot_execute_latch_operands(&state->work_regs);
+#if PILOT_DECODE_CACHE
+	decode_cache_complete_(state);
+#endif
+	
+	state->decoded_inst = state->work_regs;
+	state->sys->interconnects.decoded_inst = &state->decoded_inst;
+	state->sys->interconnects.decoded_inst_semaph = TRUE;
+}
+
 void
 pilot_decode_half1 (pilot_decode_state *state)
 {
@@ -1172,8 +1293,17 @@ pilot_decode_half1 (pilot_decode_state *state)
 		return;
 	}
 	
+	pilot_decode_half1_clocked(state);
+}
+
+void
+pilot_decode_half1_clocked (pilot_decode_state *state)
+{
 	if (state->sys->interconnects.decode_stall)
 	{
+		// the execute unit went somewhere else; whatever was decoded from here on is thrown away
+		PILOT_PERF_(state->sys, decode_stalls);
+		state->sys->interconnects.decode_stall = FALSE;
 		state->sys->interconnects.decoded_inst_semaph = FALSE;
 		state->decoding_phase = DECODER_HALF1_READY;
 	}
@@ -1200,7 +1330,12 @@ pilot_decode_half1 (pilot_decode_state *state)
 		bool read_ok = decode_try_read_word_(state);
 		if (read_ok)
 		{
+#if PILOT_DECODE_CACHE
+			decode_inst_cached_(state);
+#else
 			decode_inst_(state);
+#endif
+			state->branch_predicted = state->sys->interconnects.decode_branch;
 			state->decoding_phase = DECODER_HALF2_READ_OPERANDS;
 		}
 	}
@@ -1215,6 +1350,12 @@ pilot_decode_half2 (pilot_decode_state *state)
 		return;
 	}
 	
+	pilot_decode_half2_clocked(state);
+}
+
+void
+pilot_decode_half2_clocked (pilot_decode_state *state)
+{
 	if (state->decoding_phase == DECODER_HALF2_READ_OPERANDS)
 	{
 		if (state->words_to_read > 0)
@@ -1234,16 +1375,84 @@ pilot_decode_half2 (pilot_decode_state *state)
 	
 	if (state->decoding_phase == DECODER_HALF2_DISPATCH)
 	{
-		if (!state->work_regs.illegal)
+		decode_dispatch_(state);
+		state->decoding_phase = DECODER_HALF1_DISPATCH_WAIT;
+	}
+}
+
+bool
+pilot_decode_inst_sync (pilot_decode_state *state, uint32_t pgc)
+{
+	uint16_t word;
+	
+	if (!Pilot_mem_read_sync(state->sys, TRUE, pgc, &word))
+	{
+		return FALSE;
+	}
+	
+	state->pgc = pgc;
+	state->inst_length = 0;
+	state->words_to_read = 0;
+	state->work_regs.imm_words[state->inst_length++] = word;
+	
+#if PILOT_DECODE_CACHE
+	decode_inst_cached_(state);
+#else
+	decode_inst_(state);
+#endif
+	// there's no fetch unit to redirect; the caller goes on from next_pgc itself
+	state->branch_predicted = state->sys->interconnects.decode_branch;
+	state->sys->interconnects.decode_branch = FALSE;
+	
+	for (; state->words_to_read > 0; state->words_to_read--)
+	{
+		if (!Pilot_mem_read_sync(state->sys, TRUE, (pgc + 2 * state->inst_length) & 0xfffffe, &word))
 		{
-			state->work_regs.inst_pgc = state->pgc;
+			return FALSE;
 		}
-		
-		state->decoded_inst = state->work_regs;
-		state->sys->interconnects.decoded_inst = &state->decoded_inst;
-		state->sys->interconnects.decoded_inst_semaph = TRUE;
-		
-		state->decoding_phase = DECODER_HALF1_DISPATCH_WAIT;
+		state->work_regs.imm_words[state->inst_length++] = word;
+	}
+	
+	decode_dispatch_(state);
+	state->decoding_phase = DECODER_HALF1_DISPATCH_WAIT;
+	return TRUE;
+}
+
+
+#if PILOT_DECODE_CACHE
+bool
+pilot_decode_inst_cached (pilot_decode_state *state, uint32_t pgc)
+{
+	Pilot_mem_page *page = &state->sys->mem_map.pages[(pgc >> MEM_PAGE_SHIFT) & (MEM_NUM_PAGES - 1)];
+	decode_cache_entry *entry = &state->cache[(pgc >> 1) & (DECODE_CACHE_SIZE - 1)];
+	
+#if PILOT_BUS_TRACE
+	if (state->sys->trace.mode != BTRACE_OFF)
+	{
+		// instruction fetches have to show up in the trace
+		return FALSE;
+	}
+#endif
+	
+	if (!entry->complete || entry->pgc != pgc || entry->code_gen != page->code_gen)
+	{
+		return FALSE;
 	}
+	
+	state->branch_predicted = entry->decode_branch;
+	pilot_decode_dispatch_inst(state, pgc, entry->work_regs.inst_length, &entry->work_regs);
+	return TRUE;
 }
+#endif
 
+void
+pilot_decode_dispatch_inst (pilot_decode_state *state, uint32_t pgc, uint8_t inst_length, inst_decoded_flags *inst)
+{
+	state->pgc = pgc;
+	state->inst_length = inst_length;
+	state->words_to_read = 0;
+	
+	state->sys->interconnects.decoded_inst = inst;
+	state->sys->interconnects.decoded_inst_semaph = TRUE;
+	state->decoding_phase = DECODER_HALF1_DISPATCH_WAIT;
+}
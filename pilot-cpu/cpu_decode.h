@@ -4,6 +4,33 @@
 #include "types.h"
 #include "pilot.h"
 
+// Set PILOT_DECODE_CACHE to 0 to always decode instructions from scratch
+#ifndef PILOT_DECODE_CACHE
+#define PILOT_DECODE_CACHE 1
+#endif
+
+#define DECODE_CACHE_BITS	10
+#define DECODE_CACHE_SIZE	(1 << DECODE_CACHE_BITS)
+
+// Everything decode_inst_ produces for one instruction word at one address
+typedef struct
+{
+	bool valid;
+	uint16_t opcode;
+	uint32_t pgc;
+	uint64_t code_gen;
+	
+	uint8_t words_to_read;
+	uint8_t rm_ops;
+	bool decode_branch;
+	uint32_t decode_branch_addr;
+	
+	// Set once the whole instruction has been dispatched from the entry's page, operand words included;
+	// work_regs then holds it ready for the execute stage
+	bool complete;
+	inst_decoded_flags work_regs;
+} decode_cache_entry;
+
 typedef struct {
 	Pilot_system *sys;
 	
@@ -13,6 +40,9 @@ typedef struct {
 	
 	uint8_t inst_length;
 	uint8_t words_to_read;
+	// Set if the fetch unit was sent to a predicted branch target after the instruction being decoded
+	bool branch_predicted;
+	
 	enum
 	{
 		DECODER_HALF1_DISPATCH_WAIT = 0,
@@ -25,14 +55,38 @@ typedef struct {
 	
 	// Number of RM operands in current instruction
 	uint8_t rm_ops;
+	
+	// Set while decoding an instruction that mustn't be cached
+	bool no_cache;
+	
+#if PILOT_DECODE_CACHE
+	// Direct-mapped on the instruction address
+	decode_cache_entry cache[DECODE_CACHE_SIZE];
+#endif
 } pilot_decode_state;
 
-void decode_unreachable_ (void);
+// Supplied by the host; called on paths the decoder doesn't implement, and must not return
+_Noreturn void decode_unreachable_ (void);
 
 // Queues in a word read from the fetch unit
 void decode_queue_read_word (pilot_decode_state *state);
 
 void pilot_decode_half1 (pilot_decode_state *state);
 void pilot_decode_half2 (pilot_decode_state *state);
+// As above, for callers that have already checked core.disable_clk
+void pilot_decode_half1_clocked (pilot_decode_state *state);
+void pilot_decode_half2_clocked (pilot_decode_state *state);
+
+// Fast mode: decodes the instruction at pgc straight from memory and dispatches it to the execute stage
+// Returns FALSE if memory wasn't ready (call again to retry)
+bool pilot_decode_inst_sync (pilot_decode_state *state, uint32_t pgc);
+
+#if PILOT_DECODE_CACHE
+// Fast mode: dispatches the instruction at pgc straight out of the decode cache, without touching the bus
+// Returns FALSE if it hasn't been decoded there in full since its page was last written
+bool pilot_decode_inst_cached (pilot_decode_state *state, uint32_t pgc);
+#endif
+// Hands an already decoded instruction to the execute stage; inst must stay put until it's latched
+void pilot_decode_dispatch_inst (pilot_decode_state *state, uint32_t pgc, uint8_t inst_length, inst_decoded_flags *inst);
 
 #endif
@@ -2,11 +2,84 @@
 #include "cpu_execute.h"
 #include "cpu_mucode.h"
 #include "memory.h"
+#include "perf_counters.h"
+#include "profiler.h"
 #include "types.h"
 
-#define ACCESS_REG_BITS_(state, r, size) state->sys->core.regs[r] & (((size) == SIZE_8_BIT) ? 0xff : (((size) == SIZE_16_BIT) ? 0xffff : 0xffffff))
+#include <string.h>
+
 #define READ_IMM_LATCH_(state, imm, size) (size == SIZE_24_BIT ? (((state->decoded_inst.imm_words[imm + 1] & 0xff) << 16) | state->decoded_inst.imm_words[imm]) : state->decoded_inst.imm_words[imm])
 
+/*
+ * Register slices
+ * 
+ * Every register operand is a byte, a word or the whole of a register, so it's read or written with a single
+ * load or store to the register file: reg_bytes[index], reg_words[index] or regs[index], depending on size.
+ */
+typedef struct
+{
+	uint8_t index;
+	data_size_spec size;
+} reg_slice;
+
+static const reg_slice reg_slices_[] =
+{
+	[DATA_REG_L0] = {PILOT_REG_L(0), SIZE_8_BIT},
+	[DATA_REG_L1] = {PILOT_REG_L(1), SIZE_8_BIT},
+	[DATA_REG_L2] = {PILOT_REG_L(2), SIZE_8_BIT},
+	[DATA_REG_L3] = {PILOT_REG_L(3), SIZE_8_BIT},
+	[DATA_REG_M0] = {PILOT_REG_M(0), SIZE_8_BIT},
+	[DATA_REG_M1] = {PILOT_REG_M(1), SIZE_8_BIT},
+	[DATA_REG_M2] = {PILOT_REG_M(2), SIZE_8_BIT},
+	[DATA_REG_M3] = {PILOT_REG_M(3), SIZE_8_BIT},
+	[DATA_REG_W0] = {PILOT_REG_W(0), SIZE_16_BIT},
+	[DATA_REG_W1] = {PILOT_REG_W(1), SIZE_16_BIT},
+	[DATA_REG_W2] = {PILOT_REG_W(2), SIZE_16_BIT},
+	[DATA_REG_W3] = {PILOT_REG_W(3), SIZE_16_BIT},
+	[DATA_REG_W4] = {PILOT_REG_W(4), SIZE_16_BIT},
+	[DATA_REG_W5] = {PILOT_REG_W(5), SIZE_16_BIT},
+	[DATA_REG_W6] = {PILOT_REG_W(6), SIZE_16_BIT},
+	[DATA_REG_W7] = {PILOT_REG_W(7), SIZE_16_BIT},
+	[DATA_REG_P0] = {0, SIZE_24_BIT},
+	[DATA_REG_P1] = {1, SIZE_24_BIT},
+	[DATA_REG_P2] = {2, SIZE_24_BIT},
+	[DATA_REG_P3] = {3, SIZE_24_BIT},
+	[DATA_REG_P4] = {4, SIZE_24_BIT},
+	[DATA_REG_P5] = {5, SIZE_24_BIT},
+	[DATA_REG_P6] = {6, SIZE_24_BIT},
+	[DATA_REG_SP] = {7, SIZE_24_BIT}
+};
+
+// The low 8, 16 or 24 bits of register r
+static inline reg_slice
+reg_low_slice_ (uint8_t r, data_size_spec size)
+{
+	return (reg_slice){(size == SIZE_8_BIT) ? PILOT_REG_L(r) : ((size == SIZE_16_BIT) ? PILOT_REG_W(r) : r), size};
+}
+
+static inline uint32_t
+reg_slice_read_ (const Pilot_cpu_regs *core, reg_slice slice)
+{
+	if (slice.size == SIZE_8_BIT)
+		return core->reg_bytes[slice.index];
+	else if (slice.size == SIZE_16_BIT)
+		return core->reg_words[slice.index];
+	else
+		return core->regs[slice.index];
+}
+
+// Whatever isn't written is kept
+static inline void
+reg_slice_write_ (Pilot_cpu_regs *core, reg_slice slice, uint32_t value)
+{
+	if (slice.size == SIZE_8_BIT)
+		core->reg_bytes[slice.index] = value & 0xff;
+	else if (slice.size == SIZE_16_BIT)
+		core->reg_words[slice.index] = value & 0xffff;
+	else
+		core->regs[slice.index] = value & 0xffffff;
+}
+
 static void
 execute_invalid_opcode_ (pilot_execute_state *state)
 {
@@ -14,6 +87,123 @@ execute_invalid_opcode_ (pilot_execute_state *state)
 	state->decoded_inst.illegal = TRUE;
 }
 
+/*
+ * Lazy flags
+ *
+ * Most flag results are overwritten by the next ALU operation before anything looks at them. An ALU
+ * operation that writes flags only records what it worked on; F is worked out from that record when
+ * something reads it, or when the core hands control back to the host.
+ */
+
+// The carry out of the msb of an add: what C takes, and what LATCH_AUX_CARRY latches
+static inline bool
+alu_carry_out_ (uint32_t carries, data_size_spec size, bool invert_carries)
+{
+	uint32_t carry_bit = (size == SIZE_8_BIT) ? 0x100 : ((size == SIZE_16_BIT) ? 0x10000 : 0x1000000);
+	
+	return ((carries & carry_bit) != 0) ^ invert_carries;
+}
+
+static uint8_t
+alu_flags_value_ (const execute_pending_flags *op, uint8_t flags)
+{
+	bool alu_carry;
+	bool alu_overflow;
+	bool alu_sign;
+	uint8_t flag_source_word = 0;
+	
+	uint32_t alu_parity = op->result;
+	alu_parity = alu_parity ^ alu_parity >> 4;
+	alu_parity = alu_parity ^ alu_parity >> 2;
+	alu_parity = alu_parity ^ alu_parity >> 1;
+	
+	if (op->size == SIZE_8_BIT)
+	{
+		alu_sign = (op->result & 0x80) != 0;
+		alu_overflow = ((op->operands[1] ^ op->result) & (op->operands[0] ^ op->result) & 0x80) != 0;
+	}
+	else if (op->size == SIZE_16_BIT)
+	{
+		alu_sign = (op->result & 0x8000) != 0;
+		alu_overflow = ((op->operands[1] ^ op->result) & (op->operands[0] ^ op->result) & 0x8000) != 0;
+		alu_parity ^= (alu_parity >> 8);
+	}
+	else
+	{
+		alu_sign = (op->result & 0x800000) != 0;
+		alu_overflow = ((op->operands[1] ^ op->result) & (op->operands[0] ^ op->result) & 0x800000) != 0;
+		alu_parity ^= (alu_parity >> 8) ^ (alu_parity >> 16);
+	}
+	alu_carry = alu_carry_out_(op->carries, op->size, op->invert_carries);
+	
+	// S - Sign/negative flag
+	flag_source_word |= (alu_sign) ? F_SIGN : 0;
+	// Z - Zero flag
+	flag_source_word |= (op->zero) ? F_ZERO : 0;
+	
+	// V - Overflow/parity flag
+	switch (op->v_mode)
+	{
+		case FLAG_V_NORMAL:
+			flag_source_word |= (!op->add ? alu_parity : alu_overflow) ? F_OVERFLOW : 0;
+			break;
+		case FLAG_V_CLEAR:
+			break;
+		case FLAG_V_SHIFTER_CARRY:
+			flag_source_word |= (op->shifter_carry) ? F_OVERFLOW : 0;
+			break;
+		case FLAG_V_ACCUM:
+			flag_source_word |= ((!op->add ? alu_parity : alu_overflow) || (flags & F_OVERFLOW) != 0) ? F_OVERFLOW : 0;
+			break;
+		default:
+			execute_unreachable_();
+	}
+	
+	// C, X - Carry/borrow flags
+	flag_source_word |= (alu_carry) ? F_CARRY : 0;
+	flag_source_word |= (alu_carry) ? F_EXTEND : 0;
+	
+	flags &= ~op->write_mask;
+	flags |= (flag_source_word & op->write_mask);
+	
+	return flags;
+}
+
+uint16_t
+pilot_execute_flags_value (const pilot_execute_state *state)
+{
+	uint16_t wf = state->sys->core.wf;
+	
+	if (state->flags_pending)
+	{
+		wf = (wf & 0xff00) | alu_flags_value_(&state->pending_flags, wf & 0xff);
+	}
+	
+	return wf;
+}
+
+void
+pilot_execute_flags_sync (pilot_execute_state *state)
+{
+	if (state->flags_pending)
+	{
+		state->sys->core.wf = pilot_execute_flags_value(state);
+		state->flags_pending = FALSE;
+	}
+}
+
+// Reads some of the flags in F, only working out the pending ones if they're among them
+static inline uint8_t
+execute_read_flags_ (pilot_execute_state *state, uint8_t mask)
+{
+	if (state->flags_pending && (state->pending_flags.write_mask & mask))
+	{
+		pilot_execute_flags_sync(state);
+	}
+	
+	return state->sys->core.wf & mask;
+}
+
 static uint32_t
 fetch_data_ (pilot_execute_state *state, alu_src_control src)
 {
@@ -23,7 +213,7 @@ fetch_data_ (pilot_execute_state *state, alu_src_control src)
 			return 0;
 		case DATA_LATCH_CARRY:
 		{
-			if ((state->sys->core.wf & F_CARRY) == 0)
+			if (execute_read_flags_(state, F_CARRY) == 0)
 			{
 				return 0;
 			}
@@ -43,7 +233,7 @@ fetch_data_ (pilot_execute_state *state, alu_src_control src)
 			data_size_spec size = src.size;
 			if (size == SIZE_8_BIT)
 			{
-				if (state->mucode_decoded_buffer.operation.srcs[0].location == DATA_REG_SP || state->mucode_decoded_buffer.operation.srcs[1].location == DATA_REG_SP)
+				if (state->control->srcs[0].location == DATA_REG_SP || state->control->srcs[1].location == DATA_REG_SP)
 					return 2;
 				else
 					return 1;
@@ -52,7 +242,7 @@ fetch_data_ (pilot_execute_state *state, alu_src_control src)
 				return 2;
 			else
 			{
-				if (state->mucode_decoded_buffer.operation.srcs[0].location == DATA_REG_SP || state->mucode_decoded_buffer.operation.srcs[1].location == DATA_REG_SP)
+				if (state->control->srcs[0].location == DATA_REG_SP || state->control->srcs[1].location == DATA_REG_SP)
 					return 2;
 				else
 					return 4;
@@ -68,61 +258,41 @@ fetch_data_ (pilot_execute_state *state, alu_src_control src)
 			else
 				return 24;
 		}
+		case DATA_VEC_DIV_ZERO:
+			return 0xffcfd0;
 		case DATA_REG_L0:
-			return state->sys->core.regs[0] & 0xff;
 		case DATA_REG_L1:
-			return state->sys->core.regs[1] & 0xff;
 		case DATA_REG_L2:
-			return state->sys->core.regs[2] & 0xff;
 		case DATA_REG_L3:
-			return state->sys->core.regs[3] & 0xff;
 		case DATA_REG_M0:
-			return (state->sys->core.regs[0] >> 8) & 0xff;
 		case DATA_REG_M1:
-			return (state->sys->core.regs[1] >> 8) & 0xff;
 		case DATA_REG_M2:
-			return (state->sys->core.regs[2] >> 8) & 0xff;
 		case DATA_REG_M3:
-			return (state->sys->core.regs[3] >> 8) & 0xff;
 		case DATA_REG_W0:
-			return state->sys->core.regs[0] & 0xffff;
 		case DATA_REG_W1:
-			return state->sys->core.regs[1] & 0xffff;
 		case DATA_REG_W2:
-			return state->sys->core.regs[2] & 0xffff;
 		case DATA_REG_W3:
-			return state->sys->core.regs[3] & 0xffff;
 		case DATA_REG_W4:
-			return state->sys->core.regs[4] & 0xffff;
 		case DATA_REG_W5:
-			return state->sys->core.regs[5] & 0xffff;
 		case DATA_REG_W6:
-			return state->sys->core.regs[6] & 0xffff;
 		case DATA_REG_W7:
-			return state->sys->core.regs[7] & 0xffff;
 		case DATA_REG_P0:
-			return state->sys->core.regs[0];
 		case DATA_REG_P1:
-			return state->sys->core.regs[1];
 		case DATA_REG_P2:
-			return state->sys->core.regs[2];
 		case DATA_REG_P3:
-			return state->sys->core.regs[3];
 		case DATA_REG_P4:
-			return state->sys->core.regs[4];
 		case DATA_REG_P5:
-			return state->sys->core.regs[5];
 		case DATA_REG_P6:
-			return state->sys->core.regs[6];
 		case DATA_REG_SP:
-			return state->sys->core.regs[7];
+			return reg_slice_read_(&state->sys->core, reg_slices_[src.location]);
 		case DATA_REG_PGC:
 			return state->sys->core.pgc;
 		case DATA_REG_F:
-			return state->sys->core.wf & 0xff;
+			return execute_read_flags_(state, 0xff);
 		case DATA_REG_IRL:
 			return (state->sys->core.wf >> 8) & 0x7;
 		case DATA_REG_WF:
+			pilot_execute_flags_sync(state);
 			return state->sys->core.wf;
 		case DATA_LATCH_REPI:
 			return state->sys->core.repi;
@@ -133,7 +303,7 @@ fetch_data_ (pilot_execute_state *state, alu_src_control src)
 		case DATA_LATCH_FACTOR_B:
 			return state->sys->core.factor_b;
 		case DATA_REG_R0:
-			return ACCESS_REG_BITS_(state, 0, src.size);
+			return reg_slice_read_(&state->sys->core, reg_low_slice_(0, src.size));
 		case DATA_LATCH_MEM_ADDR:
 			return state->mem_addr;
 		case DATA_LATCH_MEM_DATA:
@@ -159,11 +329,11 @@ fetch_data_ (pilot_execute_state *state, alu_src_control src)
 		case DATA_LATCH_RM_HML:
 			return ((state->decoded_inst.imm_words[state->decoded_inst.rm2_offset + 1] & 0xff) << 16) | state->decoded_inst.imm_words[state->decoded_inst.rm2_offset];
 		case DATA_REG_IMM_0_8:
-			return ACCESS_REG_BITS_(state, (state->decoded_inst.imm_words[0] >> 8) & 0x7, src.size);
+			return reg_slice_read_(&state->sys->core, reg_low_slice_((state->decoded_inst.imm_words[0] >> 8) & 0x7, src.size));
 		case DATA_REG_IMM_1_8:
-			return ACCESS_REG_BITS_(state, (state->decoded_inst.imm_words[1] >> 8) & 0x7, src.size);
+			return reg_slice_read_(&state->sys->core, reg_low_slice_((state->decoded_inst.imm_words[1] >> 8) & 0x7, src.size));
 		case DATA_REG_IMM_1_2:
-			return ACCESS_REG_BITS_(state, (state->decoded_inst.imm_words[1] >> 2) & 0x7, src.size);
+			return reg_slice_read_(&state->sys->core, reg_low_slice_((state->decoded_inst.imm_words[1] >> 2) & 0x7, src.size));
 		case DATA_REG_IMM_2_8:
 		{
 			if (state->decoded_inst.imm_words[2] >= 0xc000) 
@@ -171,13 +341,13 @@ fetch_data_ (pilot_execute_state *state, alu_src_control src)
 				execute_invalid_opcode_(state);
 				return 0;
 			}
-			state->mucode_decoded_buffer.operation.srcs[1].sign_extend = ((state->decoded_inst.imm_words[2] & 0x0800) != 0);
-			return ACCESS_REG_BITS_(state, (state->decoded_inst.imm_words[2] >> 8) & 0x7, state->decoded_inst.imm_words[2] >> 14);
+			state->alu_src2_sign_extend = ((state->decoded_inst.imm_words[2] & 0x0800) != 0);
+			return reg_slice_read_(&state->sys->core, reg_low_slice_((state->decoded_inst.imm_words[2] >> 8) & 0x7, state->decoded_inst.imm_words[2] >> 14));
 		}
 		case DATA_REG_RM_1_8:
-			return ACCESS_REG_BITS_(state, (state->decoded_inst.imm_words[state->decoded_inst.rm2_offset] >> 8) & 0x7, src.size);
+			return reg_slice_read_(&state->sys->core, reg_low_slice_((state->decoded_inst.imm_words[state->decoded_inst.rm2_offset] >> 8) & 0x7, src.size));
 		case DATA_REG_RM_1_2:
-			return ACCESS_REG_BITS_(state, (state->decoded_inst.imm_words[state->decoded_inst.rm2_offset] >> 2) & 0x7, src.size);
+			return reg_slice_read_(&state->sys->core, reg_low_slice_((state->decoded_inst.imm_words[state->decoded_inst.rm2_offset] >> 2) & 0x7, src.size));
 		case DATA_REG_RM_2_8:
 		{
 			if (state->decoded_inst.imm_words[state->decoded_inst.rm2_offset + 1] >= 0xc000) 
@@ -185,11 +355,11 @@ fetch_data_ (pilot_execute_state *state, alu_src_control src)
 				execute_invalid_opcode_(state);
 				return 0;
 			}
-			state->mucode_decoded_buffer.operation.srcs[1].sign_extend = ((state->decoded_inst.imm_words[state->decoded_inst.rm2_offset + 1] & 0x0800) != 0);
-			return ACCESS_REG_BITS_(state, (state->decoded_inst.imm_words[state->decoded_inst.rm2_offset + 1] >> 8) & 0x7, state->decoded_inst.imm_words[state->decoded_inst.rm2_offset + 1] >> 14);
+			state->alu_src2_sign_extend = ((state->decoded_inst.imm_words[state->decoded_inst.rm2_offset + 1] & 0x0800) != 0);
+			return reg_slice_read_(&state->sys->core, reg_low_slice_((state->decoded_inst.imm_words[state->decoded_inst.rm2_offset + 1] >> 8) & 0x7, state->decoded_inst.imm_words[state->decoded_inst.rm2_offset + 1] >> 14));
 		}
 		case DATA_REG_REPR:
-			return ACCESS_REG_BITS_(state, state->sys->core.repr, src.size);
+			return reg_slice_read_(&state->sys->core, reg_low_slice_(state->sys->core.repr, src.size));
 		case DATA_DMX_IMM_BITS:
 			return 1 << ((state->decoded_inst.imm_words[0] >> 8) & 0x7);
 		case DATA_DMX_P0_BITS:
@@ -209,94 +379,34 @@ write_data_ (pilot_execute_state *state, alu_src_control dest, uint32_t *src)
 		case DATA_SIZE:
 			return;
 		case DATA_REG_L0:
-			state->sys->core.regs[0] &= 0xffff00;
-			state->sys->core.regs[0] |= *src & 0xff;
-			return;
 		case DATA_REG_L1:
-			state->sys->core.regs[1] &= 0xffff00;
-			state->sys->core.regs[1] |= *src & 0xff;
-			return;
 		case DATA_REG_L2:
-			state->sys->core.regs[2] &= 0xffff00;
-			state->sys->core.regs[2] |= *src & 0xff;
-			return;
 		case DATA_REG_L3:
-			state->sys->core.regs[3] &= 0xffff00;
-			state->sys->core.regs[3] |= *src & 0xff;
-			return;
 		case DATA_REG_M0:
-			state->sys->core.regs[0] &= 0xff00ff;
-			state->sys->core.regs[0] |= ((*src & 0xff) << 8);
-			return;
 		case DATA_REG_M1:
-			state->sys->core.regs[1] &= 0xff00ff;
-			state->sys->core.regs[1] |= ((*src & 0xff) << 8);
-			return;
 		case DATA_REG_M2:
-			state->sys->core.regs[2] &= 0xff00ff;
-			state->sys->core.regs[2] |= ((*src & 0xff) << 8);
-			return;
 		case DATA_REG_M3:
-			state->sys->core.regs[3] &= 0xff00ff;
-			state->sys->core.regs[3] |= ((*src & 0xff) << 8);
-			return;
 		case DATA_REG_W0:
-			state->sys->core.regs[0] &= 0xff0000;
-			state->sys->core.regs[0] |= *src & 0xffff;
-			return;
 		case DATA_REG_W1:
-			state->sys->core.regs[1] &= 0xff0000;
-			state->sys->core.regs[1] |= *src & 0xffff;
-			return;
 		case DATA_REG_W2:
-			state->sys->core.regs[2] &= 0xff0000;
-			state->sys->core.regs[2] |= *src & 0xffff;
-			return;
 		case DATA_REG_W3:
-			state->sys->core.regs[3] &= 0xff0000;
-			state->sys->core.regs[3] |= *src & 0xffff;
-			return;
 		case DATA_REG_W4:
-			state->sys->core.regs[4] &= 0xff0000;
-			state->sys->core.regs[4] |= *src & 0xffff;
-			return;
 		case DATA_REG_W5:
-			state->sys->core.regs[5] &= 0xff0000;
-			state->sys->core.regs[5] |= *src & 0xffff;
-			return;
 		case DATA_REG_W6:
-			state->sys->core.regs[6] &= 0xff0000;
-			state->sys->core.regs[6] |= *src & 0xffff;
-			return;
 		case DATA_REG_W7:
-			state->sys->core.regs[7] &= 0xff0000;
-			state->sys->core.regs[7] |= *src & 0xffff;
-			return;
 		case DATA_REG_P0:
-			state->sys->core.regs[0] = *src & 0xffffff;
-			return;
 		case DATA_REG_P1:
-			state->sys->core.regs[1] = *src & 0xffffff;
-			return;
 		case DATA_REG_P2:
-			state->sys->core.regs[2] = *src & 0xffffff;
-			return;
 		case DATA_REG_P3:
-			state->sys->core.regs[3] = *src & 0xffffff;
-			return;
 		case DATA_REG_P4:
-			state->sys->core.regs[4] = *src & 0xffffff;
-			return;
 		case DATA_REG_P5:
-			state->sys->core.regs[5] = *src & 0xffffff;
-			return;
 		case DATA_REG_P6:
-			state->sys->core.regs[6] = *src & 0xffffff;
-			return;
 		case DATA_REG_SP:
-			state->sys->core.regs[7] = *src & 0xffffff;
+			reg_slice_write_(&state->sys->core, reg_slices_[dest.location], *src);
 			return;
 		case DATA_REG_F:
+			// every flag is overwritten, pending ones included
+			state->flags_pending = FALSE;
 			state->sys->core.wf &= 0xff00;
 			state->sys->core.wf |= *src & 0xff;
 			return;
@@ -305,6 +415,7 @@ write_data_ (pilot_execute_state *state, alu_src_control dest, uint32_t *src)
 			state->sys->core.wf |= (*src << 8) & 0x7;
 			return;
 		case DATA_REG_WF:
+			state->flags_pending = FALSE;
 			state->sys->core.wf = *src & 0xffff;
 			return;
 		case DATA_LATCH_REPI:
@@ -320,30 +431,13 @@ write_data_ (pilot_execute_state *state, alu_src_control dest, uint32_t *src)
 			state->sys->core.factor_b = *src & 0xffffff;
 			return;
 		case DATA_REG_R0:
-		{
-			switch (dest.size)
-			{
-				case SIZE_8_BIT:
-					state->sys->core.regs[0] &= 0xffff00;
-					state->sys->core.regs[0] |= *src & 0xff;
-					return;
-				case SIZE_16_BIT:
-					state->sys->core.regs[0] &= 0xff0000;
-					state->sys->core.regs[0] |= *src & 0xffff;
-					return;
-				case SIZE_24_BIT:
-					state->sys->core.regs[0] = *src & 0xffffff;
-					return;
-				default:
-					execute_unreachable_();
-					return;
-			}
-		}
+			reg_slice_write_(&state->sys->core, reg_low_slice_(0, dest.size), *src);
+			return;
 		case DATA_REG_PGC:
+			// the fetch unit is only sent here once the instruction is over, if it isn't there already
 			state->sys->core.pgc = *src & 0xfffffe;
 			state->branched = TRUE;
-			state->sys->interconnects.execute_branch_addr = *src & 0xfffffe;
-			state->sys->interconnects.execute_branch = TRUE;
+			state->branch_addr = *src & 0xfffffe;
 			return;
 		case DATA_LATCH_MEM_ADDR:
 			state->mem_addr = *src & 0xffffff;
@@ -352,25 +446,8 @@ write_data_ (pilot_execute_state *state, alu_src_control dest, uint32_t *src)
 			state->mem_data = *src & 0xffffff;
 			return;
 		case DATA_REG_IMM_0_8:
-		{
-			switch (dest.size)
-			{
-				case SIZE_8_BIT:
-					state->sys->core.regs[(state->decoded_inst.imm_words[0] >> 8) & 0x7] &= 0xffff00;
-					state->sys->core.regs[(state->decoded_inst.imm_words[0] >> 8) & 0x7] |= *src & 0xff;
-					return;
-				case SIZE_16_BIT:
-					state->sys->core.regs[(state->decoded_inst.imm_words[0] >> 8) & 0x7] &= 0xff0000;
-					state->sys->core.regs[(state->decoded_inst.imm_words[0] >> 8) & 0x7] |= *src & 0xffff;
-					return;
-				case SIZE_24_BIT:
-					state->sys->core.regs[(state->decoded_inst.imm_words[0] >> 8) & 0x7] = *src & 0xffffff;
-					return;
-				default:
-					execute_unreachable_();
-					return;
-			}
-		}
+			reg_slice_write_(&state->sys->core, reg_low_slice_((state->decoded_inst.imm_words[0] >> 8) & 0x7, dest.size), *src);
+			return;
 		case DATA_REG_IMM_1_8:
 			state->sys->core.regs[(state->decoded_inst.imm_words[1] >> 8) & 0x7] = *src & 0xffffff;
 			return;
@@ -384,7 +461,7 @@ write_data_ (pilot_execute_state *state, alu_src_control dest, uint32_t *src)
 			state->sys->core.regs[(state->decoded_inst.imm_words[state->decoded_inst.rm2_offset] >> 2) & 0x7] = *src & 0xffffff;
 			return;
 		case DATA_REG_REPR:
-			state->sys->core.regs[state->sys->core.repr] = *src;
+			state->sys->core.regs[state->sys->core.repr] = *src & 0xffffff;
 			return;
 		case DATA_REG_IMM_2_8:
 		case DATA_REG_RM_2_8:
@@ -406,111 +483,426 @@ write_data_ (pilot_execute_state *state, alu_src_control dest, uint32_t *src)
 	}
 }
 
-static void
-execute_half1_mem_wait_ (pilot_execute_state *state)
+/*
+ * Compiled operands
+ *
+ * Most operands are a fixed slice of a register or latch, so each alu_src_control is resolved once: for
+ * microcode when the ROM is built, for core_op when the instruction is decoded. Whatever depends on the
+ * instruction words goes through a small table filled in at dispatch. Anything with side effects or that
+ * depends on machine state is left to fetch_data_() and write_data_().
+ */
+
+static inline alu_operand_access
+operand_access_ (int kind, uint8_t index, uint8_t shift, uint32_t mask)
 {
-	if (state->mem_access_waiting)
-	{
-		if (Pilot_mem_data_wait(state->sys))
-		{
-			state->mem_access_waiting = FALSE;
-			if (state->mem_access_was_read)
-			{
-				state->mem_data = Pilot_mem_get_data(state->sys);
-			}
-		}
-		else if (state->control->srcs[0].location == DATA_LATCH_MEM_DATA
-			|| state->control->srcs[1].location == DATA_LATCH_MEM_DATA
-			|| state->control->dest.location == DATA_LATCH_MEM_DATA)
-		{
-			return;
-		}
-	}
-	state->execution_phase = EXEC_HALF1_OPERAND_LATCH;
+	return (alu_operand_access){kind, index, shift, mask};
 }
 
-static void
-execute_half1_mem_prepare_ (pilot_execute_state *state)
+static inline uint32_t
+operand_size_mask_ (data_size_spec size)
 {
-	if (state->control->mem_latch_ctl == MEM_LATCH_HALF1)
-	{
-		state->mem_addr = state->alu_input_latches[0];
-		
-		if (state->control->mem_write_ctl != MEM_READ)
-		{
-			switch (state->control->mem_write_ctl)
-			{
-				case MEM_WRITE_FROM_SRC2:
-					state->mem_data = state->alu_input_latches[1];
-					break;
-				case MEM_WRITE_FROM_DEST:
-					// MEM_WRITE_FROM_DEST should only be used in cycle 2!
-					execute_unreachable_();
-					state->mem_data = state->alu_output_latch;
-					break;
-				case MEM_WRITE_FROM_MDR:
-					break;
-				case MEM_WRITE_FROM_MDR_HIGH:
-					state->mem_data = (state->mem_data >> 16) & 0xff;
-					break;
-				default:
-					execute_unreachable_();
-			}
-		}
-	}
-	state->execution_phase = EXEC_HALF1_MEM_ASSERT;
+	return (size == SIZE_8_BIT) ? 0xff : ((size == SIZE_16_BIT) ? 0xffff : 0xffffff);
 }
 
-static void
-execute_half1_mem_assert_ (pilot_execute_state *state)
+static inline alu_operand_access
+operand_slice_ (reg_slice slice)
 {
-	if (state->control->mem_latch_ctl == MEM_LATCH_HALF1 && !state->control->mem_access_suppress)
-	{
-		if (state->control->mem_write_ctl == MEM_READ)
-		{
-			if (!Pilot_mem_addr_read_assert(state->sys, state->control->is_16bit, state->mem_addr))
-			{
-				return;
-			}
-			state->mem_access_was_read = TRUE;
-		}
-		else
-		{
-			if (!Pilot_mem_addr_write_assert(state->sys, state->control->is_16bit, state->mem_addr, state->mem_data & 0xffff))
-			{
-				return;
-			}
-			state->mem_access_was_read = FALSE;
-		}
-		
-		state->mem_access_waiting = TRUE;
-		state->control->mem_latch_ctl = MEM_NO_LATCH;
-	}
-	state->execution_phase = EXEC_HALF2_READY;
+	return operand_access_(OPERAND_REG_8 + slice.size, slice.index, 0, 0);
 }
 
-void
-pilot_execute_half1 (pilot_execute_state *state)
+static alu_operand_access
+compile_fetch_ (const execute_control_word *op, alu_src_control src)
 {
-	if (state->sys->core.disable_clk)
-	{
-		return;
-	}
+	uint32_t imm_mask = (src.size == SIZE_24_BIT) ? 0xffffff : 0xffff;
+	bool uses_sp = (op->srcs[0].location == DATA_REG_SP || op->srcs[1].location == DATA_REG_SP);
 	
-	if (state->execution_phase == EXEC_HALF1_READY)
+	switch (src.location)
 	{
-		state->execution_phase = EXEC_HALF1_MEM_WAIT;
+		case DATA_ZERO:
+			return operand_access_(OPERAND_CONST, 0, 0, 0);
+		case DATA_SIZE:
+			if (src.size == SIZE_16_BIT || uses_sp)
+				return operand_access_(OPERAND_CONST, 0, 0, 2);
+			return operand_access_(OPERAND_CONST, 0, 0, (src.size == SIZE_8_BIT) ? 1 : 4);
+		case DATA_NUM_BITS:
+			return operand_access_(OPERAND_CONST, 0, 0, (src.size == SIZE_8_BIT) ? 8 : ((src.size == SIZE_16_BIT) ? 16 : 24));
+		case DATA_VEC_DIV_ZERO:
+			return operand_access_(OPERAND_CONST, 0, 0, 0xffcfd0);
+		case DATA_REG_L0:
+		case DATA_REG_L1:
+		case DATA_REG_L2:
+		case DATA_REG_L3:
+		case DATA_REG_M0:
+		case DATA_REG_M1:
+		case DATA_REG_M2:
+		case DATA_REG_M3:
+		case DATA_REG_W0:
+		case DATA_REG_W1:
+		case DATA_REG_W2:
+		case DATA_REG_W3:
+		case DATA_REG_W4:
+		case DATA_REG_W5:
+		case DATA_REG_W6:
+		case DATA_REG_W7:
+		case DATA_REG_P0:
+		case DATA_REG_P1:
+		case DATA_REG_P2:
+		case DATA_REG_P3:
+		case DATA_REG_P4:
+		case DATA_REG_P5:
+		case DATA_REG_P6:
+		case DATA_REG_SP:
+			return operand_slice_(reg_slices_[src.location]);
+		case DATA_REG_R0:
+			return operand_slice_(reg_low_slice_(0, src.size));
+		case DATA_LATCH_MEM_ADDR:
+			return operand_access_(OPERAND_MEM_LATCH, 0, 0, 0xffffffff);
+		case DATA_LATCH_MEM_DATA:
+			return operand_access_(OPERAND_MEM_LATCH, 1, 0, 0xffffffff);
+		case DATA_LATCH_IMM_0:
+		case DATA_LATCH_IMM_1:
+		case DATA_LATCH_IMM_2:
+			return operand_access_(OPERAND_INST_IMM, OPERAND_IMM_0 + (src.location - DATA_LATCH_IMM_0), 0, imm_mask);
+		case DATA_LATCH_IMM_HML:
+			return operand_access_(OPERAND_INST_IMM, OPERAND_IMM_HML, 0, 0xffffff);
+		case DATA_LATCH_IMM_HML_RM:
+			return operand_access_(OPERAND_INST_IMM, OPERAND_IMM_HML_RM, 0, 0xffffff);
+		case DATA_LATCH_SFI_1:
+			return operand_access_(OPERAND_INST_IMM, OPERAND_IMM_0, 2, 0x000f);
+		case DATA_LATCH_SFI_2:
+			return operand_access_(OPERAND_INST_IMM, OPERAND_IMM_0, 8, 0x000f);
+		case DATA_LATCH_RM_1:
+			return operand_access_(OPERAND_INST_IMM, OPERAND_IMM_RM_1, 0, imm_mask);
+		case DATA_LATCH_RM_2:
+			return operand_access_(OPERAND_INST_IMM, OPERAND_IMM_RM_2, 0, imm_mask);
+		case DATA_LATCH_RM_HML:
+			return operand_access_(OPERAND_INST_IMM, OPERAND_IMM_RM_HML, 0, 0xffffff);
+		case DATA_REG_IMM_0_8:
+			return operand_access_(OPERAND_INST_REG_8 + src.size, OPERAND_REG_IMM_0_8, 0, 0);
+		case DATA_REG_IMM_1_8:
+			return operand_access_(OPERAND_INST_REG_8 + src.size, OPERAND_REG_IMM_1_8, 0, 0);
+		case DATA_REG_IMM_1_2:
+			return operand_access_(OPERAND_INST_REG_8 + src.size, OPERAND_REG_IMM_1_2, 0, 0);
+		case DATA_REG_RM_1_8:
+			return operand_access_(OPERAND_INST_REG_8 + src.size, OPERAND_REG_RM_1_8, 0, 0);
+		case DATA_REG_RM_1_2:
+			return operand_access_(OPERAND_INST_REG_8 + src.size, OPERAND_REG_RM_1_2, 0, 0);
+		case DATA_DMX_IMM_BITS:
+			return operand_access_(OPERAND_INST_IMM, OPERAND_IMM_DMX, 0, 0xffffffff);
+		default:
+			return operand_access_(OPERAND_GENERIC, 0, 0, 0);
 	}
-	
-	if (state->execution_phase == EXEC_HALF1_MEM_WAIT)
+}
+
+static alu_operand_access
+compile_write_ (alu_src_control dest)
+{
+	switch (dest.location)
 	{
-		execute_half1_mem_wait_(state);
-	}
-	
-	if (state->execution_phase == EXEC_HALF1_OPERAND_LATCH)
+		case DATA_ZERO:
+		case DATA_LATCH_CARRY:
+		case DATA_SIZE:
+		case DATA_REG_IMM_2_8:
+		case DATA_REG_RM_2_8:
+		case DATA_LATCH_IMM_0:
+		case DATA_LATCH_IMM_1:
+		case DATA_LATCH_IMM_2:
+		case DATA_LATCH_IMM_HML:
+		case DATA_LATCH_IMM_HML_RM:
+		case DATA_LATCH_SFI_1:
+		case DATA_LATCH_SFI_2:
+		case DATA_LATCH_RM_1:
+		case DATA_LATCH_RM_2:
+		case DATA_LATCH_RM_HML:
+		case DATA_DMX_IMM_BITS:
+		case DATA_DMX_P0_BITS:
+			return operand_access_(OPERAND_CONST, 0, 0, 0);
+		case DATA_REG_L0:
+		case DATA_REG_L1:
+		case DATA_REG_L2:
+		case DATA_REG_L3:
+		case DATA_REG_M0:
+		case DATA_REG_M1:
+		case DATA_REG_M2:
+		case DATA_REG_M3:
+		case DATA_REG_W0:
+		case DATA_REG_W1:
+		case DATA_REG_W2:
+		case DATA_REG_W3:
+		case DATA_REG_W4:
+		case DATA_REG_W5:
+		case DATA_REG_W6:
+		case DATA_REG_W7:
+		case DATA_REG_P0:
+		case DATA_REG_P1:
+		case DATA_REG_P2:
+		case DATA_REG_P3:
+		case DATA_REG_P4:
+		case DATA_REG_P5:
+		case DATA_REG_P6:
+		case DATA_REG_SP:
+			return operand_slice_(reg_slices_[dest.location]);
+		case DATA_REG_R0:
+			return operand_slice_(reg_low_slice_(0, dest.size));
+		case DATA_LATCH_MEM_ADDR:
+			return operand_access_(OPERAND_MEM_LATCH, 0, 0, 0xffffff);
+		case DATA_LATCH_MEM_DATA:
+			return operand_access_(OPERAND_MEM_LATCH, 1, 0, 0xffffff);
+		case DATA_REG_IMM_0_8:
+			return operand_access_(OPERAND_INST_REG_8 + dest.size, OPERAND_REG_IMM_0_8, 0, 0);
+		case DATA_REG_IMM_1_8:
+			return operand_access_(OPERAND_INST_REG_24, OPERAND_REG_IMM_1_8, 0, 0);
+		case DATA_REG_IMM_1_2:
+			return operand_access_(OPERAND_INST_REG_24, OPERAND_REG_IMM_1_2, 0, 0);
+		case DATA_REG_RM_1_8:
+			return operand_access_(OPERAND_INST_REG_24, OPERAND_REG_RM_1_8, 0, 0);
+		case DATA_REG_RM_1_2:
+			return operand_access_(OPERAND_INST_REG_24, OPERAND_REG_RM_1_2, 0, 0);
+		default:
+			return operand_access_(OPERAND_GENERIC, 0, 0, 0);
+	}
+}
+
+static inline uint32_t
+operand_word_ (const inst_decoded_flags *inst, unsigned int word)
+{
+	return (word < sizeof(inst->imm_words) / sizeof(inst->imm_words[0])) ? inst->imm_words[word] : 0;
+}
+
+void
+pilot_execute_latch_operands (inst_decoded_flags *inst)
+{
+	unsigned int rm = inst->rm2_offset;
+	
+	inst->operand_regs[OPERAND_REG_IMM_0_8] = (operand_word_(inst, 0) >> 8) & 0x7;
+	inst->operand_regs[OPERAND_REG_IMM_1_8] = (operand_word_(inst, 1) >> 8) & 0x7;
+	inst->operand_regs[OPERAND_REG_IMM_1_2] = (operand_word_(inst, 1) >> 2) & 0x7;
+	inst->operand_regs[OPERAND_REG_RM_1_8] = (operand_word_(inst, rm) >> 8) & 0x7;
+	inst->operand_regs[OPERAND_REG_RM_1_2] = (operand_word_(inst, rm) >> 2) & 0x7;
+	
+	// 24-bit reads take the low byte of the next word as the high byte
+	inst->operand_imms[OPERAND_IMM_0] = operand_word_(inst, 0) | (operand_word_(inst, 1) << 16);
+	inst->operand_imms[OPERAND_IMM_1] = operand_word_(inst, 1) | (operand_word_(inst, 2) << 16);
+	inst->operand_imms[OPERAND_IMM_2] = operand_word_(inst, 2) | (operand_word_(inst, 3) << 16);
+	inst->operand_imms[OPERAND_IMM_HML] = ((operand_word_(inst, 0) & 0xff) << 16) | operand_word_(inst, 1);
+	inst->operand_imms[OPERAND_IMM_HML_RM] = ((operand_word_(inst, 2) & 0xff) << 16) | operand_word_(inst, 1);
+	inst->operand_imms[OPERAND_IMM_RM_1] = operand_word_(inst, rm) | (operand_word_(inst, rm + 1) << 16);
+	inst->operand_imms[OPERAND_IMM_RM_2] = operand_word_(inst, rm + 1) | (operand_word_(inst, rm + 2) << 16);
+	inst->operand_imms[OPERAND_IMM_RM_HML] = ((operand_word_(inst, rm + 1) & 0xff) << 16) | operand_word_(inst, rm);
+	inst->operand_imms[OPERAND_IMM_DMX] = 1 << ((operand_word_(inst, 0) >> 8) & 0x7);
+}
+
+static inline uint32_t
+fetch_operand_ (pilot_execute_state *state, int src)
+{
+	const alu_operand_access *access = &state->control->src_access[src];
+	const Pilot_cpu_regs *core = &state->sys->core;
+	uint32_t value;
+	
+	switch (access->kind)
+	{
+		case OPERAND_REG_8:
+			return core->reg_bytes[access->index];
+		case OPERAND_REG_16:
+			return core->reg_words[access->index];
+		case OPERAND_REG_24:
+			return core->regs[access->index];
+		case OPERAND_INST_REG_8:
+			return core->reg_bytes[PILOT_REG_L(state->decoded_inst.operand_regs[access->index])];
+		case OPERAND_INST_REG_16:
+			return core->reg_words[PILOT_REG_W(state->decoded_inst.operand_regs[access->index])];
+		case OPERAND_INST_REG_24:
+			return core->regs[state->decoded_inst.operand_regs[access->index]];
+		case OPERAND_INST_IMM:
+			value = state->decoded_inst.operand_imms[access->index];
+			break;
+		case OPERAND_MEM_LATCH:
+			value = access->index ? state->mem_data : state->mem_addr;
+			break;
+		case OPERAND_CONST:
+			return access->mask;
+		default:
+			return fetch_data_(state, state->control->srcs[src]);
+	}
+	
+	return (value >> access->shift) & access->mask;
+}
+
+static inline void
+write_operand_ (pilot_execute_state *state, uint32_t *src)
+{
+	const alu_operand_access *access = &state->control->dest_access;
+	Pilot_cpu_regs *core = &state->sys->core;
+	
+	// registers are 24 bits wide; whatever isn't written is kept
+	switch (access->kind)
+	{
+		case OPERAND_REG_8:
+			core->reg_bytes[access->index] = *src & 0xff;
+			return;
+		case OPERAND_REG_16:
+			core->reg_words[access->index] = *src & 0xffff;
+			return;
+		case OPERAND_REG_24:
+			core->regs[access->index] = *src & 0xffffff;
+			return;
+		case OPERAND_INST_REG_8:
+			core->reg_bytes[PILOT_REG_L(state->decoded_inst.operand_regs[access->index])] = *src & 0xff;
+			return;
+		case OPERAND_INST_REG_16:
+			core->reg_words[PILOT_REG_W(state->decoded_inst.operand_regs[access->index])] = *src & 0xffff;
+			return;
+		case OPERAND_INST_REG_24:
+			core->regs[state->decoded_inst.operand_regs[access->index]] = *src & 0xffffff;
+			return;
+		case OPERAND_MEM_LATCH:
+			*(access->index ? &state->mem_data : &state->mem_addr) = *src & access->mask;
+			return;
+		case OPERAND_CONST:
+			return;
+		default:
+			write_data_(state, state->control->dest, src);
+			return;
+	}
+}
+
+// Hands this control word's access to the memory controller; FALSE if the bus is taken
+static bool
+execute_mem_assert_ (pilot_execute_state *state)
+{
+	const execute_control_word *control = state->control;
+	Pilot_system *sys = state->sys;
+	
+	if (control->is_24bit_high && state->mem_high_done)
+	{
+		// the bus is still busy with the low half's transaction, which covers this cycle too
+		state->mem_high_done = FALSE;
+		state->control_status->mem_done = TRUE;
+		return TRUE;
+	}
+	
+	if (control->mem_write_ctl == MEM_READ)
+	{
+		if (!(control->is_24bit ? Pilot_mem_addr_read24_assert(sys, state->mem_addr)
+			: Pilot_mem_addr_read_assert(sys, control->is_16bit, state->mem_addr)))
+		{
+			return FALSE;
+		}
+		state->mem_access_was_read = TRUE;
+	}
+	else
+	{
+		if (!(control->is_24bit ? Pilot_mem_addr_write24_assert(sys, state->mem_addr, state->mem_data & 0xffffff)
+			: Pilot_mem_addr_write_assert(sys, control->is_16bit, state->mem_addr, state->mem_data & 0xffff)))
+		{
+			return FALSE;
+		}
+		state->mem_access_was_read = FALSE;
+	}
+	
+	state->mem_access_waiting = TRUE;
+	state->mem_high_done = control->is_24bit;
+	state->control_status->mem_done = TRUE;
+	return TRUE;
+}
+
+static void
+execute_half1_mem_wait_ (pilot_execute_state *state)
+{
+	if (state->mem_access_waiting)
+	{
+		if (Pilot_mem_data_wait(state->sys))
+		{
+			state->mem_access_waiting = FALSE;
+			if (state->mem_access_was_read)
+			{
+				state->mem_data = Pilot_mem_get_data(state->sys);
+			}
+		}
+		else if (state->control->srcs[0].location == DATA_LATCH_MEM_DATA
+			|| state->control->srcs[1].location == DATA_LATCH_MEM_DATA
+			|| state->control->dest.location == DATA_LATCH_MEM_DATA)
+		{
+			return;
+		}
+	}
+	state->execution_phase = EXEC_HALF1_OPERAND_LATCH;
+}
+
+static void
+execute_half1_mem_prepare_ (pilot_execute_state *state)
+{
+	if (state->control->mem_latch_ctl == MEM_LATCH_HALF1 && !state->control_status->mem_done)
+	{
+		state->mem_addr = state->alu_input_latches[0];
+		
+		if (state->control->mem_write_ctl != MEM_READ)
+		{
+			switch (state->control->mem_write_ctl)
+			{
+				case MEM_WRITE_FROM_SRC2:
+					state->mem_data = state->alu_input_latches[1];
+					break;
+				case MEM_WRITE_FROM_DEST:
+					// MEM_WRITE_FROM_DEST should only be used in cycle 2!
+					execute_unreachable_();
+					state->mem_data = state->alu_output_latch;
+					break;
+				case MEM_WRITE_FROM_MDR:
+					break;
+				case MEM_WRITE_FROM_MDR_HIGH:
+					state->mem_data = (state->mem_data >> 16) & 0xff;
+					break;
+				default:
+					execute_unreachable_();
+			}
+		}
+	}
+	state->execution_phase = EXEC_HALF1_MEM_ASSERT;
+}
+
+static void
+execute_half1_mem_assert_ (pilot_execute_state *state)
+{
+	if (state->control->mem_latch_ctl == MEM_LATCH_HALF1 && !state->control_status->mem_done && !state->control->mem_access_suppress)
+	{
+		if (!execute_mem_assert_(state))
+		{
+			return;
+		}
+	}
+	state->execution_phase = EXEC_HALF2_READY;
+}
+
+void
+pilot_execute_half1 (pilot_execute_state *state)
+{
+	if (state->sys->core.disable_clk)
+	{
+		return;
+	}
+	
+	pilot_execute_half1_clocked(state);
+}
+
+void
+pilot_execute_half1_clocked (pilot_execute_state *state)
+{
+	if (state->execution_phase == EXEC_HALF1_READY)
+	{
+		state->execution_phase = EXEC_HALF1_MEM_WAIT;
+	}
+	
+	if (state->execution_phase == EXEC_HALF1_MEM_WAIT)
+	{
+		execute_half1_mem_wait_(state);
+	}
+	
+	if (state->execution_phase == EXEC_HALF1_OPERAND_LATCH)
 	{
-		state->alu_input_latches[0] = fetch_data_(state, state->control->srcs[0]);
-		state->alu_input_latches[1] = fetch_data_(state, state->control->srcs[1]);
+		state->alu_src2_sign_extend = state->control->srcs[1].sign_extend;
+		state->alu_input_latches[0] = fetch_operand_(state, 0);
+		state->alu_input_latches[1] = fetch_operand_(state, 1);
 		state->execution_phase = EXEC_HALF1_MEM_PREPARE;
 	}
 	
@@ -531,7 +923,6 @@ alu_operate_shifter_ (pilot_execute_state *state, uint32_t operand)
 	bool inject_bit;
 	bool msb_bit;
 	bool lsb_bit = operand & 1;
-	bool carry_flag = !(state->control->latch_aux_mode == LATCH_AUX_CARRY) ? ((fetch_data_(state, (alu_src_control){DATA_REG_F, SIZE_8_BIT, FALSE}) & F_EXTEND) != 0) : state->sys->core.latch_aux;
 	
 	if (state->control->srcs[1].size == SIZE_8_BIT)
 	{
@@ -555,7 +946,7 @@ alu_operate_shifter_ (pilot_execute_state *state, uint32_t operand)
 			break;
 		case SHIFTER_LEFT_CARRY:
 		case SHIFTER_RIGHT_CARRY:
-			inject_bit = carry_flag;
+			inject_bit = !(state->control->latch_aux_mode == LATCH_AUX_CARRY) ? (execute_read_flags_(state, F_EXTEND) != 0) : state->sys->core.latch_aux;
 			break;
 		case SHIFTER_LEFT_BARREL:
 		case SHIFTER_RIGHT_ARITH:
@@ -621,65 +1012,30 @@ alu_operate_shifter_ (pilot_execute_state *state, uint32_t operand)
 	return operand;
 }
 
-static inline uint8_t
-alu_modify_flags_ (pilot_execute_state *state, uint8_t flags, uint32_t operands[2], uint32_t result, uint32_t carries)
+// Works out the eager part of the flags: the Z latch and the aux latch are internal state the very next
+// control word may depend on, so only the F register itself is left for later
+static inline void
+alu_modify_flags_ (pilot_execute_state *state, uint32_t operands[2], uint32_t result, uint32_t carries)
 {
-	bool alu_carry;
-	bool alu_overflow;
-	bool alu_zero;
-	bool alu_sign;
-	uint8_t flag_source_word = 0;
-	
-	uint32_t alu_parity = result;
-	alu_parity = alu_parity ^ alu_parity >> 4;
-	alu_parity = alu_parity ^ alu_parity >> 2;
-	alu_parity = alu_parity ^ alu_parity >> 1;
-	
-	if (state->control->srcs[0].size == SIZE_8_BIT)
-	{
-		alu_carry = (carries & 0x80) != 0;
-		alu_sign = (result & 0x80) != 0;
-		alu_overflow = ((operands[1] ^ result) & (operands[0] ^ result) & 0x80) != 0;
-		alu_zero = (result & 0xff) == 0;
-	}
-	else if (state->control->srcs[0].size == SIZE_16_BIT)
-	{
-		alu_carry = (carries & 0x8000) != 0;
-		alu_sign = (result & 0x8000) != 0;
-		alu_overflow = ((operands[1] ^ result) & (operands[0] ^ result) & 0x8000) != 0;
-		alu_zero = (result & 0xffff) == 0;
-		alu_parity ^= (alu_parity >> 8);
-	}
-	else
-	{
-		alu_carry = (carries & 0x800000) != 0;
-		alu_sign = (result & 0x800000) != 0;
-		alu_overflow = ((operands[1] ^ result) & (operands[0] ^ result) & 0x800000) != 0;
-		alu_zero = (result & 0xffffff) == 0;
-		alu_parity ^= (alu_parity >> 8) ^ (alu_parity >> 16);
-	}
-	alu_carry ^= state->control->invert_carries;
+	uint32_t size_bit = (state->control->srcs[0].size == SIZE_8_BIT) ? 0x80 : ((state->control->srcs[0].size == SIZE_16_BIT) ? 0x8000 : 0x800000);
+	bool alu_zero = (result & ((size_bit << 1) - 1)) == 0;
+	bool zero;
 	
-	// S - Sign/negative flag
-	flag_source_word |= (alu_sign) ? F_SIGN : 0;
-	// Z - Zero flag
 	switch (state->control->flag_z_mode)
 	{
 		case FLAG_Z_NORMAL:
-			flag_source_word |= (alu_zero) ? F_ZERO : 0;
-			state->used_z = alu_zero;
+			zero = alu_zero;
 			break;
 		case FLAG_Z_ACCUM:
-			flag_source_word |= (state->used_z && alu_zero) ? F_ZERO : 0;
-			state->used_z = state->used_z && alu_zero;
+			zero = state->used_z && alu_zero;
 			break;
 		case FLAG_Z_BIT_TEST:
-			flag_source_word |= ((operands[0] & operands[1]) == 0) ? F_ZERO : 0;
-			state->used_z = ((operands[0] & operands[1]) == 0);
+			zero = ((operands[0] & operands[1]) == 0);
 			break;
 		default:
 			execute_unreachable_();
 	}
+	state->used_z = zero;
 	
 	switch (state->control->latch_aux_mode)
 	{
@@ -692,50 +1048,50 @@ alu_modify_flags_ (pilot_execute_state *state, uint8_t flags, uint32_t operands[
 			state->sys->core.latch_aux = state->used_z;
 			break;
 		case LATCH_AUX_CARRY:
-			state->sys->core.latch_aux = !(state->control->operation == ALU_ADD) ? (state->alu_shifter_carry_bit != 0) : alu_carry;
+			// for an add, the same bit as C
+			state->sys->core.latch_aux = !(state->control->operation == ALU_ADD) ? (state->alu_shifter_carry_bit != 0) : alu_carry_out_(carries, state->control->srcs[0].size, state->control->invert_carries);
 			break;
 		default:
 			execute_unreachable_();
 	}
 	
-	// V - Overflow/parity flag
-	switch (state->control->flag_v_mode)
+	uint8_t write_mask = state->control->flag_write_mask;
+	if (!write_mask)
 	{
-		case FLAG_V_NORMAL:
-			flag_source_word |= (!(state->control->operation == ALU_ADD) ? alu_parity : alu_overflow) ? F_OVERFLOW : 0;
-			break;
-		case FLAG_V_CLEAR:
-			break;
-		case FLAG_V_SHIFTER_CARRY:
-			flag_source_word |= (state->alu_shifter_carry_bit != 0) ? F_OVERFLOW : 0;
-			break;
-		case FLAG_V_ACCUM:
-			flag_source_word |= ((!(state->control->operation == ALU_ADD) ? alu_parity : alu_overflow) || (flags & F_OVERFLOW) != 0) ? F_OVERFLOW : 0;
-			break;
-		default:
-			execute_unreachable_();
+		return;
 	}
 	
-	// C, X - Carry/borrow flags
-	flag_source_word |= (alu_carry) ? F_CARRY : 0;
-	flag_source_word |= (alu_carry) ? F_EXTEND : 0;
-	
-	flags &= ~state->control->flag_write_mask;
-	flags |= (flag_source_word & state->control->flag_write_mask);
+	// a pending operation can be forgotten if this one overwrites everything it would have written
+	if (state->flags_pending && (state->control->flag_v_mode == FLAG_V_ACCUM || (state->pending_flags.write_mask & ~write_mask)))
+	{
+		pilot_execute_flags_sync(state);
+	}
 	
-	return flags;
+	execute_pending_flags *pending = &state->pending_flags;
+	pending->operands[0] = operands[0];
+	pending->operands[1] = operands[1];
+	pending->result = result;
+	pending->carries = carries;
+	pending->size = state->control->srcs[0].size;
+	pending->write_mask = write_mask;
+	pending->v_mode = state->control->flag_v_mode;
+	pending->add = (state->control->operation == ALU_ADD);
+	pending->invert_carries = state->control->invert_carries;
+	pending->shifter_carry = state->alu_shifter_carry_bit;
+	pending->zero = zero;
+	state->flags_pending = TRUE;
 }
 
+// Runs any control word, looking at every field
 static void
-execute_half2_result_latch_ (pilot_execute_state *state)
+alu_kernel_generic_ (pilot_execute_state *state, uint32_t operands[2], uint32_t *carries)
 {
 	int i;
-	uint32_t operands[2];
-	uint32_t carries;
+	uint32_t sum;
+	// carry into the lsb of an add
+	uint32_t carry_in = 0;
 	
-	alu_src_control *src2 = &state->control->srcs[1];
-	uint8_t flags = fetch_data_(state, (alu_src_control){DATA_REG_F, SIZE_8_BIT, FALSE});
-	bool carry_flag_status = !(state->control->latch_aux_mode == LATCH_AUX_CARRY) ? ((flags & F_EXTEND) != 0) : state->sys->core.latch_aux;
+	const alu_src_control *src2 = &state->control->srcs[1];
 	
 	operands[0] = state->alu_input_latches[0];
 	operands[1] = state->alu_input_latches[1];
@@ -747,12 +1103,25 @@ execute_half2_result_latch_ (pilot_execute_state *state)
 	
 	if (state->control->src2_add_carry)
 	{
-		operands[1] += carry_flag_status;
+		carry_in = !(state->control->latch_aux_mode == LATCH_AUX_CARRY) ? (execute_read_flags_(state, F_EXTEND) != 0) : state->sys->core.latch_aux;
+	}
+	
+	if (state->control->src2_negate)
+	{
+		// a - (b + c) is a + ~b + 1 - c; the 1 goes in as a carry, or subtracting 0 would lose the carry out
+		operands[1] = ~operands[1];
+		carry_in = !carry_in;
+	}
+	
+	// the logic operations and the shifter need all of src2
+	if (state->control->operation != ALU_ADD || state->control->shifter_mode != SHIFTER_NONE)
+	{
+		operands[1] += carry_in;
+		carry_in = 0;
 	}
 	
 	if (state->control->src2_negate)
 	{
-		operands[1] = ~operands[1] + 1;
 		if (src2->size == SIZE_8_BIT)
 		{
 			operands[1] &= 0xff;
@@ -770,15 +1139,17 @@ execute_half2_result_latch_ (pilot_execute_state *state)
 	if (state->control->src2_and_with_aux && state->sys->core.latch_aux == 0)
 	{
 		operands[1] = 0;
+		carry_in = 0;
 	}
 	
 	for (i = 0; i < 2; i++)
 	{
-		alu_src_control *src = &state->control->srcs[i];
+		const alu_src_control *src = &state->control->srcs[i];
+		bool sign_extend = (i == 0) ? src->sign_extend : state->alu_src2_sign_extend;
 		if (src->size == SIZE_8_BIT)
 		{
 			operands[i] &= 0xff;
-			if (src->sign_extend && (operands[i] & 0x80))
+			if (sign_extend && (operands[i] & 0x80))
 			{
 				operands[i] |= 0xffff00;
 			}
@@ -786,7 +1157,7 @@ execute_half2_result_latch_ (pilot_execute_state *state)
 		else if (src->size == SIZE_16_BIT)
 		{
 			operands[i] &= 0xffff;
-			if (src->sign_extend && (operands[i] & 0x8000))
+			if (sign_extend && (operands[i] & 0x8000))
 			{
 				operands[i] |= 0xff0000;
 			}
@@ -805,46 +1176,210 @@ execute_half2_result_latch_ (pilot_execute_state *state)
 		case ALU_OFF:
 			break;
 		case ALU_ADD:
-			state->alu_output_latch = (operands[0] + operands[1]) & 0xffffff;
-			carries = operands[0] ^ operands[1] ^ state->alu_output_latch;
+			// the carries keep the carry out of the msb, which is past the end of the output latch in 24-bit mode
+			sum = operands[0] + operands[1] + carry_in;
+			state->alu_output_latch = sum & 0xffffff;
+			*carries = operands[0] ^ operands[1] ^ sum;
 			break;
 		case ALU_AND:
 			state->alu_output_latch = operands[0] & operands[1];
-			carries = 0;
+			*carries = 0;
 			break;
 		case ALU_OR:
 			state->alu_output_latch = operands[0] | operands[1];
-			carries = 0;
+			*carries = 0;
 			break;
 		case ALU_XOR:
 			state->alu_output_latch = operands[0] ^ operands[1];
-			carries = 0;
+			*carries = 0;
 			break;
 		default:
 			execute_unreachable_();
 	}
 	
-	if ((state->control->dest.size == SIZE_8_BIT) && (flags & F_DECIMAL) && (carries & 0x08))
+	if ((state->control->dest.size == SIZE_8_BIT) && (*carries & 0x08) && execute_read_flags_(state, F_DECIMAL))
 	{
 		state->alu_output_latch = state->alu_output_latch + 0x10;
-		carries = (carries & 0x0f) | ((operands[0] ^ operands[1] ^ state->alu_output_latch) & 0xf0);
-	}
-	
-	if (state->control->operation != ALU_OFF)
-	{
-		uint32_t flags_data = alu_modify_flags_(state, flags, operands, state->alu_output_latch, carries);
-		write_data_(state, (alu_src_control){DATA_REG_F, SIZE_8_BIT, FALSE}, &flags_data);
-		write_data_(state, state->control->dest, &state->alu_output_latch);
-		
-		state->control->operation = ALU_OFF;
+		*carries = (*carries & 0x0f) | ((operands[0] ^ operands[1] ^ state->alu_output_latch) & 0x1f0);
 	}
-	
+}
+
+/*
+ * Specialized kernels
+ *
+ * Nearly every control word that uses the ALU leaves the shifter alone, uses one size throughout and at
+ * most negates src2 or adds the carry to it. Such control words get one of these (picked by compile_alu_kernel_()),
+ * which is the generic path with everything but the operands fixed.
+ */
+
+enum
+{
+	ALU_KERNEL_ADD = 0,
+	ALU_KERNEL_ADC,
+	ALU_KERNEL_SUB,
+	ALU_KERNEL_SBC,
+	ALU_KERNEL_AND,
+	ALU_KERNEL_OR,
+	ALU_KERNEL_XOR,
+	ALU_NUM_KERNEL_OPS
+};
+
+static inline void
+alu_kernel_ (pilot_execute_state *state, uint32_t operands[2], uint32_t *carries, int kernel_op, uint32_t mask)
+{
+	uint32_t sum;
+	uint32_t carry_in = 0;
+	
+	operands[0] = state->alu_input_latches[0] & mask;
+	operands[1] = state->alu_input_latches[1];
+	
+	if (kernel_op == ALU_KERNEL_ADC || kernel_op == ALU_KERNEL_SBC)
+	{
+		carry_in = !(state->control->latch_aux_mode == LATCH_AUX_CARRY) ? (execute_read_flags_(state, F_EXTEND) != 0) : state->sys->core.latch_aux;
+	}
+	if (kernel_op == ALU_KERNEL_SUB || kernel_op == ALU_KERNEL_SBC)
+	{
+		// as a + ~b + 1 - c, the same as the generic path
+		operands[1] = ~operands[1];
+		carry_in = !carry_in;
+	}
+	operands[1] &= mask;
+	
+	state->alu_shifter_carry_bit = FALSE;
+	
+	switch (kernel_op)
+	{
+		case ALU_KERNEL_AND:
+			state->alu_output_latch = operands[0] & operands[1];
+			*carries = 0;
+			return;
+		case ALU_KERNEL_OR:
+			state->alu_output_latch = operands[0] | operands[1];
+			*carries = 0;
+			return;
+		case ALU_KERNEL_XOR:
+			state->alu_output_latch = operands[0] ^ operands[1];
+			*carries = 0;
+			return;
+		default:
+			sum = operands[0] + operands[1] + carry_in;
+			state->alu_output_latch = sum & 0xffffff;
+			*carries = operands[0] ^ operands[1] ^ sum;
+			break;
+	}
+	
+	if (mask == 0xff && (*carries & 0x08) && execute_read_flags_(state, F_DECIMAL))
+	{
+		state->alu_output_latch = state->alu_output_latch + 0x10;
+		*carries = (*carries & 0x0f) | ((operands[0] ^ operands[1] ^ state->alu_output_latch) & 0x1f0);
+	}
+}
+
+#define ALU_KERNEL_SIZES_(name, kernel_op) \
+	static void name##_8_ (pilot_execute_state *state, uint32_t operands[2], uint32_t *carries) { alu_kernel_(state, operands, carries, kernel_op, 0xff); } \
+	static void name##_16_ (pilot_execute_state *state, uint32_t operands[2], uint32_t *carries) { alu_kernel_(state, operands, carries, kernel_op, 0xffff); } \
+	static void name##_24_ (pilot_execute_state *state, uint32_t operands[2], uint32_t *carries) { alu_kernel_(state, operands, carries, kernel_op, 0xffffff); }
+
+ALU_KERNEL_SIZES_(alu_kernel_add, ALU_KERNEL_ADD)
+ALU_KERNEL_SIZES_(alu_kernel_adc, ALU_KERNEL_ADC)
+ALU_KERNEL_SIZES_(alu_kernel_sub, ALU_KERNEL_SUB)
+ALU_KERNEL_SIZES_(alu_kernel_sbc, ALU_KERNEL_SBC)
+ALU_KERNEL_SIZES_(alu_kernel_and, ALU_KERNEL_AND)
+ALU_KERNEL_SIZES_(alu_kernel_or, ALU_KERNEL_OR)
+ALU_KERNEL_SIZES_(alu_kernel_xor, ALU_KERNEL_XOR)
+
+typedef void (*alu_kernel) (pilot_execute_state *state, uint32_t operands[2], uint32_t *carries);
+
+// Indexed by execute_control_word.alu_kernel: 0 is the generic path, then one per operation and size
+static const alu_kernel alu_kernels_[1 + ALU_NUM_KERNEL_OPS * 3] =
+{
+	alu_kernel_generic_,
+	alu_kernel_add_8_, alu_kernel_add_16_, alu_kernel_add_24_,
+	alu_kernel_adc_8_, alu_kernel_adc_16_, alu_kernel_adc_24_,
+	alu_kernel_sub_8_, alu_kernel_sub_16_, alu_kernel_sub_24_,
+	alu_kernel_sbc_8_, alu_kernel_sbc_16_, alu_kernel_sbc_24_,
+	alu_kernel_and_8_, alu_kernel_and_16_, alu_kernel_and_24_,
+	alu_kernel_or_8_, alu_kernel_or_16_, alu_kernel_or_24_,
+	alu_kernel_xor_8_, alu_kernel_xor_16_, alu_kernel_xor_24_
+};
+
+static uint8_t
+compile_alu_kernel_ (const execute_control_word *op)
+{
+	int kernel_op;
+	
+	if (op->operation == ALU_OFF || op->shifter_mode != SHIFTER_NONE || op->src2_add1 || op->src2_and_with_aux)
+	{
+		return 0;
+	}
+	
+	// sign extension of src2 can also be switched on by an index word as it's latched
+	if (op->srcs[0].size != op->srcs[1].size || op->dest.size != op->srcs[0].size
+		|| op->srcs[0].sign_extend || op->srcs[1].sign_extend
+		|| op->srcs[0].location == DATA_REG_IMM_2_8 || op->srcs[0].location == DATA_REG_RM_2_8
+		|| op->srcs[1].location == DATA_REG_IMM_2_8 || op->srcs[1].location == DATA_REG_RM_2_8)
+	{
+		return 0;
+	}
+	
+	switch (op->operation)
+	{
+		case ALU_ADD:
+			kernel_op = op->src2_negate ? (op->src2_add_carry ? ALU_KERNEL_SBC : ALU_KERNEL_SUB) : (op->src2_add_carry ? ALU_KERNEL_ADC : ALU_KERNEL_ADD);
+			break;
+		case ALU_AND:
+		case ALU_OR:
+		case ALU_XOR:
+			if (op->src2_negate || op->src2_add_carry)
+			{
+				return 0;
+			}
+			kernel_op = ALU_KERNEL_AND + (op->operation - ALU_AND);
+			break;
+		default:
+			return 0;
+	}
+	
+	return 1 + kernel_op * 3 + ((op->srcs[0].size == SIZE_8_BIT) ? 0 : ((op->srcs[0].size == SIZE_16_BIT) ? 1 : 2));
+}
+
+void
+pilot_execute_compile_control (execute_control_word *op)
+{
+	op->src_access[0] = compile_fetch_(op, op->srcs[0]);
+	op->src_access[1] = compile_fetch_(op, op->srcs[1]);
+	op->dest_access = compile_write_(op->dest);
+	op->alu_kernel = compile_alu_kernel_(op);
+}
+
+static void
+execute_half2_result_latch_ (pilot_execute_state *state)
+{
+	uint32_t operands[2];
+	uint32_t carries;
+	
+	alu_kernels_[state->control->alu_kernel](state, operands, &carries);
+	
+	if (state->control->operation != ALU_OFF && !state->control_status->alu_done)
+	{
+		alu_modify_flags_(state, operands, state->alu_output_latch, carries);
+		write_operand_(state, &state->alu_output_latch);
+		
+		state->control_status->alu_done = TRUE;
+	}
+	
 	state->execution_phase = EXEC_HALF2_MEM_PREPARE;
 }
 
 static void
 execute_half2_mem_prepare_ (pilot_execute_state *state)
 {
+	if (state->control_status->mem_done)
+	{
+		state->execution_phase = EXEC_HALF2_MEM_ASSERT;
+		return;
+	}
+	
 	if (state->control->mem_latch_ctl == MEM_LATCH_HALF2)
 	{
 		state->mem_addr = state->alu_output_latch;
@@ -880,125 +1415,135 @@ execute_half2_mem_prepare_ (pilot_execute_state *state)
 static void
 execute_half2_mem_assert_ (pilot_execute_state *state)
 {
-	if (state->control->mem_latch_ctl >= MEM_LATCH_HALF2 && !state->control->mem_access_suppress)
+	if (state->control->mem_latch_ctl >= MEM_LATCH_HALF2 && !state->control_status->mem_done && !state->control->mem_access_suppress)
 	{
-		if (state->control->mem_write_ctl == MEM_READ)
-		{
-			if (!Pilot_mem_addr_read_assert(state->sys, state->control->is_16bit, state->mem_addr))
-			{
-				return;
-			}
-			state->mem_access_was_read = TRUE;
-		}
-		else
+		if (!execute_mem_assert_(state))
 		{
-			if (!Pilot_mem_addr_write_assert(state->sys, state->control->is_16bit, state->mem_addr, state->mem_data & 0xffff))
-			{
-				return;
-			}
-			state->mem_access_was_read = FALSE;
+			return;
 		}
-		state->mem_access_waiting = TRUE;
-		state->control->mem_latch_ctl = MEM_NO_LATCH;
 	}
 	
 	state->execution_phase = EXEC_HALF2_ADVANCE_SEQUENCER;
 }
 
+/*
+ * Branch conditions only look at V, C, Z and S. Packed into 4 bits, they index a 16-bit mask per condition
+ * whose set bits are the flag combinations that take the branch.
+ */
+#define BRANCH_FLAGS_	(F_OVERFLOW | F_CARRY | F_ZERO | F_SIGN)
+#define BRANCH_INDEX_(flags)	((((flags) >> 2) & 0x3) | (((flags) >> 4) & 0xc))
+#define BRANCH_BIT_(cond, i)	((cond(((i) & 1) != 0, ((i) & 2) != 0, ((i) & 4) != 0, ((i) & 8) != 0)) ? (1u << (i)) : 0)
+#define BRANCH_MASK_(cond)	(BRANCH_BIT_(cond, 0) | BRANCH_BIT_(cond, 1) | BRANCH_BIT_(cond, 2) | BRANCH_BIT_(cond, 3) \
+	| BRANCH_BIT_(cond, 4) | BRANCH_BIT_(cond, 5) | BRANCH_BIT_(cond, 6) | BRANCH_BIT_(cond, 7) \
+	| BRANCH_BIT_(cond, 8) | BRANCH_BIT_(cond, 9) | BRANCH_BIT_(cond, 10) | BRANCH_BIT_(cond, 11) \
+	| BRANCH_BIT_(cond, 12) | BRANCH_BIT_(cond, 13) | BRANCH_BIT_(cond, 14) | BRANCH_BIT_(cond, 15))
+
+#define COND_LE_(v, c, z, s)	((z) || ((s) != (v)))
+#define COND_GT_(v, c, z, s)	(!(z) && ((s) == (v)))
+#define COND_LT_(v, c, z, s)	((s) != (v))
+#define COND_GE_(v, c, z, s)	((s) == (v))
+#define COND_U_LE_(v, c, z, s)	((c) || (z))
+#define COND_U_GT_(v, c, z, s)	(!(c) && !(z))
+#define COND_C_(v, c, z, s)	(c)
+#define COND_NC_(v, c, z, s)	(!(c))
+#define COND_M_(v, c, z, s)	(s)
+#define COND_P_(v, c, z, s)	(!(s))
+#define COND_OV_(v, c, z, s)	(v)
+#define COND_NOV_(v, c, z, s)	(!(v))
+#define COND_Z_(v, c, z, s)	(z)
+#define COND_NZ_(v, c, z, s)	(!(z))
+
+static const uint16_t branch_cond_table_[] =
+{
+	[COND_LE] = BRANCH_MASK_(COND_LE_),
+	[COND_GT] = BRANCH_MASK_(COND_GT_),
+	[COND_LT] = BRANCH_MASK_(COND_LT_),
+	[COND_GE] = BRANCH_MASK_(COND_GE_),
+	[COND_U_LE] = BRANCH_MASK_(COND_U_LE_),
+	[COND_U_GT] = BRANCH_MASK_(COND_U_GT_),
+	[COND_C] = BRANCH_MASK_(COND_C_),
+	[COND_NC] = BRANCH_MASK_(COND_NC_),
+	[COND_M] = BRANCH_MASK_(COND_M_),
+	[COND_P] = BRANCH_MASK_(COND_P_),
+	[COND_OV] = BRANCH_MASK_(COND_OV_),
+	[COND_NOV] = BRANCH_MASK_(COND_NOV_),
+	[COND_Z] = BRANCH_MASK_(COND_Z_),
+	[COND_NZ] = BRANCH_MASK_(COND_NZ_),
+	[COND_ALWAYS] = 0xffff,
+	[COND_ALWAYS_CALL] = 0xffff
+};
+
 static bool
 execute_sequencer_branch_test_ (pilot_execute_state *state)
 {
-	uint8_t flags = fetch_data_(state, (alu_src_control){DATA_REG_F, SIZE_8_BIT, FALSE});
-	bool overflow = (flags & F_OVERFLOW) != 0;
-	bool carry = (flags & F_CARRY) != 0;
-	bool zero = (flags & F_ZERO) != 0;
-	bool sign = (flags & F_SIGN) != 0;
-	
-	bool branched = TRUE;
+	bool branched;
 	
-	switch (state->mucode_decoded_buffer.branch_cond)
+	if (state->mucode_decoded->branch_cond == COND_DJNZ)
 	{
-		case COND_LE:
-			branched = zero || (sign != overflow);
-			break;
-		case COND_GT:
-			branched = (!zero) && (sign == overflow);
-			break;
-		case COND_LT:
-			branched = sign != overflow;
-			break;
-		case COND_GE:
-			branched = sign == overflow;
-			break;
-		case COND_U_LE:
-			branched = carry || zero;
-			break;
-		case COND_U_GT:
-			branched = (!carry) && (!zero);
-			break;
-		case COND_C:
-			branched = carry;
-			break;
-		case COND_NC:
-			branched = !carry;
-			break;
-		case COND_M:
-			branched = sign;
-			break;
-		case COND_P:
-			branched = !sign;
-			break;
-		case COND_OV:
-			branched = overflow;
-			break;
-		case COND_NOV:
-			branched = !overflow;
-			break;
-		case COND_Z:
-			branched = zero;
-			break;
-		case COND_NZ:
-			branched = !zero;
-			break;
-		case COND_ALWAYS:
-		case COND_ALWAYS_CALL:
-			branched = TRUE;
-			break;
-		case COND_DJNZ:
-			branched = !state->sys->core.latch_aux;
-			break;
-		default:
-			execute_unreachable_();
-			return FALSE;
+		branched = !state->sys->core.latch_aux;
+	}
+	else if (state->mucode_decoded->branch_cond <= COND_ALWAYS_CALL)
+	{
+		uint8_t flags = execute_read_flags_(state, BRANCH_FLAGS_);
+		branched = (branch_cond_table_[state->mucode_decoded->branch_cond] >> BRANCH_INDEX_(flags)) & 1;
+	}
+	else
+	{
+		execute_unreachable_();
+		return FALSE;
 	}
 	
-	state->mucode_control = branched ? state->mucode_decoded_buffer.next : state->mucode_decoded_buffer.next_no_branch;
+	state->mucode_control = branched ? state->mucode_decoded->next : state->mucode_decoded->next_no_branch;
 	return state->mucode_control.entry_idx != MU_NONE;
 }
 
 static bool
 execute_sequencer_mucode_run_ (pilot_execute_state *state)
 {
-	if (state->mucode_decoded_buffer.branch && !execute_sequencer_branch_test_(state))
+	// a branch entry leaves mucode_control cleared until it's been tested; a new sequence sets it first
+	if (state->mucode_decoded && state->mucode_decoded->branch && state->mucode_control.entry_idx == MU_NONE
+		&& !execute_sequencer_branch_test_(state))
 	{
 		return FALSE;
 	}
 	
-	state->mucode_decoded_buffer = decode_mucode_entry(state->mucode_control);
-	state->control = &state->mucode_decoded_buffer.operation;
+	state->mucode_decoded = mucode_rom_lookup(state->mucode_control);
+	PILOT_PERF_(state->sys, mucode_steps[state->mucode_control.entry_idx]);
+	if (state->mucode_control.entry_idx == MU_PUSH_PGC_WR_PGC)
+	{
+		PILOT_PROF_CALL_(state->sys, state->decoded_inst.inst_pgc);
+	}
+	state->control = &state->mucode_decoded->operation;
+	state->control_status = &state->mucode_status;
+	state->mucode_status.alu_done = FALSE;
+	state->mucode_status.mem_done = FALSE;
 	
-	if (!state->mucode_decoded_buffer.branch)
+	if (!state->mucode_decoded->branch)
 	{
-		state->mucode_control = state->mucode_decoded_buffer.next;
+		state->mucode_control = state->mucode_decoded->next;
+	}
+	else
+	{
+		state->mucode_control.entry_idx = MU_NONE;
 	}
 	
-	if (state->mucode_decoded_buffer.branch || state->mucode_decoded_buffer.next.entry_idx != MU_NONE) {
+	if (state->mucode_decoded->branch || state->mucode_decoded->next.entry_idx != MU_NONE) {
 		return TRUE;
 	}
 	
 	return FALSE;
 }
 
+static inline void
+execute_sequencer_latch_inst_ (pilot_execute_state *state)
+{
+	state->decoded_inst = *state->sys->interconnects.decoded_inst;
+	
+	// a freshly latched core op hasn't been carried out yet, even if the sequencer is still pointing at it
+	state->core_op_status.alu_done = FALSE;
+	state->core_op_status.mem_done = FALSE;
+}
+
 static bool
 execute_sequencer_interrupt_test_ (pilot_execute_state *state)
 {
@@ -1010,6 +1555,33 @@ execute_sequencer_interrupt_test_ (pilot_execute_state *state)
 	return TRUE;
 }
 
+// Finishes an instruction. The decoder has gone on from wherever it predicted the instruction would
+// continue; if it actually went somewhere else, what was decoded since is thrown away and the fetch unit
+// is sent to the right address.
+static void
+execute_sequencer_end_inst_ (pilot_execute_state *state)
+{
+	pilot_interconnect *interconnects = &state->sys->interconnects;
+	uint32_t fall_through = (state->decoded_inst.inst_pgc + 2 * state->decoded_inst.inst_length) & 0xfffffe;
+	uint32_t next = state->branched ? state->branch_addr : fall_through;
+	
+	if (next != state->decoded_inst.next_pgc)
+	{
+		if (state->decoded_inst.next_pgc != fall_through)
+		{
+			PILOT_PERF_(state->sys, branch_mispredicts);
+		}
+		
+		interconnects->execute_branch = TRUE;
+		interconnects->execute_branch_addr = next;
+		interconnects->decoded_inst_semaph = FALSE;
+		interconnects->decode_stall = TRUE;
+	}
+	
+	state->branched = FALSE;
+	state->sequencer_phase = EXEC_SEQ_WAIT_NEXT_INS;
+}
+
 static void
 execute_half2_advance_sequencer_ (pilot_execute_state *state)
 {
@@ -1033,7 +1605,7 @@ execute_half2_advance_sequencer_ (pilot_execute_state *state)
 			state->repeat_type.entry_idx = MU_NONE;
 			state->sequencer_phase = EXEC_SEQ_FINAL_STEPS;
 		}
-		else if (state->repeat_type.entry_idx == MU_REPR && (fetch_data_(state, (alu_src_control){DATA_REG_F, SIZE_8_BIT, FALSE}) & F_ZERO) != 0)
+		else if (state->repeat_type.entry_idx == MU_REPR && execute_read_flags_(state, F_ZERO) != 0)
 		{
 			state->repeat_type.entry_idx = MU_NONE;
 			state->sequencer_phase = EXEC_SEQ_FINAL_STEPS;
@@ -1042,6 +1614,13 @@ execute_half2_advance_sequencer_ (pilot_execute_state *state)
 		{
 			state->sequencer_phase = EXEC_SEQ_WAIT_CACHED_INS;
 		}
+		
+		// REPR points PGC back at itself only while the repeat is going on; once that's over, execution
+		// carries on after the repeated instruction
+		if (state->sequencer_phase == EXEC_SEQ_FINAL_STEPS && state->repeat_type.entry_idx == MU_NONE)
+		{
+			state->branched = FALSE;
+		}
 	}
 	
 	if (state->sequencer_phase == EXEC_SEQ_FINAL_STEPS)
@@ -1052,6 +1631,7 @@ execute_half2_advance_sequencer_ (pilot_execute_state *state)
 			state->mucode_control = state->repeat_type;
 			state->sequencer_phase = EXEC_SEQ_REPEAT_OP;
 			state->decoded_inst.repeat_op.entry_idx = MU_NONE;
+			state->repeat_iterations = 0;
 		}
 		else if (state->repeat_type.entry_idx != MU_NONE)
 		{
@@ -1060,9 +1640,7 @@ execute_half2_advance_sequencer_ (pilot_execute_state *state)
 		}
 		else if (state->branched)
 		{
-			state->branched = FALSE;
-			state->sys->interconnects.decoded_inst_semaph = FALSE;
-			state->sequencer_phase = EXEC_SEQ_WAIT_NEXT_INS;
+			execute_sequencer_end_inst_(state);
 		}
 		else if (state->decoded_inst.interrupt)
 		{
@@ -1074,7 +1652,7 @@ execute_half2_advance_sequencer_ (pilot_execute_state *state)
 		}
 		else
 		{
-			state->sequencer_phase = EXEC_SEQ_WAIT_NEXT_INS;
+			execute_sequencer_end_inst_(state);
 		}
 	}
 	
@@ -1082,8 +1660,11 @@ execute_half2_advance_sequencer_ (pilot_execute_state *state)
 	{
 		if (state->sys->interconnects.decoded_inst_semaph)
 		{
-			state->decoded_inst = *state->sys->interconnects.decoded_inst;
+			execute_sequencer_latch_inst_(state);
 			state->sys->interconnects.decoded_inst_semaph = FALSE;
+			state->inst_latched = TRUE;
+			PILOT_PERF_(state->sys, insts);
+			PILOT_PERF_(state->sys, inst_mix[state->decoded_inst.inst_class]);
 			
 			if (state->repeat_type.entry_idx == MU_REPR)
 			{
@@ -1101,7 +1682,7 @@ execute_half2_advance_sequencer_ (pilot_execute_state *state)
 	{
 		if (!execute_sequencer_mucode_run_(state))
 		{
-			state->sequencer_phase = EXEC_SEQ_WAIT_NEXT_INS;
+			execute_sequencer_end_inst_(state);
 		}
 	}
 	
@@ -1116,32 +1697,32 @@ execute_half2_advance_sequencer_ (pilot_execute_state *state)
 			}
 			else
 			{
-				state->sequencer_phase = EXEC_SEQ_WAIT_NEXT_INS;
+				execute_sequencer_end_inst_(state);
 			}
 		}
 	}
 	
 	if (state->sequencer_phase == EXEC_SEQ_WAIT_CACHED_INS)
 	{
-		state->decoded_inst = *state->sys->interconnects.decoded_inst;
+		execute_sequencer_latch_inst_(state);
 		state->sequencer_phase = EXEC_SEQ_EVAL_CONTROL;
+		state->repeat_latched = TRUE;
+		state->repeat_iterations++;
 	}
 	
 	if (state->sequencer_phase == EXEC_SEQ_EVAL_CONTROL)
 	{
 		if (state->decoded_inst.div_zero)
 		{
-			state->sequencer_phase = EXEC_SEQ_WAIT_NEXT_INS;
-			
 			uint32_t branch_addr = 0xffcfd0;
 			write_data_(state, (alu_src_control){DATA_REG_PGC, SIZE_24_BIT, FALSE}, &branch_addr);
+			execute_sequencer_end_inst_(state);
 		}
 		else if (state->decoded_inst.illegal)
 		{
-			state->sequencer_phase = EXEC_SEQ_WAIT_NEXT_INS;
-			
 			uint32_t branch_addr = 0xffcfe0;
 			write_data_(state, (alu_src_control){DATA_REG_PGC, SIZE_24_BIT, FALSE}, &branch_addr);
+			execute_sequencer_end_inst_(state);
 		}
 		else if (state->decoded_inst.restart)
 		{
@@ -1165,6 +1746,7 @@ execute_half2_advance_sequencer_ (pilot_execute_state *state)
 	if (state->sequencer_phase == EXEC_SEQ_CORE_OP)
 	{
 		state->control = &state->decoded_inst.core_op;
+		state->control_status = &state->core_op_status;
 		state->sequencer_phase = EXEC_SEQ_CORE_OP_EXECUTED;
 	}
 	
@@ -1201,7 +1783,7 @@ execute_half2_advance_sequencer_ (pilot_execute_state *state)
 		}
 		else
 		{
-			state->sequencer_phase = EXEC_SEQ_WAIT_NEXT_INS;
+			execute_sequencer_end_inst_(state);
 		}
 	}
 }
@@ -1214,6 +1796,12 @@ pilot_execute_half2 (pilot_execute_state *state)
 		return;
 	}
 	
+	pilot_execute_half2_clocked(state);
+}
+
+void
+pilot_execute_half2_clocked (pilot_execute_state *state)
+{
 	if (state->execution_phase == EXEC_START)
 	{
 		if (state->sys->interconnects.decoded_inst_semaph)
@@ -1245,8 +1833,724 @@ pilot_execute_half2 (pilot_execute_state *state)
 	if (state->execution_phase == EXEC_HALF2_ADVANCE_SEQUENCER)
 	{
 		execute_half2_advance_sequencer_(state);
-		state->sys->interconnects.execute_memory_backoff = (state->control->mem_latch_ctl != MEM_NO_LATCH && !state->control->mem_access_suppress);
+		state->sys->interconnects.execute_memory_backoff = (state->control->mem_latch_ctl != MEM_NO_LATCH && !state->control_status->mem_done && !state->control->mem_access_suppress);
+		
+		state->execution_phase = EXEC_HALF1_READY;
+	}
+}
+
+/*
+ * Fast functional mode
+ * 
+ * Runs the same control words through the same sequencer, one whole control word per step. Memory accesses
+ * bypass the memory controller and complete immediately, but the data of a read only reaches mem_data at
+ * the start of the next control word, just as it would coming back from the memory controller.
+ */
+static bool
+execute_sync_mem_access_ (pilot_execute_state *state)
+{
+	const execute_control_word *control = state->control;
+	Pilot_system *sys = state->sys;
+	
+	if (control->is_24bit_high && state->mem_high_done)
+	{
+		state->mem_high_done = FALSE;
+		state->control_status->mem_done = TRUE;
+		return TRUE;
+	}
+	
+	if (control->mem_write_ctl == MEM_READ)
+	{
+		if (control->is_24bit)
+		{
+			if (!Pilot_mem_read24_sync(sys, state->mem_addr, &state->mem_sync_data))
+			{
+				return FALSE;
+			}
+		}
+		else
+		{
+			uint16_t data;
+			if (!Pilot_mem_read_sync(sys, control->is_16bit, state->mem_addr, &data))
+			{
+				return FALSE;
+			}
+			state->mem_sync_data = data;
+		}
+		state->mem_access_was_read = TRUE;
+	}
+	else
+	{
+		if (!(control->is_24bit ? Pilot_mem_write24_sync(sys, state->mem_addr, state->mem_data & 0xffffff)
+			: Pilot_mem_write_sync(sys, control->is_16bit, state->mem_addr, state->mem_data & 0xffff)))
+		{
+			return FALSE;
+		}
+		state->mem_access_was_read = FALSE;
+	}
+	
+	state->mem_access_waiting = TRUE;
+	state->mem_high_done = control->is_24bit;
+	state->control_status->mem_done = TRUE;
+	return TRUE;
+}
+
+void
+pilot_execute_sync_flush (pilot_execute_state *state)
+{
+	if (state->mem_access_waiting)
+	{
+		state->mem_access_waiting = FALSE;
+		if (state->mem_access_was_read)
+		{
+			state->mem_data = state->mem_sync_data;
+		}
+	}
+}
+
+int
+pilot_execute_step_sync (pilot_execute_state *state)
+{
+	int accesses = 0;
+	
+	if (state->execution_phase == EXEC_START)
+	{
+		if (state->sys->interconnects.decoded_inst_semaph)
+		{
+			execute_half2_advance_sequencer_(state);
+			state->execution_phase = EXEC_HALF1_READY;
+		}
+		return 0;
+	}
+	
+	if (state->execution_phase == EXEC_HALF1_READY)
+	{
+		pilot_execute_sync_flush(state);
+		
+		state->alu_src2_sign_extend = state->control->srcs[1].sign_extend;
+		state->alu_input_latches[0] = fetch_operand_(state, 0);
+		state->alu_input_latches[1] = fetch_operand_(state, 1);
+		
+		execute_half1_mem_prepare_(state);
+	}
+	
+	if (state->execution_phase == EXEC_HALF1_MEM_ASSERT)
+	{
+		if (state->control->mem_latch_ctl == MEM_LATCH_HALF1 && !state->control_status->mem_done && !state->control->mem_access_suppress)
+		{
+			if (!execute_sync_mem_access_(state))
+			{
+				return -1;
+			}
+			accesses++;
+		}
+		state->execution_phase = EXEC_HALF2_RESULT_LATCH;
+	}
+	
+	if (state->execution_phase == EXEC_HALF2_RESULT_LATCH)
+	{
+		execute_half2_result_latch_(state);
+		execute_half2_mem_prepare_(state);
+	}
+	
+	if (state->execution_phase == EXEC_HALF2_MEM_ASSERT)
+	{
+		if (state->control->mem_latch_ctl >= MEM_LATCH_HALF2 && !state->control_status->mem_done && !state->control->mem_access_suppress)
+		{
+			if (!execute_sync_mem_access_(state))
+			{
+				return -1;
+			}
+			accesses++;
+		}
 		
+		execute_half2_advance_sequencer_(state);
+		state->sys->interconnects.execute_memory_backoff = FALSE;
 		state->execution_phase = EXEC_HALF1_READY;
 	}
+	
+	return accesses;
+}
+
+/*
+ * Repeated block operations
+ * 
+ * What REPI and REPR mostly end up repeating is an LD or CP on auto-indexed memory: block copies, fills
+ * and searches through a buffer. In fast mode, once an iteration of one has gone by entirely on directly
+ * mapped memory, what an iteration costs is known, so the ones after it can be carried out straight on
+ * host memory. The iteration that ends the loop is always left to the sequencer, and so is the one right
+ * after those carried out here, which sets the flags and latches just as the last of them would have.
+ */
+
+enum
+{
+	// LD from memory to memory
+	REPEAT_BLOCK_COPY = 0,
+	// LD to memory from something that stays the same throughout
+	REPEAT_BLOCK_FILL,
+	// ALU operation on a memory operand that only sets flags (CP and the like)
+	REPEAT_BLOCK_TEST
+};
+
+// A memory operand accessed through a register that's auto-indexed
+typedef struct
+{
+	uint8_t reg;
+	uint8_t bytes;
+	// How far the register moves per iteration; pre-decrement (negative) accesses after moving
+	int8_t step;
+} repeat_block_operand;
+
+typedef struct
+{
+	int kind;
+	const execute_control_word *op;
+	// src is the memory operand that's read (unless filling), dest the one LD writes
+	repeat_block_operand src;
+	repeat_block_operand dest;
+	// The other ALU input, and whether it's the left one
+	uint32_t value;
+	bool value_left;
+	// Registers that change from one iteration to the next
+	uint8_t written_regs;
+} repeat_block;
+
+static bool
+repeat_block_operand_ (mucode_entry_spec spec, data_size_spec size, repeat_block_operand *operand)
+{
+	if ((spec.entry_idx != MU_IND_REG_POST_AUTO && spec.entry_idx != MU_IND_REG_AUTO) || spec.mem_access_suppress)
+	{
+		return FALSE;
+	}
+	
+	// pre-decrement always accesses 24 bits, whatever the size of the instruction
+	if (spec.size != size)
+	{
+		return FALSE;
+	}
+	
+	// the register moves by the DATA_SIZE of the word that indexes it, which comes after the access for post-increment
+	const mucode_entry *entry = mucode_rom_lookup(spec);
+	while (spec.entry_idx == MU_IND_REG_POST_AUTO || entry->operation.srcs[1].location != DATA_SIZE
+		|| entry->operation.dest.location != entry->operation.srcs[0].location)
+	{
+		if (entry->branch || entry->next.entry_idx == MU_NONE)
+		{
+			return FALSE;
+		}
+		spec = entry->next;
+		entry = mucode_rom_lookup(spec);
+	}
+	
+	const execute_control_word *index = &entry->operation;
+	if (index->operation != ALU_ADD || index->src_access[1].kind != OPERAND_CONST)
+	{
+		return FALSE;
+	}
+	
+	operand->reg = spec.reg_select & 0x7;
+	operand->bytes = size + 1;
+	operand->step = index->src2_negate ? -(int8_t)index->src_access[1].mask : (int8_t)index->src_access[1].mask;
+	return TRUE;
+}
+
+// Reads a register operand (one of OPERAND_REG_* or OPERAND_INST_REG_*) as fetch_operand_() would
+static uint32_t
+operand_reg_read_ (const Pilot_cpu_regs *core, const inst_decoded_flags *inst, const alu_operand_access *access)
+{
+	switch (access->kind)
+	{
+		case OPERAND_REG_8:
+			return core->reg_bytes[access->index];
+		case OPERAND_REG_16:
+			return core->reg_words[access->index];
+		case OPERAND_REG_24:
+			return core->regs[access->index];
+		case OPERAND_INST_REG_8:
+			return core->reg_bytes[PILOT_REG_L(inst->operand_regs[access->index])];
+		case OPERAND_INST_REG_16:
+			return core->reg_words[PILOT_REG_W(inst->operand_regs[access->index])];
+		default:
+			return core->regs[inst->operand_regs[access->index]];
+	}
+}
+
+// Value of a source that stays the same for the whole loop; FALSE if it might not
+static bool
+repeat_block_const_ (const pilot_execute_state *state, int src, uint8_t written_regs, uint32_t *value)
+{
+	const alu_operand_access *access = &state->decoded_inst.core_op.src_access[src];
+	uint8_t reg;
+	
+	switch (access->kind)
+	{
+		case OPERAND_CONST:
+			*value = access->mask;
+			return TRUE;
+		case OPERAND_INST_IMM:
+			*value = (state->decoded_inst.operand_imms[access->index] >> access->shift) & access->mask;
+			return TRUE;
+		case OPERAND_REG_8:
+			// a byte of the register file; four to a register, whichever way round they are
+			reg = access->index / 4;
+			break;
+		case OPERAND_REG_16:
+			reg = access->index / 2;
+			break;
+		case OPERAND_REG_24:
+			reg = access->index;
+			break;
+		case OPERAND_INST_REG_8:
+		case OPERAND_INST_REG_16:
+		case OPERAND_INST_REG_24:
+			reg = state->decoded_inst.operand_regs[access->index];
+			break;
+		default:
+			return FALSE;
+	}
+	
+	if (written_regs & (1 << reg))
+	{
+		return FALSE;
+	}
+	
+	*value = operand_reg_read_(&state->sys->core, &state->decoded_inst, access);
+	return TRUE;
+}
+
+// Works out whether the instruction being repeated is one of the operations above
+static bool
+repeat_block_decode_ (pilot_execute_state *state, repeat_block *block)
+{
+	const inst_decoded_flags *inst = &state->decoded_inst;
+	const execute_control_word *op = &inst->core_op;
+	data_size_spec size = op->srcs[0].size;
+	int value_src;
+	
+	if (op->operation == ALU_OFF || op->srcs[1].size != size || op->shifter_mode != SHIFTER_NONE
+		|| op->src2_add1 || op->src2_add_carry || op->src2_and_with_aux || (op->src2_negate && op->operation != ALU_ADD)
+		|| op->latch_aux_mode != LATCH_AUX_NONE || op->flag_z_mode != FLAG_Z_NORMAL || op->flag_v_mode == FLAG_V_ACCUM)
+	{
+		return FALSE;
+	}
+	
+	// decimal mode adjusts every addition, the ones that move the pointers included
+	if (execute_read_flags_(state, F_DECIMAL))
+	{
+		return FALSE;
+	}
+	
+	block->op = op;
+	block->written_regs = 0;
+	
+	if (inst->run_after.entry_idx != MU_NONE)
+	{
+		// LD; the destination is written from MDR after the core op
+		if (op->operation != ALU_OR || op->srcs[0].location != DATA_ZERO || op->dest.location != DATA_LATCH_MEM_DATA
+			|| op->mem_latch_ctl != MEM_NO_LATCH || !inst->run_after.is_write || !repeat_block_operand_(inst->run_after, size, &block->dest))
+		{
+			return FALSE;
+		}
+		block->written_regs |= 1 << block->dest.reg;
+		
+		if (inst->run_before.entry_idx == MU_NONE)
+		{
+			block->kind = REPEAT_BLOCK_FILL;
+			value_src = 1;
+		}
+		else
+		{
+			if (op->srcs[1].location != DATA_LATCH_MEM_DATA || inst->run_before.is_write
+				|| !repeat_block_operand_(inst->run_before, size, &block->src) || block->src.reg == block->dest.reg)
+			{
+				return FALSE;
+			}
+			block->kind = REPEAT_BLOCK_COPY;
+			block->written_regs |= 1 << block->src.reg;
+			value_src = -1;
+		}
+	}
+	else
+	{
+		if (!repeat_block_operand_(inst->run_before, size, &block->src))
+		{
+			return FALSE;
+		}
+		block->written_regs |= 1 << block->src.reg;
+		
+		// the read-modify-write forms work on MDR as it was left, not on what's in memory, so those aren't here
+		if (op->mem_latch_ctl != MEM_NO_LATCH || inst->run_before.is_write
+			|| (op->dest.location != DATA_ZERO && op->dest.location != DATA_LATCH_MEM_DATA))
+		{
+			return FALSE;
+		}
+		
+		block->kind = REPEAT_BLOCK_TEST;
+		value_src = (op->srcs[0].location == DATA_LATCH_MEM_DATA) ? 1 : 0;
+		
+		if (op->srcs[!value_src].location != DATA_LATCH_MEM_DATA)
+		{
+			return FALSE;
+		}
+	}
+	
+	// REPR's counter can't be one of the pointers as well
+	if (state->repeat_type.entry_idx == MU_REPR)
+	{
+		if (block->written_regs & (1 << state->sys->core.repr))
+		{
+			return FALSE;
+		}
+		block->written_regs |= 1 << state->sys->core.repr;
+	}
+	
+	if (value_src < 0)
+	{
+		return TRUE;
+	}
+	
+	block->value_left = (value_src == 0);
+	return repeat_block_const_(state, value_src, block->written_regs, &block->value);
+}
+
+// Whether the iteration that was timed did just what the next ones are going to: move the pointers and the
+// counter and nothing else (it doesn't if the sequencer skips part of the instruction)
+static bool
+repeat_block_timed_ (const pilot_execute_state *state, const repeat_block *block, const uint32_t *regs_before)
+{
+	for (int r = 0; r < 8; r++)
+	{
+		uint32_t delta = 0;
+		
+		if (block->kind != REPEAT_BLOCK_FILL && r == block->src.reg)
+		{
+			delta += block->src.step;
+		}
+		if (block->kind != REPEAT_BLOCK_TEST && r == block->dest.reg)
+		{
+			delta += block->dest.step;
+		}
+		if (state->repeat_type.entry_idx == MU_REPR && r == state->sys->core.repr)
+		{
+			delta--;
+		}
+		
+		if (((state->sys->core.regs[r] - regs_before[r]) & 0xffffff) != (delta & 0xffffff))
+		{
+			return FALSE;
+		}
+	}
+	
+	return TRUE;
+}
+
+// Host memory for the element of operand the iteration now starting goes to, if that and the next ones
+// are directly mapped. count is cut down to the elements left in the same page, less one for the iteration
+// the sequencer runs after them, which mustn't get held up on the bus where the one before it didn't
+static uint8_t *
+repeat_block_map_ (Pilot_system *sys, const repeat_block_operand *operand, bool write, uint32_t *count)
+{
+	uint32_t first = (sys->core.regs[operand->reg] + ((operand->step < 0) ? operand->step : 0)) & 0xffffff;
+	uint32_t len;
+	
+	// the iteration that was timed went to the element before, which has to have been direct as well
+	if (!Pilot_mem_direct_ptr(sys, first - operand->step, write, &len) || len < operand->bytes)
+	{
+		return NULL;
+	}
+	
+	uint8_t *mem = Pilot_mem_direct_ptr(sys, first, write, &len);
+	if (!mem || len < operand->bytes)
+	{
+		return NULL;
+	}
+	
+	uint32_t fit = (operand->step > 0) ? (len - operand->bytes) / operand->step : (first & MEM_PAGE_MASK) / -operand->step;
+	if (fit < *count)
+	{
+		*count = fit;
+	}
+	
+	return mem;
+}
+
+static inline uint32_t
+repeat_block_load_ (const uint8_t *mem, uint8_t bytes)
+{
+	uint32_t data = mem[0];
+	
+	if (bytes > 1)
+	{
+		data |= mem[1] << 8;
+	}
+	if (bytes > 2)
+	{
+		data |= mem[2] << 16;
+	}
+	
+	return data;
+}
+
+static inline void
+repeat_block_store_ (uint8_t *mem, uint8_t bytes, uint32_t data)
+{
+	mem[0] = data & 0xff;
+	
+	if (bytes > 1)
+	{
+		mem[1] = (data >> 8) & 0xff;
+	}
+	if (bytes > 2)
+	{
+		mem[2] = (data >> 16) & 0xff;
+	}
+}
+
+static inline uint32_t
+repeat_block_alu_ (const execute_control_word *op, uint32_t left, uint32_t right)
+{
+	switch (op->operation)
+	{
+		case ALU_ADD:
+			return op->src2_negate ? left - right : left + right;
+		case ALU_AND:
+			return left & right;
+		case ALU_OR:
+			return left | right;
+		default:
+			return left ^ right;
+	}
+}
+
+// Carries out up to count iterations; returns how many it did
+static uint32_t
+repeat_block_run_ (pilot_execute_state *state, const repeat_block *block, uint32_t count)
+{
+	Pilot_system *sys = state->sys;
+	bool stops_on_zero = (state->repeat_type.entry_idx == MU_REPR);
+	uint32_t mask = operand_size_mask_(block->op->srcs[0].size);
+	uint8_t *src = NULL;
+	uint8_t *dest = NULL;
+	uint32_t i;
+	
+	if (block->kind != REPEAT_BLOCK_FILL)
+	{
+		src = repeat_block_map_(sys, &block->src, FALSE, &count);
+		if (!src)
+		{
+			return 0;
+		}
+	}
+	if (block->kind == REPEAT_BLOCK_COPY || block->kind == REPEAT_BLOCK_FILL)
+	{
+		dest = repeat_block_map_(sys, &block->dest, TRUE, &count);
+		if (!dest)
+		{
+			return 0;
+		}
+	}
+	
+	int src_step = block->src.step;
+	int dest_step = block->dest.step;
+	uint8_t bytes = (block->kind == REPEAT_BLOCK_FILL) ? block->dest.bytes : block->src.bytes;
+	
+	switch (block->kind)
+	{
+		case REPEAT_BLOCK_COPY:
+			// one element at a time, in case the two overlap
+			for (i = 0; i < count; i++)
+			{
+				repeat_block_store_(dest + (int32_t)i * dest_step, bytes, repeat_block_load_(src + (int32_t)i * src_step, bytes));
+			}
+			break;
+		case REPEAT_BLOCK_FILL:
+			// LD is an OR with zero
+			for (i = 0; i < count; i++)
+			{
+				repeat_block_store_(dest + (int32_t)i * dest_step, bytes, block->value);
+			}
+			break;
+		case REPEAT_BLOCK_TEST:
+			// only REPR looks at the results; it stops once Z is set, so that iteration is the sequencer's
+			if (stops_on_zero)
+			{
+				for (i = 0; i < count; i++)
+				{
+					uint32_t data = repeat_block_load_(src + (int32_t)i * src_step, bytes);
+					uint32_t result = block->value_left ? repeat_block_alu_(block->op, block->value, data) : repeat_block_alu_(block->op, data, block->value);
+					if (!(result & mask))
+					{
+						break;
+					}
+				}
+				count = i;
+			}
+			break;
+	}
+	
+	if (!count)
+	{
+		return 0;
+	}
+	
+	if (block->kind != REPEAT_BLOCK_FILL)
+	{
+		sys->core.regs[block->src.reg] = (sys->core.regs[block->src.reg] + count * src_step) & 0xffffff;
+	}
+	if (dest)
+	{
+		Pilot_mem_direct_written(sys, sys->core.regs[block->dest.reg] + ((dest_step < 0) ? dest_step : 0));
+		sys->core.regs[block->dest.reg] = (sys->core.regs[block->dest.reg] + count * dest_step) & 0xffffff;
+	}
+	
+	return count;
+}
+
+void
+pilot_execute_repeat_bulk (pilot_execute_state *state, uint64_t cycle_limit)
+{
+	Pilot_system *sys = state->sys;
+	uint64_t cost = sys->cycles - state->repeat_cycle;
+	bool timed = (state->repeat_mark != 0 && state->repeat_mark + 1 == state->repeat_iterations);
+	uint32_t regs_before[8];
+	repeat_block block;
+	
+	memcpy(regs_before, state->repeat_regs, sizeof(regs_before));
+	memcpy(state->repeat_regs, sys->core.regs, sizeof(state->repeat_regs));
+	state->repeat_mark = state->repeat_iterations;
+	state->repeat_cycle = sys->cycles;
+	
+	if (!timed || !cost || state->repeat_type.entry_idx == MU_NONE || cycle_limit <= sys->cycles)
+	{
+		return;
+	}
+	
+	// the iteration after the ones carried out here has to be over before cycle_limit as well
+	uint64_t count = (cycle_limit - sys->cycles - 1) / cost;
+	if (count < 2)
+	{
+		return;
+	}
+	count--;
+	
+	// the counter has already been taken down for the iteration that's starting, which is the last
+	// one once it reaches 1 (if it's been taken down to 0, REPR keeps going until Z is set)
+	bool by_reg = (state->repeat_type.entry_idx == MU_REPR);
+	uint32_t left = by_reg ? sys->core.regs[sys->core.repr] : sys->core.repi;
+	if (left < 2)
+	{
+		return;
+	}
+	if (count > left - 1)
+	{
+		count = left - 1;
+	}
+	
+	if (!repeat_block_decode_(state, &block) || !repeat_block_timed_(state, &block, regs_before))
+	{
+		return;
+	}
+	
+	count = repeat_block_run_(state, &block, count);
+	if (!count)
+	{
+		return;
+	}
+	
+	if (by_reg)
+	{
+		sys->core.regs[sys->core.repr] = left - count;
+	}
+	else
+	{
+		sys->core.repi = left - count;
+	}
+	
+	sys->cycles += count * cost;
+	state->repeat_iterations += count;
+	memcpy(state->repeat_regs, sys->core.regs, sizeof(state->repeat_regs));
+	state->repeat_mark = state->repeat_iterations;
+	state->repeat_cycle = sys->cycles;
+	PILOT_PERF_(sys, repeat_blocks);
+}
+
+/*
+ * Multiply and divide
+ * 
+ * MULU / MULS and DIVU / DIVS run a shift-and-add (or shift-and-subtract) loop one bit per step. In fast
+ * mode, the loop itself (along with the setup steps of a multiply) can be done with one host operation
+ * instead: none of its control words touch memory, F or anything but r, R0, factorA, REPI and the aux latch,
+ * so only their end result has to come out the same. The sign handling of MULS and DIVS is left to the
+ * microcode, which sees exactly what the loop would have left behind.
+ */
+uint32_t
+pilot_execute_muldiv (pilot_execute_state *state, uint32_t max_words)
+{
+	Pilot_system *sys = state->sys;
+	
+	if (state->execution_phase != EXEC_HALF1_READY || state->sequencer_phase != EXEC_SEQ_RUN_AFTER
+		|| !state->mucode_decoded || state->mucode_status.alu_done)
+	{
+		return 0;
+	}
+	
+	mucode_entry_spec spec = mucode_rom_spec(state->mucode_decoded);
+	if (spec.entry_idx != MU_MUL_LD_FACTOR_A && spec.entry_idx != MU_DIV_LD_REPI)
+	{
+		return 0;
+	}
+	
+	bool mul = (spec.entry_idx == MU_MUL_LD_FACTOR_A);
+	uint32_t bits = (spec.size == SIZE_8_BIT) ? 8 : ((spec.size == SIZE_16_BIT) ? 16 : 24);
+	uint32_t mask = (1u << bits) - 1;
+	uint32_t words = mul ? 4 + 5 * bits : 1 + 6 * bits;
+	
+	// in decimal mode the adds in the loop (even the one counting it down) get adjusted
+	if (words > max_words || execute_read_flags_(state, F_DECIMAL))
+	{
+		return 0;
+	}
+	
+	alu_src_control reg = {DATA_REG_IMM_0_8, spec.size, FALSE};
+	alu_src_control reg_r0 = {DATA_REG_R0, spec.size, FALSE};
+	uint32_t lo, hi;
+	
+	pilot_execute_sync_flush(state);
+	
+	if (mul)
+	{
+		// unsigned, whether it's MULS or not
+		uint32_t factor_a = fetch_data_(state, reg) & mask;
+		uint64_t product = (uint64_t)factor_a * (sys->core.factor_b & mask);
+		sys->core.factor_a = factor_a;
+		lo = product & mask;
+		hi = (product >> bits) & mask;
+	}
+	else
+	{
+		// by now MU_DIV_TEST_DIVIDEND_HI has made sure the quotient fits, and DIVS has taken the magnitudes
+		uint64_t dividend = ((uint64_t)(fetch_data_(state, reg_r0) & mask) << bits) | (fetch_data_(state, reg) & mask);
+		uint32_t divisor = sys->core.factor_b & mask;
+		lo = dividend / divisor;
+		hi = dividend % divisor;
+	}
+	
+	write_data_(state, reg, &lo);
+	write_data_(state, reg_r0, &hi);
+	
+	// where the loop leaves off: its counter has just reached zero
+	sys->core.repi = 0;
+	sys->core.latch_aux = TRUE;
+	state->used_z = TRUE;
+	
+	spec.entry_idx = mul ? MU_MUL_LOOP : MU_DIV_LOOP;
+	state->mucode_control = mucode_rom_lookup(spec)->next_no_branch;
+	state->mucode_decoded = NULL;
+	if (!execute_sequencer_mucode_run_(state))
+	{
+		state->sequencer_phase = EXEC_SEQ_FINAL_STEPS;
+	}
+	
+	PILOT_PERF_(sys, host_muldiv);
+	return words;
 }
@@ -4,13 +4,47 @@
 #include "pilot.h"
 #include "types.h"
 
+// Set PILOT_REPEAT_BULK to 0 to always run repeated instructions one iteration at a time in fast mode
+#ifndef PILOT_REPEAT_BULK
+#define PILOT_REPEAT_BULK 1
+#endif
+
+// Set PILOT_HOST_MULDIV to 0 to always run the multiply and divide loops one control word at a time in fast mode
+#ifndef PILOT_HOST_MULDIV
+#define PILOT_HOST_MULDIV 1
+#endif
+
+// Control words are read-only; this records which parts of one have already been carried out
+typedef struct {
+	bool alu_done;
+	bool mem_done;
+} execute_control_status;
+
+// An ALU operation whose flags haven't been worked out yet
+typedef struct {
+	uint32_t operands[2];
+	uint32_t result;
+	uint32_t carries;
+	data_size_spec size;
+	uint8_t write_mask;
+	uint8_t v_mode;
+	bool add;
+	bool invert_carries;
+	bool shifter_carry;
+	// Z comes from the Z latch, so it's worked out right away
+	bool zero;
+} execute_pending_flags;
+
 typedef struct {
 	Pilot_system *sys;
 	
 	inst_decoded_flags decoded_inst;
 	mucode_entry_spec mucode_control;
-	mucode_entry mucode_decoded_buffer;
-	execute_control_word *control;
+	const mucode_entry *mucode_decoded;
+	const execute_control_word *control;
+	execute_control_status *control_status;
+	execute_control_status core_op_status;
+	execute_control_status mucode_status;
 	
 	mucode_entry_spec repeat_type;
 	
@@ -18,11 +52,17 @@ typedef struct {
 	uint32_t branch_addr;
 	
 	uint32_t alu_input_latches[2];
+	// sign extension of ALU src2, latched with the operand (indexed addressing takes it from the index word)
+	bool alu_src2_sign_extend;
 	uint32_t alu_output_latch;
 	bool alu_shifter_carry_bit;
 	
 	bool used_z;
 	
+	// The last operation that wrote flags, while F doesn't include them yet (see pilot_execute_flags_sync)
+	bool flags_pending;
+	execute_pending_flags pending_flags;
+	
 	// Memory address and data registers for requesting memory accesses
 	uint32_t mem_addr;
 	uint32_t mem_data;
@@ -31,6 +71,21 @@ typedef struct {
 	// During this time, any reads from mem_data will block until this flag goes low.
 	bool mem_access_waiting;
 	bool mem_access_was_read;
+	// Fast mode: data of a synchronous read, handed over to mem_data on the next control word
+	uint32_t mem_sync_data;
+	// Set by a 24-bit access until the high half it already took care of comes along
+	bool mem_high_done;
+	
+	// Set whenever the sequencer takes a new instruction from the decoder; cleared by whoever is watching
+	bool inst_latched;
+	// Same, for each iteration of a repeated instruction after the first
+	bool repeat_latched;
+	// Iterations of the repeated instruction so far, and which of them pilot_execute_repeat_bulk last saw begin,
+	// when, and with what in the registers
+	uint32_t repeat_iterations;
+	uint32_t repeat_mark;
+	uint64_t repeat_cycle;
+	uint32_t repeat_regs[8];
 	
 	enum
 	{
@@ -69,9 +124,37 @@ typedef struct {
 	} sequencer_phase;
 } pilot_execute_state;
 
-void execute_unreachable_ ();
+// Supplied by the host; called on paths the execute unit doesn't implement, and must not return
+_Noreturn void execute_unreachable_ (void);
+
+// Resolves the operands of a control word and picks its ALU kernel; must be called again whenever it changes
+void pilot_execute_compile_control (execute_control_word *op);
+// Fills in the operand table of an instruction from its immediate words, once they've all been read
+void pilot_execute_latch_operands (inst_decoded_flags *inst);
 
 void pilot_execute_half1 (pilot_execute_state *state);
 void pilot_execute_half2 (pilot_execute_state *state);
+// As above, for callers that have already checked core.disable_clk
+void pilot_execute_half1_clocked (pilot_execute_state *state);
+void pilot_execute_half2_clocked (pilot_execute_state *state);
+
+// Writes the flags of the last ALU operation to F, if that hasn't happened yet;
+// anything outside the execute stage has to call this before it reads or writes core.wf
+void pilot_execute_flags_sync (pilot_execute_state *state);
+// WF as it is once that's happened, without writing anything
+uint16_t pilot_execute_flags_value (const pilot_execute_state *state);
+
+// Fast mode: runs one control word with synchronous memory accesses
+// Returns the number of bus accesses it made, or -1 if the bus wasn't ready (call again to retry)
+int pilot_execute_step_sync (pilot_execute_state *state);
+// Fast mode: finishes the access started by the last control word
+void pilot_execute_sync_flush (pilot_execute_state *state);
+// Fast mode: call when repeat_latched gets set. Times the iteration just finished, and carries out as many
+// of the next ones as it can straight on host memory, if the instruction is a plain block operation
+// (copy, fill or compare) and they'd all be over before cycle_limit
+void pilot_execute_repeat_bulk (pilot_execute_state *state, uint64_t cycle_limit);
+// Fast mode: if the next control word starts the loop of a MULU / MULS / DIVU / DIVS, carries it out with one
+// host operation, provided it's no more than max_words control words long. Returns how many were skipped (or 0)
+uint32_t pilot_execute_muldiv (pilot_execute_state *state, uint32_t max_words);
 
 #endif
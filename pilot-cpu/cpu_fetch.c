@@ -1,5 +1,27 @@
 #include "cpu_fetch.h"
 #include "memory.h"
+#include "perf_counters.h"
+
+// Moves every word that isn't stuck behind slot 4 one slot ahead
+static inline uint8_t
+fetch_queue_advance_ (uint8_t full)
+{
+	// the run of occupied slots ending at slot 4 stays put; everything below the highest empty slot moves
+	uint8_t below = ~full & FETCH_QUEUE_ALL;
+	below |= below >> 1;
+	below |= below >> 2;
+	below |= below >> 4;
+	below >>= 1;
+	
+	return (full & ~below) | ((full & below) << 1);
+}
+
+static inline void
+fetch_queue_flush_ (pilot_fetch_state *state)
+{
+	state->queue_full = 0;
+	state->queue_head = state->queue_tail;
+}
 
 void
 pilot_fetch_half1 (pilot_fetch_state *state)
@@ -9,17 +31,15 @@ pilot_fetch_half1 (pilot_fetch_state *state)
 		return;
 	}
 	
+	pilot_fetch_half1_clocked(state);
+}
+
+void
+pilot_fetch_half1_clocked (pilot_fetch_state *state)
+{
 	if (state->fetch_phase == FETCH_HALF1_READY)
 	{
-		for (int i = 4; i > 0; i--)
-		{
-			if (!state->queue_words_full[i])
-			{
-				state->queue_words[i] = state->queue_words[i - 1];
-				state->queue_words_full[i] = state->queue_words_full[i - 1];
-				state->queue_words_full[i - 1] = FALSE;
-			}
-		}
+		state->queue_full = fetch_queue_advance_(state->queue_full);
 		
 		state->fetch_phase = FETCH_HALF1_MEM_WAIT;
 	}
@@ -30,8 +50,8 @@ pilot_fetch_half1 (pilot_fetch_state *state)
 		{
 			if (Pilot_mem_data_wait(state->sys))
 			{
-				state->queue_words[0] = Pilot_mem_get_data(state->sys);
-				state->queue_words_full[0] = TRUE;
+				state->queue_words[state->queue_tail++ & (FETCH_RING_SIZE - 1)] = Pilot_mem_get_data(state->sys);
+				state->queue_full |= 1;
 			}
 			else
 			{
@@ -48,13 +68,13 @@ pilot_fetch_half1 (pilot_fetch_state *state)
 	{
 		bool *fetch_word_semaph = &state->sys->interconnects.fetch_word_semaph;
 		uint16_t *fetch_word = &state->sys->interconnects.fetch_word;
+		bool branch_pending = state->sys->interconnects.decode_branch || state->sys->interconnects.execute_branch;
 		
-		state->sys->interconnects.decode_stall = FALSE;
-		
-		if (!(*fetch_word_semaph) && state->queue_words_full[4])
+		// a word from the old address would come out labelled with the new one
+		if (!(*fetch_word_semaph) && !branch_pending && (state->queue_full & FETCH_QUEUE_OUT))
 		{
-			*fetch_word = state->queue_words[4];
-			state->queue_words_full[4] = FALSE;
+			*fetch_word = state->queue_words[state->queue_head++ & (FETCH_RING_SIZE - 1)];
+			state->queue_full &= ~FETCH_QUEUE_OUT;
 			
 			state->sys->interconnects.fetch_addr = (state->sys->interconnects.fetch_addr + 2) & 0xfffffe;
 			*fetch_word_semaph = TRUE;
@@ -72,6 +92,12 @@ pilot_fetch_half2 (pilot_fetch_state *state)
 		return;
 	}
 	
+	pilot_fetch_half2_clocked(state);
+}
+
+void
+pilot_fetch_half2_clocked (pilot_fetch_state *state)
+{
 	if (state->fetch_phase == FETCH_HALF2_READY)
 	{
 		state->fetch_phase = FETCH_HALF2_BRANCH;
@@ -82,53 +108,30 @@ pilot_fetch_half2 (pilot_fetch_state *state)
 		bool *decode_branch = &state->sys->interconnects.decode_branch;
 		bool *execute_branch = &state->sys->interconnects.execute_branch;
 		
+		// fetch_addr is advanced as each word is dequeued, so it starts out one word before the target
 		if (*decode_branch)
 		{
 			*decode_branch = FALSE;
-			state->branch_predicted = TRUE;
+			PILOT_PERF_(state->sys, branches_predicted);
 			
 			state->sys->interconnects.fetch_word_semaph = FALSE;
 			
-			for (int i = 0; i < 5; i++)
-			{
-				state->queue_words_full[i] = FALSE;
-			}
+			fetch_queue_flush_(state);
 			
 			state->mem_addr = state->sys->interconnects.decode_branch_addr;
+			state->sys->interconnects.fetch_addr = (state->sys->interconnects.decode_branch_addr - 2) & 0xfffffe;
 		}
+		// the execute unit only sends the fetch unit somewhere the decoder didn't already predict
 		if (*execute_branch)
 		{
-			if (state->branch_predicted)
-			{
-				state->branch_predicted = FALSE;
-				
-				if (state->sys->interconnects.decode_branch_addr != state->sys->interconnects.execute_branch_addr)
-				{
-					state->sys->interconnects.decode_stall = TRUE;
-					state->sys->interconnects.fetch_word_semaph = FALSE;
-					
-					for (int i = 0; i < 5; i++)
-					{
-						state->queue_words_full[i] = FALSE;
-					}
-					
-					state->mem_addr = state->sys->interconnects.execute_branch_addr;
-				}
-			}
-			else
-			{
-				state->sys->interconnects.fetch_word_semaph = FALSE;
-				
-				for (int i = 0; i < 5; i++)
-				{
-					state->queue_words_full[i] = FALSE;
-				}
-				
-				state->mem_addr = state->sys->interconnects.execute_branch_addr;
-			}
-			
-			state->sys->interconnects.fetch_addr = state->sys->interconnects.execute_branch_addr;
 			*execute_branch = FALSE;
+			
+			state->sys->interconnects.fetch_word_semaph = FALSE;
+			
+			fetch_queue_flush_(state);
+			
+			state->mem_addr = state->sys->interconnects.execute_branch_addr;
+			state->sys->interconnects.fetch_addr = (state->sys->interconnects.execute_branch_addr - 2) & 0xfffffe;
 		}
 		
 		state->fetch_phase = FETCH_HALF2_MEM_ASSERT;
@@ -136,15 +139,7 @@ pilot_fetch_half2 (pilot_fetch_state *state)
 	
 	if (state->fetch_phase == FETCH_HALF2_MEM_ASSERT)
 	{
-		bool all_full = TRUE;
-		
-		for (int i = 0; i < 5; i++) {
-			if (!state->queue_words_full[i])
-			{
-				all_full = FALSE;
-			}
-		}
-		if (all_full)
+		if (state->queue_full == FETCH_QUEUE_ALL)
 		{
 			state->fetch_phase = FETCH_HALF1_READY;
 			return;
@@ -152,6 +147,7 @@ pilot_fetch_half2 (pilot_fetch_state *state)
 		
 		if (state->sys->interconnects.execute_memory_backoff)
 		{
+			PILOT_PERF_(state->sys, fetch_backoffs);
 			return;
 		}
 		
@@ -4,16 +4,26 @@
 #include "types.h"
 #include "pilot.h"
 
+#define FETCH_QUEUE_SLOTS	5
+#define FETCH_QUEUE_ALL	((1 << FETCH_QUEUE_SLOTS) - 1)
+#define FETCH_QUEUE_OUT	(1 << (FETCH_QUEUE_SLOTS - 1))
+// Must be a power of 2 at least as big as FETCH_QUEUE_SLOTS
+#define FETCH_RING_SIZE	8
+
 typedef struct {
 	Pilot_system *sys;
 	
-	uint16_t queue_words[5];
-	bool queue_words_full[5];
+	// The prefetch queue has 5 slots, and each cycle every word moves one slot closer to slot 4 unless the
+	// slot ahead is still occupied; the decoder takes words from slot 4. Words never overtake each other,
+	// so they're kept in the order they were fetched, while queue_full only tracks which slots are occupied.
+	uint16_t queue_words[FETCH_RING_SIZE];
+	uint8_t queue_head;
+	uint8_t queue_tail;
+	// Bit i is set if slot i is occupied
+	uint8_t queue_full;
 	
 	uint32_t mem_addr;
 	
-	bool branch_predicted;
-	
 	bool mem_access_waiting;
 	
 	enum
@@ -30,5 +40,8 @@ typedef struct {
 
 void pilot_fetch_half1 (pilot_fetch_state *state);
 void pilot_fetch_half2 (pilot_fetch_state *state);
+// As above, for callers that have already checked core.disable_clk
+void pilot_fetch_half1_clocked (pilot_fetch_state *state);
+void pilot_fetch_half2_clocked (pilot_fetch_state *state);
 
 #endif
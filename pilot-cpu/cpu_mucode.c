@@ -1,5 +1,7 @@
 #include "cpu_regs.h"
 #include "cpu_decode.h"
+#include "cpu_execute.h"
+#include <pthread.h>
 
 static inline mucode_entry
 base_entry_ (mucode_entry_spec spec)
@@ -58,9 +60,13 @@ base_entry_ (mucode_entry_spec spec)
 	
 	prg.operation.dest.location = DATA_ZERO;
 	prg.operation.dest.size = spec.size;
+	prg.operation.dest.sign_extend = FALSE;
 	
 	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	prg.operation.mem_write_ctl = MEM_READ;
 	prg.operation.is_16bit = (spec.size >= SIZE_16_BIT);
+	prg.operation.is_24bit = FALSE;
+	prg.operation.is_24bit_high = FALSE;
 	prg.operation.mem_access_suppress = spec.mem_access_suppress;
 	
 	return prg;
@@ -278,6 +284,7 @@ ind_2cyc_mar_auto_ (mucode_entry_spec spec)
 	
 	prg.operation.mem_latch_ctl = MEM_LATCH_HALF2;
 	prg.operation.mem_write_ctl = !(spec.is_write) ? MEM_READ : MEM_WRITE_FROM_MDR_HIGH;
+	prg.operation.is_24bit_high = TRUE;
 	
 	return prg;
 }
@@ -383,65 +390,579 @@ adjust_pgc_ (mucode_entry_spec spec)
 	return prg;
 }
 
+/*
+ * MULS / MULU
+ * 
+ * Shift-and-add, least significant bit first: r starts out as the multiplier and is shifted right once per
+ * step, with the low half of the product shifted in at the top as it's worked out. MULS multiplies the
+ * operands as unsigned and then takes factorB (and factorA) away from the high half for each operand that's
+ * negative.
+ */
+
+static mucode_entry
+mul_1cyc_ld_factor_a_(mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_REG_IMM_0_8;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_ZERO;
+	prg.operation.operation = ALU_OR;
+	
+	prg.operation.dest.location = DATA_LATCH_FACTOR_A;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.next.entry_idx = MU_MUL_LD_PRODUCT_LO;
+	prg.next.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+mul_2cyc_ld_product_lo_(mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_LATCH_FACTOR_B;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_ZERO;
+	prg.operation.operation = ALU_OR;
+	
+	prg.operation.dest.location = DATA_REG_IMM_0_8;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.next.entry_idx = MU_MUL_LD_PRODUCT_HI;
+	prg.next.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+mul_3cyc_ld_product_hi_(mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_ZERO;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_ZERO;
+	prg.operation.operation = ALU_OR;
+	
+	prg.operation.dest.location = DATA_REG_R0;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.next.entry_idx = MU_MUL_LD_REPI;
+	prg.next.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+mul_4cyc_ld_repi_(mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_NUM_BITS;
+	prg.operation.srcs[1].location = DATA_ZERO;
+	prg.operation.operation = ALU_OR;
+	
+	prg.operation.dest.size = SIZE_8_BIT;
+	prg.operation.dest.location = DATA_LATCH_REPI;
+	
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.next.entry_idx = MU_MUL_TEST_MULTIPLIER;
+	prg.next.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+mul_ncyc_test_multiplier_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_ZERO;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_REG_IMM_0_8;
+	prg.operation.operation = ALU_OR;
+	
+	prg.operation.dest.location = DATA_ZERO;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.operation.shifter_mode = SHIFTER_RIGHT_LOGICAL;
+	prg.operation.latch_aux_mode = LATCH_AUX_CARRY;
+	
+	prg.next.entry_idx = MU_MUL_ADD_PRODUCT_HI;
+	prg.next.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+mul_n1cyc_add_product_hi_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_REG_R0;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_LATCH_FACTOR_A;
+	prg.operation.operation = ALU_ADD;
+	
+	prg.operation.dest.location = DATA_REG_R0;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.operation.src2_and_with_aux = TRUE;
+	prg.operation.latch_aux_mode = LATCH_AUX_CARRY;
+	
+	prg.next.entry_idx = MU_MUL_SHIFT_PRODUCT_HI_RIGHT;
+	prg.next.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+mul_n2cyc_shift_product_hi_right_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_ZERO;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_REG_R0;
+	prg.operation.operation = ALU_OR;
+	
+	prg.operation.dest.location = DATA_REG_R0;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.operation.shifter_mode = SHIFTER_RIGHT_CARRY;
+	prg.operation.latch_aux_mode = LATCH_AUX_CARRY;
+	
+	prg.next.entry_idx = MU_MUL_SHIFT_PRODUCT_LO_RIGHT;
+	prg.next.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+mul_n3cyc_shift_product_lo_right_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_ZERO;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_REG_IMM_0_8;
+	prg.operation.operation = ALU_OR;
+	
+	prg.operation.dest.location = DATA_REG_IMM_0_8;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.operation.shifter_mode = SHIFTER_RIGHT_CARRY;
+	prg.operation.latch_aux_mode = LATCH_AUX_CARRY;
+	
+	prg.next.entry_idx = MU_MUL_LOOP;
+	prg.next.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+mul_n4cyc_loop_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	prg.operation.srcs[0].location = DATA_LATCH_REPI;
+	prg.operation.srcs[0].size = SIZE_8_BIT;
+	
+	prg.operation.srcs[1].location = DATA_ZERO;
+	prg.operation.srcs[1].size = SIZE_8_BIT;
+	prg.operation.srcs[1].sign_extend = TRUE;
+	
+	prg.operation.operation = ALU_ADD;
+	prg.operation.src2_add1 = TRUE;
+	prg.operation.src2_negate = TRUE;
+	
+	prg.operation.dest.size = SIZE_8_BIT;
+	prg.operation.dest.location = DATA_LATCH_REPI;
+	
+	prg.operation.latch_aux_mode = LATCH_AUX_ZERO;
+	
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.branch = TRUE;
+	prg.branch_cond = COND_DJNZ;
+	
+	prg.next.entry_idx = MU_MUL_TEST_MULTIPLIER;
+	prg.next.size = spec.size;
+	
+	prg.next_no_branch.entry_idx = (spec.reg_select & 0x8) ? MU_MUL_TEST_FACTOR_A_SIGN : MU_MUL_TEST_PRODUCT_LO;
+	prg.next_no_branch.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+mul_sign_1cyc_test_factor_a_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_ZERO;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_LATCH_FACTOR_A;
+	prg.operation.operation = ALU_OR;
+	
+	prg.operation.dest.location = DATA_ZERO;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.operation.shifter_mode = SHIFTER_LEFT;
+	prg.operation.latch_aux_mode = LATCH_AUX_CARRY;
+	
+	prg.next.entry_idx = MU_MUL_SUB_FACTOR_B;
+	prg.next.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+mul_sign_2cyc_sub_factor_b_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_REG_R0;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_LATCH_FACTOR_B;
+	prg.operation.operation = ALU_ADD;
+	
+	prg.operation.dest.location = DATA_REG_R0;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.operation.src2_negate = TRUE;
+	prg.operation.src2_and_with_aux = TRUE;
+	
+	prg.next.entry_idx = MU_MUL_TEST_FACTOR_B_SIGN;
+	prg.next.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+mul_sign_3cyc_test_factor_b_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_ZERO;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_LATCH_FACTOR_B;
+	prg.operation.operation = ALU_OR;
+	
+	prg.operation.dest.location = DATA_ZERO;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.operation.shifter_mode = SHIFTER_LEFT;
+	prg.operation.latch_aux_mode = LATCH_AUX_CARRY;
+	
+	prg.next.entry_idx = MU_MUL_SUB_FACTOR_A;
+	prg.next.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+mul_sign_4cyc_sub_factor_a_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_REG_R0;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_LATCH_FACTOR_A;
+	prg.operation.operation = ALU_ADD;
+	
+	prg.operation.dest.location = DATA_REG_R0;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.operation.src2_negate = TRUE;
+	prg.operation.src2_and_with_aux = TRUE;
+	
+	prg.next.entry_idx = MU_MUL_TEST_PRODUCT_LO;
+	prg.next.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+mul_end_1cyc_test_product_lo_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_REG_IMM_0_8;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_ZERO;
+	prg.operation.operation = ALU_OR;
+	
+	prg.operation.dest.location = DATA_ZERO;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.next.entry_idx = MU_MUL_TEST_PRODUCT_HI;
+	prg.next.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+mul_end_2cyc_test_product_hi_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_REG_R0;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_ZERO;
+	prg.operation.operation = ALU_OR;
+	
+	prg.operation.dest.location = DATA_ZERO;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.operation.flag_z_mode = FLAG_Z_ACCUM;
+	prg.operation.flag_v_mode = FLAG_V_CLEAR;
+	prg.operation.latch_aux_mode = LATCH_AUX_CLEAR;
+	prg.operation.flag_write_mask = F_OVERFLOW | F_SIGN | F_CARRY | F_ZERO;
+	
+	prg.next.entry_idx = MU_NONE;
+	
+	return prg;
+}
+
+/*
+ * DIVS / DIVU
+ * 
+ * The dividend is R0:r, and the quotient and the remainder end up in r and R0. Restoring division, most
+ * significant bit first: each step shifts R0:r left by one and takes factorB away from R0 if it fits,
+ * setting the quotient bit that has just been freed up at the bottom of r.
+ * 
+ * DIVS divides the magnitudes, negating the dividend and the divisor on the way in, then gives the quotient
+ * and the remainder their signs back (the remainder takes the sign of the dividend). If the quotient
+ * doesn't fit, V is set and r and R0 are left as they are (DIVU) or undefined (DIVS); a zero divisor
+ * branches to the Divide by Zero exception instead.
+ */
+
+static mucode_entry
+div_1cyc_test_factor_b_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	// the core op has latched whether factorB is zero
+	prg.operation.operation = ALU_OFF;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.branch = TRUE;
+	prg.branch_cond = COND_DJNZ;
+	
+	prg.next.entry_idx = (spec.reg_select & 0x8) ? MU_DIV_TEST_DIVIDEND_SIGN : MU_DIV_TEST_DIVIDEND_HI;
+	prg.next.size = spec.size;
+	
+	prg.next_no_branch.entry_idx = MU_BR_DIV_ZERO;
+	prg.next_no_branch.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+div_sign_1cyc_test_dividend_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_ZERO;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_REG_R0;
+	prg.operation.operation = ALU_OR;
+	
+	prg.operation.dest.location = DATA_ZERO;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.operation.shifter_mode = SHIFTER_LEFT;
+	prg.operation.latch_aux_mode = LATCH_AUX_CARRY;
+	
+	prg.branch = TRUE;
+	prg.branch_cond = COND_DJNZ;
+	
+	prg.next.entry_idx = MU_DIV_TEST_FACTOR_B_SIGN;
+	prg.next.size = spec.size;
+	
+	prg.next_no_branch.entry_idx = MU_DIV_NEG_DIVIDEND_TEST_LO;
+	prg.next_no_branch.reg_select = spec.reg_select | 0x1;
+	prg.next_no_branch.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+div_sign_2cyc_neg_dividend_test_lo_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	// r + 0xff...ff carries unless r is zero, in which case R0 is negated on its own
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_REG_IMM_0_8;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_ZERO;
+	prg.operation.operation = ALU_ADD;
+	
+	prg.operation.dest.location = DATA_ZERO;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.operation.src2_add1 = TRUE;
+	prg.operation.src2_negate = TRUE;
+	prg.operation.latch_aux_mode = LATCH_AUX_CARRY;
+	
+	prg.next.entry_idx = MU_DIV_NEG_DIVIDEND_HI;
+	prg.next.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+div_sign_3cyc_neg_dividend_hi_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_ZERO;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_REG_R0;
+	prg.operation.operation = ALU_ADD;
+	
+	prg.operation.dest.location = DATA_REG_R0;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.operation.src2_add_carry = TRUE;
+	prg.operation.src2_negate = TRUE;
+	prg.operation.latch_aux_mode = LATCH_AUX_CARRY;
+	
+	prg.next.entry_idx = MU_DIV_NEG_DIVIDEND_LO;
+	prg.next.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+div_sign_4cyc_neg_dividend_lo_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_ZERO;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_REG_IMM_0_8;
+	prg.operation.operation = ALU_ADD;
+	
+	prg.operation.dest.location = DATA_REG_IMM_0_8;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.operation.src2_negate = TRUE;
+	
+	prg.next.entry_idx = MU_DIV_TEST_FACTOR_B_SIGN;
+	prg.next.size = spec.size;
+	
+	return prg;
+}
+
 static mucode_entry
-mul_1cyc_ld_factor_a_(mucode_entry_spec spec)
+div_sign_5cyc_test_factor_b_ (mucode_entry_spec spec)
 {
 	mucode_entry prg = base_entry_(spec);
 	
 	prg.operation.srcs[0].size = spec.size;
-	prg.operation.srcs[0].location = DATA_REG_IMM_0_8;
-	prg.operation.srcs[1].location = DATA_ZERO;
+	prg.operation.srcs[0].location = DATA_ZERO;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_LATCH_FACTOR_B;
 	prg.operation.operation = ALU_OR;
 	
-	prg.operation.dest.location = DATA_LATCH_FACTOR_A;
+	prg.operation.dest.location = DATA_ZERO;
 	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
 	
-	prg.next.entry_idx = MU_MUL_LD_PRODUCT_LO;
+	prg.operation.shifter_mode = SHIFTER_LEFT;
+	prg.operation.latch_aux_mode = LATCH_AUX_CARRY;
+	
+	prg.branch = TRUE;
+	prg.branch_cond = COND_DJNZ;
+	
+	prg.next.entry_idx = MU_DIV_TEST_DIVIDEND_HI;
 	prg.next.size = spec.size;
 	
+	prg.next_no_branch.entry_idx = MU_DIV_NEG_FACTOR_B;
+	prg.next_no_branch.reg_select = spec.reg_select | 0x2;
+	prg.next_no_branch.size = spec.size;
+	
 	return prg;
 }
 
 static mucode_entry
-mul_2cyc_ld_product_lo_(mucode_entry_spec spec)
+div_sign_6cyc_neg_factor_b_ (mucode_entry_spec spec)
 {
 	mucode_entry prg = base_entry_(spec);
 	
 	prg.operation.srcs[0].size = spec.size;
 	prg.operation.srcs[0].location = DATA_ZERO;
-	prg.operation.srcs[1].location = DATA_ZERO;
-	prg.operation.operation = ALU_OR;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_LATCH_FACTOR_B;
+	prg.operation.operation = ALU_ADD;
 	
-	prg.operation.dest.location = DATA_REG_IMM_0_8;
+	prg.operation.dest.location = DATA_LATCH_FACTOR_B;
 	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
 	
-	prg.next.entry_idx = MU_MUL_LD_PRODUCT_HI;
+	prg.operation.src2_negate = TRUE;
+	
+	prg.next.entry_idx = MU_DIV_TEST_DIVIDEND_HI;
 	prg.next.size = spec.size;
 	
 	return prg;
 }
 
 static mucode_entry
-mul_3cyc_ld_product_hi_(mucode_entry_spec spec)
+div_2cyc_test_dividend_hi_ (mucode_entry_spec spec)
 {
 	mucode_entry prg = base_entry_(spec);
 	
+	// factorB - (R0 + 1) borrows if R0 >= factorB
 	prg.operation.srcs[0].size = spec.size;
-	prg.operation.srcs[0].location = DATA_ZERO;
-	prg.operation.srcs[1].location = DATA_ZERO;
-	prg.operation.operation = ALU_OR;
+	prg.operation.srcs[0].location = DATA_LATCH_FACTOR_B;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_REG_R0;
+	prg.operation.operation = ALU_ADD;
 	
-	prg.operation.dest.location = DATA_REG_R0;
+	prg.operation.dest.location = DATA_ZERO;
 	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
 	
-	prg.next.entry_idx = MU_MUL_LD_REPI;
+	prg.operation.src2_add1 = TRUE;
+	prg.operation.src2_negate = TRUE;
+	prg.operation.invert_carries = TRUE;
+	prg.operation.latch_aux_mode = LATCH_AUX_CARRY;
+	
+	prg.branch = TRUE;
+	prg.branch_cond = COND_DJNZ;
+	
+	prg.next.entry_idx = MU_DIV_LD_REPI;
 	prg.next.size = spec.size;
 	
+	prg.next_no_branch.entry_idx = MU_DIV_OVERFLOW;
+	prg.next_no_branch.size = spec.size;
+	
 	return prg;
 }
 
 static mucode_entry
-mul_4cyc_ld_repi_(mucode_entry_spec spec)
+div_3cyc_ld_repi_ (mucode_entry_spec spec)
 {
 	mucode_entry prg = base_entry_(spec);
 	
@@ -455,13 +976,14 @@ mul_4cyc_ld_repi_(mucode_entry_spec spec)
 	
 	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
 	
-	prg.next.entry_idx = MU_MUL_SHIFT_PRODUCT_LO_LEFT;
+	prg.next.entry_idx = MU_DIV_SHIFT_DIVIDEND_LO_LEFT;
+	prg.next.size = spec.size;
 	
 	return prg;
 }
 
 static mucode_entry
-mul_ncyc_shift_product_lo_left_ (mucode_entry_spec spec)
+div_ncyc_shift_dividend_lo_left_ (mucode_entry_spec spec)
 {
 	mucode_entry prg = base_entry_(spec);
 	
@@ -471,22 +993,20 @@ mul_ncyc_shift_product_lo_left_ (mucode_entry_spec spec)
 	prg.operation.srcs[1].location = DATA_REG_IMM_0_8;
 	prg.operation.operation = ALU_OR;
 	
-	prg.operation.dest.size = spec.size;
 	prg.operation.dest.location = DATA_REG_IMM_0_8;
-	
 	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
 	
 	prg.operation.shifter_mode = SHIFTER_LEFT;
 	prg.operation.latch_aux_mode = LATCH_AUX_CARRY;
 	
-	prg.next.entry_idx = MU_MUL_SHIFT_PRODUCT_HI_LEFT;
+	prg.next.entry_idx = MU_DIV_SHIFT_DIVIDEND_HI_LEFT;
 	prg.next.size = spec.size;
 	
 	return prg;
 }
 
 static mucode_entry
-mul_n1cyc_shift_product_hi_left_ (mucode_entry_spec spec)
+div_n1cyc_shift_dividend_hi_left_ (mucode_entry_spec spec)
 {
 	mucode_entry prg = base_entry_(spec);
 	
@@ -496,140 +1016,246 @@ mul_n1cyc_shift_product_hi_left_ (mucode_entry_spec spec)
 	prg.operation.srcs[1].location = DATA_REG_R0;
 	prg.operation.operation = ALU_OR;
 	
-	prg.operation.dest.size = spec.size;
 	prg.operation.dest.location = DATA_REG_R0;
-	
 	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
 	
 	prg.operation.shifter_mode = SHIFTER_LEFT_CARRY;
+	prg.operation.invert_carries = TRUE;
 	prg.operation.latch_aux_mode = LATCH_AUX_CARRY;
 	
-	prg.next.entry_idx = MU_MUL_SHIFT_FACTOR_B_LEFT;
+	prg.next.entry_idx = MU_DIV_SUB_FACTOR_B;
 	prg.next.size = spec.size;
 	
 	return prg;
 }
 
 static mucode_entry
-mul_n2cyc_shift_factor_b_left_ (mucode_entry_spec spec)
+div_n2cyc_sub_factor_b_ (mucode_entry_spec spec)
 {
 	mucode_entry prg = base_entry_(spec);
 	
+	// as in div_2cyc_test_dividend_hi_(); if a bit was shifted out of R0 (aux is clear), factorB always fits
 	prg.operation.srcs[0].size = spec.size;
-	prg.operation.srcs[0].location = DATA_ZERO;
+	prg.operation.srcs[0].location = DATA_LATCH_FACTOR_B;
 	prg.operation.srcs[1].size = spec.size;
-	prg.operation.srcs[1].location = DATA_LATCH_FACTOR_B;
-	prg.operation.operation = ALU_OR;
-	
-	prg.operation.dest.size = spec.size;
-	prg.operation.dest.location = DATA_LATCH_FACTOR_B;
+	prg.operation.srcs[1].location = DATA_REG_R0;
+	prg.operation.operation = ALU_ADD;
 	
+	prg.operation.dest.location = DATA_ZERO;
 	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
 	
-	prg.operation.shifter_mode = SHIFTER_LEFT;
+	prg.operation.src2_add1 = TRUE;
+	prg.operation.src2_negate = TRUE;
+	prg.operation.src2_and_with_aux = TRUE;
+	prg.operation.invert_carries = TRUE;
 	prg.operation.latch_aux_mode = LATCH_AUX_CARRY;
 	
-	prg.next.entry_idx = MU_MUL_ADD_PRODUCT_LO;
+	prg.next.entry_idx = MU_DIV_ADD_DIVIDEND_LO_CARRY;
 	prg.next.size = spec.size;
 	
 	return prg;
 }
 
 static mucode_entry
-mul_n3cyc_add_product_lo_ (mucode_entry_spec spec)
+div_n3cyc_add_dividend_lo_carry_ (mucode_entry_spec spec)
 {
 	mucode_entry prg = base_entry_(spec);
 	
 	prg.operation.srcs[0].size = spec.size;
 	prg.operation.srcs[0].location = DATA_REG_IMM_0_8;
-	prg.operation.srcs[1].location = DATA_LATCH_FACTOR_A;
-	prg.operation.srcs[1].sign_extend = (spec.reg_select & 0x8) != 0;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_ZERO;
 	prg.operation.operation = ALU_ADD;
 	
 	prg.operation.dest.location = DATA_REG_IMM_0_8;
 	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
 	
-	prg.operation.shifter_mode = SHIFTER_NONE;
-	prg.operation.src2_negate = (spec.reg_select & 0x10) != 0;
+	prg.operation.src2_add1 = TRUE;
 	prg.operation.src2_and_with_aux = TRUE;
 	
-	prg.operation.invert_carries = (spec.reg_select & 0x10) != 0;
-	prg.operation.flag_write_mask = F_ZERO | F_CARRY;
-	
-	prg.next.entry_idx = MU_MUL_ADD_PRODUCT_HI;
+	prg.next.entry_idx = MU_DIV_ST_DIVIDEND_HI;
 	prg.next.size = spec.size;
 	
 	return prg;
 }
 
 static mucode_entry
-mul_n4cyc_add_product_hi_ (mucode_entry_spec spec)
+div_n4cyc_st_dividend_hi_ (mucode_entry_spec spec)
 {
 	mucode_entry prg = base_entry_(spec);
 	
 	prg.operation.srcs[0].size = spec.size;
 	prg.operation.srcs[0].location = DATA_REG_R0;
-	prg.operation.srcs[1].location = DATA_LATCH_CARRY;
-	prg.operation.srcs[1].sign_extend = (spec.reg_select & 0x8) != 0;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_LATCH_FACTOR_B;
 	prg.operation.operation = ALU_ADD;
 	
-	prg.operation.dest.size = spec.size;
 	prg.operation.dest.location = DATA_REG_R0;
 	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
 	
-	prg.operation.shifter_mode = SHIFTER_NONE;
-	prg.operation.src2_add1 = (spec.reg_select & 0x8) != 0;
-	prg.operation.src2_negate = (spec.reg_select & 0x10) == 0;
+	prg.operation.src2_negate = TRUE;
 	prg.operation.src2_and_with_aux = TRUE;
 	
-	prg.operation.invert_carries = (spec.reg_select & 0x10) != 0;
-	prg.operation.flag_z_mode = FLAG_Z_ACCUM;
-	prg.operation.flag_v_mode = FLAG_V_CLEAR;
-	prg.operation.latch_aux_mode = LATCH_AUX_CLEAR;
+	prg.next.entry_idx = MU_DIV_LOOP;
+	prg.next.size = spec.size;
 	
-	prg.operation.flag_write_mask = F_OVERFLOW | F_SIGN | F_CARRY | F_ZERO;
+	return prg;
+}
+
+static mucode_entry
+div_n5cyc_loop_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = mul_n4cyc_loop_(spec);
 	
-	prg.next.entry_idx = MU_MUL_LOOP;
-	prg.next.size = spec.size;
+	prg.next.entry_idx = MU_DIV_SHIFT_DIVIDEND_LO_LEFT;
+	
+	// DIVS checks that the quotient fits in the signed range
+	if (!(spec.reg_select & 0x8))
+	{
+		prg.next_no_branch.entry_idx = MU_DIV_TEST_QUOTIENT;
+	}
+	else if (((spec.reg_select >> 1) ^ spec.reg_select) & 0x1)
+	{
+		prg.next_no_branch.entry_idx = MU_DIV_NEG_QUOTIENT;
+	}
+	else
+	{
+		prg.next_no_branch.entry_idx = MU_DIV_TEST_QUOTIENT_SIGN;
+	}
 	
 	return prg;
 }
 
 static mucode_entry
-mul_n5cyc_loop_ (mucode_entry_spec spec)
+div_end_1cyc_test_quotient_sign_ (mucode_entry_spec spec)
 {
 	mucode_entry prg = base_entry_(spec);
-	prg.operation.srcs[0].location = DATA_LATCH_REPI;
-	prg.operation.srcs[0].size = SIZE_8_BIT;
 	
-	prg.operation.srcs[1].location = DATA_ZERO;
-	prg.operation.srcs[1].size = SIZE_8_BIT;
-	prg.operation.srcs[1].sign_extend = TRUE;
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_ZERO;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_REG_IMM_0_8;
+	prg.operation.operation = ALU_OR;
+	
+	prg.operation.dest.location = DATA_ZERO;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.operation.shifter_mode = SHIFTER_LEFT;
+	prg.operation.latch_aux_mode = LATCH_AUX_CARRY;
+	
+	prg.branch = TRUE;
+	prg.branch_cond = COND_DJNZ;
+	
+	prg.next.entry_idx = (spec.reg_select & 0x1) ? MU_DIV_NEG_REMAINDER : MU_DIV_TEST_QUOTIENT;
+	prg.next.size = spec.size;
+	
+	prg.next_no_branch.entry_idx = MU_DIV_OVERFLOW;
+	prg.next_no_branch.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+div_end_1cyc_neg_quotient_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
 	
+	// the quotient is allowed to come out as zero or negative; V is cleared, so GT is Z and S both clear
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_ZERO;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_REG_IMM_0_8;
 	prg.operation.operation = ALU_ADD;
-	prg.operation.src2_add1 = TRUE;
+	
+	prg.operation.dest.location = DATA_REG_IMM_0_8;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
 	prg.operation.src2_negate = TRUE;
+	prg.operation.flag_v_mode = FLAG_V_CLEAR;
+	prg.operation.flag_write_mask = F_OVERFLOW | F_SIGN | F_CARRY | F_ZERO;
 	
-	prg.operation.dest.size = SIZE_8_BIT;
-	prg.operation.dest.location = DATA_LATCH_REPI;
+	prg.branch = TRUE;
+	prg.branch_cond = COND_GT;
 	
-	prg.operation.latch_aux_mode = LATCH_AUX_ZERO;
+	prg.next.entry_idx = MU_DIV_OVERFLOW;
+	prg.next.size = spec.size;
 	
+	prg.next_no_branch.entry_idx = (spec.reg_select & 0x1) ? MU_DIV_NEG_REMAINDER : MU_DIV_TEST_QUOTIENT;
+	prg.next_no_branch.size = spec.size;
+	
+	return prg;
+}
+
+static mucode_entry
+div_end_2cyc_neg_remainder_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_ZERO;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_REG_R0;
+	prg.operation.operation = ALU_ADD;
+	
+	prg.operation.dest.location = DATA_REG_R0;
 	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
 	
-	prg.branch = TRUE;
-	prg.branch_cond = COND_DJNZ;
+	prg.operation.src2_negate = TRUE;
 	
-	prg.next.entry_idx = MU_MUL_SHIFT_PRODUCT_LO_LEFT;
-	prg.next.reg_select = spec.reg_select & 0xf;
+	prg.next.entry_idx = MU_DIV_TEST_QUOTIENT;
 	prg.next.size = spec.size;
 	
-	prg.next_no_branch.entry_idx = MU_NONE;
+	return prg;
+}
+
+static mucode_entry
+div_end_3cyc_test_quotient_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_REG_IMM_0_8;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_ZERO;
+	prg.operation.operation = ALU_OR;
+	
+	prg.operation.dest.location = DATA_ZERO;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.operation.flag_v_mode = FLAG_V_CLEAR;
+	prg.operation.latch_aux_mode = LATCH_AUX_CLEAR;
+	prg.operation.flag_write_mask = F_OVERFLOW | F_SIGN | F_CARRY | F_ZERO;
+	
+	prg.next.entry_idx = MU_NONE;
 	
 	return prg;
 }
 
-// todo: DIV microcode
+static mucode_entry
+div_end_overflow_ (mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	// shifting zero with the carries inverted is what sets V
+	prg.operation.srcs[0].size = spec.size;
+	prg.operation.srcs[0].location = DATA_ZERO;
+	prg.operation.srcs[1].size = spec.size;
+	prg.operation.srcs[1].location = DATA_ZERO;
+	prg.operation.operation = ALU_OR;
+	
+	prg.operation.dest.location = DATA_ZERO;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.operation.shifter_mode = SHIFTER_LEFT;
+	prg.operation.invert_carries = TRUE;
+	prg.operation.flag_v_mode = FLAG_V_SHIFTER_CARRY;
+	prg.operation.latch_aux_mode = LATCH_AUX_CLEAR;
+	prg.operation.flag_write_mask = F_OVERFLOW;
+	
+	prg.next.entry_idx = MU_NONE;
+	
+	return prg;
+}
 
 static mucode_entry
 push_pgc_1cyc_ind_sp_auto_(mucode_entry_spec spec)
@@ -792,89 +1418,207 @@ br_hml_2cyc_add_pgc_(mucode_entry_spec spec)
 	return prg;
 }
 
+static mucode_entry
+br_div_zero_(mucode_entry_spec spec)
+{
+	mucode_entry prg = base_entry_(spec);
+	
+	prg.operation.srcs[0].size = SIZE_24_BIT;
+	prg.operation.srcs[0].location = DATA_VEC_DIV_ZERO;
+	prg.operation.srcs[1].size = SIZE_24_BIT;
+	prg.operation.srcs[1].location = DATA_ZERO;
+	prg.operation.dest.location = DATA_REG_PGC;
+	prg.operation.dest.size = SIZE_24_BIT;
+	prg.operation.operation = ALU_OR;
+	
+	prg.operation.latch_aux_mode = LATCH_AUX_CLEAR;
+	prg.operation.mem_latch_ctl = MEM_NO_LATCH;
+	
+	prg.next.entry_idx = MU_NONE;
+	
+	return prg;
+}
+
+typedef mucode_entry (*mucode_builder_) (mucode_entry_spec spec);
+
+static const mucode_builder_ mucode_builders_[MU_NUM_ENTRIES] =
+{
+	[MU_IND_IMM] = ind_1cyc_imm_,
+	[MU_IND_IMM_RM] = ind_1cyc_imm_rm_,
+	[MU_IND_REG] = ind_1cyc_reg_,
+	[MU_IND_REG_POST_AUTO] = ind_1cyc_reg_post_auto_,
+	[MU_IND_REG_AUTO] = ind_1cyc_reg_auto_,
+	[MU_IND_REG_WITH_IMM] = ind_2cyc_withimm_,
+	[MU_IND_IMM0] = ind_1cyc_imm0_,
+	[MU_IND_IMM_WITH_BITS] = ind_2cyc_imm_withbits_,
+	[MU_IND_REG_WITH_BITS] = ind_2cyc_reg_withbits_,
+	[MU_IND_PGC_WITH_IMM] = ind_2cyc_pgc_withimm_,
+	[MU_IND_PGC_WITH_IMM_RM] = ind_2cyc_pgc_withimm_rm_,
+	[MU_IND_DJNZ] = ind_1cyc_djnz_,
+	[MU_IND_MAR_AUTO] = ind_2cyc_mar_auto_,
+	[MU_IND_MAR_POST_AUTO] = ind_2cyc_mar_post_auto_,
+	[MU_POST_AUTOIDX] = after_autoidx_,
+	[MU_REPI] = repi_,
+	[MU_REPR] = repr_,
+	[MU_ADJUST_PGC] = adjust_pgc_,
+	[MU_MUL_LD_FACTOR_A] = mul_1cyc_ld_factor_a_,
+	[MU_MUL_LD_PRODUCT_LO] = mul_2cyc_ld_product_lo_,
+	[MU_MUL_LD_PRODUCT_HI] = mul_3cyc_ld_product_hi_,
+	[MU_MUL_LD_REPI] = mul_4cyc_ld_repi_,
+	[MU_MUL_TEST_MULTIPLIER] = mul_ncyc_test_multiplier_,
+	[MU_MUL_ADD_PRODUCT_HI] = mul_n1cyc_add_product_hi_,
+	[MU_MUL_SHIFT_PRODUCT_HI_RIGHT] = mul_n2cyc_shift_product_hi_right_,
+	[MU_MUL_SHIFT_PRODUCT_LO_RIGHT] = mul_n3cyc_shift_product_lo_right_,
+	[MU_MUL_LOOP] = mul_n4cyc_loop_,
+	[MU_MUL_TEST_FACTOR_A_SIGN] = mul_sign_1cyc_test_factor_a_,
+	[MU_MUL_SUB_FACTOR_B] = mul_sign_2cyc_sub_factor_b_,
+	[MU_MUL_TEST_FACTOR_B_SIGN] = mul_sign_3cyc_test_factor_b_,
+	[MU_MUL_SUB_FACTOR_A] = mul_sign_4cyc_sub_factor_a_,
+	[MU_MUL_TEST_PRODUCT_LO] = mul_end_1cyc_test_product_lo_,
+	[MU_MUL_TEST_PRODUCT_HI] = mul_end_2cyc_test_product_hi_,
+	
+	[MU_DIV_TEST_FACTOR_B] = div_1cyc_test_factor_b_,
+	[MU_DIV_TEST_DIVIDEND_SIGN] = div_sign_1cyc_test_dividend_,
+	[MU_DIV_NEG_DIVIDEND_TEST_LO] = div_sign_2cyc_neg_dividend_test_lo_,
+	[MU_DIV_NEG_DIVIDEND_HI] = div_sign_3cyc_neg_dividend_hi_,
+	[MU_DIV_NEG_DIVIDEND_LO] = div_sign_4cyc_neg_dividend_lo_,
+	[MU_DIV_TEST_FACTOR_B_SIGN] = div_sign_5cyc_test_factor_b_,
+	[MU_DIV_NEG_FACTOR_B] = div_sign_6cyc_neg_factor_b_,
+	[MU_DIV_TEST_DIVIDEND_HI] = div_2cyc_test_dividend_hi_,
+	[MU_DIV_LD_REPI] = div_3cyc_ld_repi_,
+	[MU_DIV_SHIFT_DIVIDEND_LO_LEFT] = div_ncyc_shift_dividend_lo_left_,
+	[MU_DIV_SHIFT_DIVIDEND_HI_LEFT] = div_n1cyc_shift_dividend_hi_left_,
+	[MU_DIV_SUB_FACTOR_B] = div_n2cyc_sub_factor_b_,
+	[MU_DIV_ADD_DIVIDEND_LO_CARRY] = div_n3cyc_add_dividend_lo_carry_,
+	[MU_DIV_ST_DIVIDEND_HI] = div_n4cyc_st_dividend_hi_,
+	[MU_DIV_LOOP] = div_n5cyc_loop_,
+	[MU_DIV_TEST_QUOTIENT_SIGN] = div_end_1cyc_test_quotient_sign_,
+	[MU_DIV_NEG_QUOTIENT] = div_end_1cyc_neg_quotient_,
+	[MU_DIV_NEG_REMAINDER] = div_end_2cyc_neg_remainder_,
+	[MU_DIV_TEST_QUOTIENT] = div_end_3cyc_test_quotient_,
+	[MU_DIV_OVERFLOW] = div_end_overflow_,
+	
+	[MU_PUSH_PGC_IND_SP_AUTO] = push_pgc_1cyc_ind_sp_auto_,
+	[MU_PUSH_PGC_WR_PGC] = push_pgc_2cyc_wr_pgc_,
+	[MU_PUSH_WF_IND_SP_AUTO] = push_wf_1cyc_ind_sp_auto_,
+	[MU_PUSH_WF_WR_WF] = push_wf_2cyc_wr_wf_,
+	[MU_BR_MAR_COND] = br_mar_cond_,
+	[MU_BR_MAR] = br_mar_,
+	[MU_BR_HML_TEST_HML] = br_hml_1cyc_test_hml_,
+	[MU_BR_HML_ADD_PGC] = br_hml_2cyc_add_pgc_,
+	[MU_BR_DIV_ZERO] = br_div_zero_
+};
+
 mucode_entry
 decode_mucode_entry (mucode_entry_spec spec)
 {
-	mucode_entry result;
-	switch (spec.entry_idx)
+	if (spec.entry_idx >= MU_NUM_ENTRIES || !mucode_builders_[spec.entry_idx])
+	{
+		decode_unreachable_();
+	}
+	
+	return mucode_builders_[spec.entry_idx](spec);
+}
+
+/*
+ * Microcode ROM
+ * 
+ * Every entry the sequencer can reach is built once by mucode_rom_init() and then looked up by its packed
+ * mucode_entry_spec. Only the low 5 bits of reg_select are ever decoded by the entry builders, so the key is:
+ * entry_idx (MU_NUM_ENTRIES) x reg_select (32) x size (3) x is_write (2) x mem_access_suppress (2)
+ * 
+ * The ROM is the only state shared between machines. It's filled exactly once, however many threads
+ * initialize machines at the same time, and is read-only from then on.
+ */
+#define MUCODE_ROM_REG_SELECTS	32
+#define MUCODE_ROM_SIZES	3
+#define MUCODE_ROM_ENTRIES	(MU_NUM_ENTRIES * MUCODE_ROM_REG_SELECTS * MUCODE_ROM_SIZES * 4)
+
+#define MUCODE_ROM_INDEX_(entry_idx, reg_select, size, is_write, mem_access_suppress) \
+	(((((entry_idx) * MUCODE_ROM_REG_SELECTS + ((reg_select) & 0x1f)) * MUCODE_ROM_SIZES + (size)) << 2) \
+	| (((is_write) != 0) << 1) | ((mem_access_suppress) != 0))
+
+static mucode_entry mucode_rom_[MUCODE_ROM_ENTRIES];
+static pthread_once_t mucode_rom_once_ = PTHREAD_ONCE_INIT;
+
+static void
+mucode_rom_fill_ (void)
+{
+	for (int idx = 0; idx < MU_NUM_ENTRIES; idx++)
+	{
+		for (int reg_select = 0; reg_select < MUCODE_ROM_REG_SELECTS; reg_select++)
+		{
+			for (int size = 0; size < MUCODE_ROM_SIZES; size++)
+			{
+				for (int flags = 0; flags < 4; flags++)
+				{
+					mucode_entry_spec spec =
+					{
+						idx,
+						reg_select,
+						size,
+						(flags & 2) != 0,
+						(flags & 1) != 0
+					};
+					
+					// unimplemented entry points are left as no-ops; mucode_rom_lookup() never returns them
+					mucode_entry *entry = &mucode_rom_[MUCODE_ROM_INDEX_(idx, reg_select, size, spec.is_write, spec.mem_access_suppress)];
+					*entry = mucode_builders_[idx] ? mucode_builders_[idx](spec) : base_entry_(spec);
+					
+					// the high half of a 24-bit access is the MAR step chained on by base_entry_(); if it
+					// goes the same way as this one, both halves go out as one bus transaction
+					entry->operation.is_24bit = (entry->next.entry_idx == MU_IND_MAR_AUTO || entry->next.entry_idx == MU_IND_MAR_POST_AUTO)
+						&& (entry->operation.mem_write_ctl != MEM_READ) == spec.is_write;
+					pilot_execute_compile_control(&entry->operation);
+				}
+			}
+		}
+	}
+	
+}
+
+void
+mucode_rom_init (void)
+{
+	pthread_once(&mucode_rom_once_, mucode_rom_fill_);
+}
+
+const mucode_entry *
+mucode_rom_lookup (mucode_entry_spec spec)
+{
+	// reg_select is masked down to the bits the ROM decodes, but anything else out of range has no entry
+	if (spec.entry_idx >= MU_NUM_ENTRIES || spec.size >= MUCODE_ROM_SIZES || !mucode_builders_[spec.entry_idx])
 	{
-		case MU_IND_IMM:
-			return result = ind_1cyc_imm_(spec);
-		case MU_IND_IMM_RM:
-			return result = ind_1cyc_imm_rm_(spec);
-		case MU_IND_REG:
-			return result = ind_1cyc_reg_(spec);
-		case MU_IND_REG_POST_AUTO:
-			return result = ind_1cyc_reg_post_auto_(spec);
-		case MU_IND_REG_AUTO:
-			return result = ind_1cyc_reg_auto_(spec);
-		case MU_IND_REG_WITH_IMM:
-			return result = ind_2cyc_withimm_(spec);
-		case MU_IND_IMM0:
-			return result = ind_1cyc_imm0_(spec);
-		case MU_IND_IMM_WITH_BITS:
-			return result = ind_2cyc_imm_withbits_(spec);
-		case MU_IND_REG_WITH_BITS:
-			return result = ind_2cyc_reg_withbits_(spec);
-		case MU_IND_PGC_WITH_IMM:
-			return result = ind_2cyc_pgc_withimm_(spec);
-		case MU_IND_PGC_WITH_IMM_RM:
-			return result = ind_2cyc_pgc_withimm_rm_(spec);
-		case MU_IND_DJNZ:
-			return result = ind_1cyc_djnz_(spec);
-		case MU_IND_MAR_AUTO:
-			return result = ind_2cyc_mar_auto_(spec);
-		case MU_IND_MAR_POST_AUTO:
-			return result = ind_2cyc_mar_post_auto_(spec);
-		case MU_POST_AUTOIDX:
-			return result = after_autoidx_(spec);
-		case MU_REPI:
-			return result = repi_(spec);
-		case MU_REPR:
-			return result = repr_(spec);
-		case MU_ADJUST_PGC:
-			return result = adjust_pgc_(spec);
-		case MU_MUL_LD_FACTOR_A:
-			return result = mul_1cyc_ld_factor_a_(spec);
-		case MU_MUL_LD_PRODUCT_LO:
-			return result = mul_2cyc_ld_product_lo_(spec);
-		case MU_MUL_LD_PRODUCT_HI:
-			return result = mul_3cyc_ld_product_hi_(spec);
-		case MU_MUL_LD_REPI:
-			return result = mul_4cyc_ld_repi_(spec);
-		case MU_MUL_SHIFT_PRODUCT_LO_LEFT:
-			return result = mul_ncyc_shift_product_lo_left_(spec);
-		case MU_MUL_SHIFT_PRODUCT_HI_LEFT:
-			return result = mul_n1cyc_shift_product_hi_left_(spec);
-		case MU_MUL_SHIFT_FACTOR_B_LEFT:
-			return result = mul_n2cyc_shift_factor_b_left_(spec);
-		case MU_MUL_ADD_PRODUCT_LO:
-			return result = mul_n3cyc_add_product_lo_(spec);
-		case MU_MUL_ADD_PRODUCT_HI:
-			return result = mul_n4cyc_add_product_hi_(spec);
-		case MU_MUL_LOOP:
-			return result = mul_n5cyc_loop_(spec);
-		
-		// DIVU / DIVS microcode would be here
-		
-		case MU_PUSH_PGC_IND_SP_AUTO:
-			return result = push_pgc_1cyc_ind_sp_auto_(spec);
-		case MU_PUSH_PGC_WR_PGC:
-			return result = push_pgc_2cyc_wr_pgc_(spec);
-		case MU_PUSH_WF_IND_SP_AUTO:
-			return result = push_wf_1cyc_ind_sp_auto_(spec);
-		case MU_PUSH_WF_WR_WF:
-			return result = push_wf_2cyc_wr_wf_(spec);
-		case MU_BR_MAR_COND:
-			return result = br_mar_cond_(spec);
-		case MU_BR_MAR:
-			return result = br_mar_(spec);
-		case MU_BR_HML_TEST_HML:
-			return result = br_hml_1cyc_test_hml_(spec);
-		case MU_BR_HML_ADD_PGC:
-			return result = br_hml_2cyc_add_pgc_(spec);
-		default:
-			decode_unreachable_();
-			return base_entry_(spec);
+		decode_unreachable_();
 	}
+	
+	return &mucode_rom_[MUCODE_ROM_INDEX_(spec.entry_idx, spec.reg_select, spec.size, spec.is_write, spec.mem_access_suppress)];
+}
+
+uint32_t
+mucode_rom_index (const mucode_entry *entry)
+{
+	return entry - mucode_rom_;
+}
+
+mucode_entry_spec
+mucode_rom_spec (const mucode_entry *entry)
+{
+	uint32_t index = mucode_rom_index(entry);
+	mucode_entry_spec spec =
+	{
+		index / (MUCODE_ROM_REG_SELECTS * MUCODE_ROM_SIZES * 4),
+		(index / (MUCODE_ROM_SIZES * 4)) % MUCODE_ROM_REG_SELECTS,
+		(index / 4) % MUCODE_ROM_SIZES,
+		(index & 2) != 0,
+		(index & 1) != 0
+	};
+	
+	return spec;
+}
+
+const mucode_entry *
+mucode_rom_entry (uint32_t index)
+{
+	return (index < MUCODE_ROM_ENTRIES) ? &mucode_rom_[index] : NULL;
 }
@@ -3,6 +3,20 @@
 
 #include "types.h"
 
+// Builds a microcode entry from scratch (used to fill the microcode ROM)
 mucode_entry decode_mucode_entry (mucode_entry_spec spec);
 
+// Fills the microcode ROM; must be called once before the execute stage is clocked
+void mucode_rom_init (void);
+
+// Returns the prebuilt microcode entry for a spec
+const mucode_entry *mucode_rom_lookup (mucode_entry_spec spec);
+
+// Position of an entry in the microcode ROM, so that it can be referred to without a pointer (save states)
+uint32_t mucode_rom_index (const mucode_entry *entry);
+// The spec an entry was looked up with (reg_select only keeps the bits the ROM decodes)
+mucode_entry_spec mucode_rom_spec (const mucode_entry *entry);
+// Returns NULL if index is out of range
+const mucode_entry *mucode_rom_entry (uint32_t index);
+
 #endif
@@ -3,8 +3,28 @@
 
 #include "types.h"
 
+/*
+ * The general purpose registers can be accessed by the byte and by the word as well as whole, each part with
+ * a single load or store: Ln, Mn and Wn are reg_bytes[PILOT_REG_L(n)], reg_bytes[PILOT_REG_M(n)] and
+ * reg_words[PILOT_REG_W(n)]. Registers are 24 bits wide, so the top byte of each of regs[] is always zero.
+ */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define PILOT_REG_L(n)	(4 * (n) + 3)
+#define PILOT_REG_M(n)	(4 * (n) + 2)
+#define PILOT_REG_W(n)	(2 * (n) + 1)
+#else
+#define PILOT_REG_L(n)	(4 * (n))
+#define PILOT_REG_M(n)	(4 * (n) + 1)
+#define PILOT_REG_W(n)	(2 * (n))
+#endif
+
 typedef struct {
-	uint32_t regs[8];
+	union
+	{
+		uint32_t regs[8];
+		uint16_t reg_words[16];
+		uint8_t reg_bytes[32];
+	};
 	uint16_t wf;
 	
 	// Program counter
@@ -25,7 +45,7 @@ typedef struct {
 	bool disable_clk;
 } Pilot_cpu_regs;
 
-const enum
+typedef enum
 {
 	// Extend carry/borrow flag
 	F_EXTEND   = 1 << 0,
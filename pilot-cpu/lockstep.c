@@ -0,0 +1,72 @@
+#include "lockstep.h"
+#include <string.h>
+
+bool
+Pilot_lockstep_init (Pilot_lockstep *ls, Pilot_cpu **lanes, int num_lanes)
+{
+	if (num_lanes < 0 || num_lanes > PILOT_LOCKSTEP_MAX_LANES)
+	{
+		return FALSE;
+	}
+	
+	memset(ls, 0, sizeof(*ls));
+	memcpy(ls->lanes, lanes, num_lanes * sizeof(lanes[0]));
+	ls->num_lanes = num_lanes;
+	return TRUE;
+}
+
+// Finds another lane whose last decoded instruction is the one this lane needs next
+static const Pilot_cpu *
+lockstep_leader_ (Pilot_lockstep *ls, int lane)
+{
+	const Pilot_cpu *cpu = ls->lanes[lane];
+	
+	if (cpu->exec_mode != PILOT_EXEC_FAST || cpu->sys.interconnects.decoded_inst_semaph)
+	{
+		return NULL;
+	}
+	
+	for (int i = 0; i < ls->num_lanes; i++)
+	{
+		const inst_decoded_flags *inst = ls->lanes[i]->sys.interconnects.decoded_inst;
+		if (i != lane && inst && inst->inst_pgc == cpu->fast_pgc)
+		{
+			return ls->lanes[i];
+		}
+	}
+	
+	return NULL;
+}
+
+void
+Pilot_lockstep_run (Pilot_lockstep *ls, uint64_t num_cycles)
+{
+	uint64_t end[PILOT_LOCKSTEP_MAX_LANES];
+	bool running = TRUE;
+	
+	for (int i = 0; i < ls->num_lanes; i++)
+	{
+		uint64_t cycles = ls->lanes[i]->sys.cycles;
+		end[i] = (num_cycles < UINT64_MAX - cycles) ? cycles + num_cycles : UINT64_MAX;
+	}
+	
+	while (running)
+	{
+		running = FALSE;
+		for (int i = 0; i < ls->num_lanes; i++)
+		{
+			Pilot_cpu *cpu = ls->lanes[i];
+			
+			if (cpu->sys.cycles < end[i])
+			{
+				Pilot_cpu_step(cpu, lockstep_leader_(ls, i), end[i] - cpu->sys.cycles);
+				running = TRUE;
+			}
+		}
+	}
+	
+	for (int i = 0; i < ls->num_lanes; i++)
+	{
+		pilot_execute_flags_sync(&ls->lanes[i]->execute);
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef __LOCKSTEP_H__
+#define __LOCKSTEP_H__
+
+#include <stdint.h>
+#include "types.h"
+#include "cpu.h"
+
+#define PILOT_LOCKSTEP_MAX_LANES	16
+
+// A group of machines (lanes) run side by side, typically the same ROM with different inputs.
+// Lanes take turns one step at a time, and a lane in fast mode that's about to run the instruction
+// another lane last decoded from the same host memory copies it instead of decoding it again.
+// Lanes that have diverged simply run on their own. Each lane keeps its own Pilot_cpu and runs its own
+// ALU; there's no struct-of-arrays register file and no vector execution across lanes.
+typedef struct
+{
+	Pilot_cpu *lanes[PILOT_LOCKSTEP_MAX_LANES];
+	int num_lanes;
+} Pilot_lockstep;
+
+// Returns FALSE if num_lanes is negative or more than PILOT_LOCKSTEP_MAX_LANES
+bool Pilot_lockstep_init (Pilot_lockstep *ls, Pilot_cpu **lanes, int num_lanes);
+
+// Runs every lane for num_cycles cycles, then brings each lane's F up to date as Pilot_run_cycles does
+void Pilot_lockstep_run (Pilot_lockstep *ls, uint64_t num_cycles);
+
+#endif
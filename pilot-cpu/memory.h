@@ -5,11 +5,41 @@
 #include <stddef.h>
 #include "pilot.h"
 
+// Sets up the default memory map; must be called before the memory controller is clocked
+void Pilot_mem_map_init (Pilot_system *sys);
+// Maps [start, end] directly onto host memory (start must be page aligned; the last page may be partial)
+void Pilot_mem_map_direct (Pilot_system *sys, uint32_t start, uint32_t end, uint8_t *mem, bool writable);
+// Hands [start, end] back to its region's handler (start and end + 1 must be page aligned)
+void Pilot_mem_map_unmap (Pilot_system *sys, uint32_t start, uint32_t end);
+void Pilot_mem_set_handler (Pilot_system *sys, Pilot_mem_region region, Pilot_mem_read_handler read, Pilot_mem_write_handler write, void *ctx);
+// Every direct write marks its page dirty and lists it in mem_map.dirty_pages; this starts a new list
+void Pilot_mem_dirty_clear (Pilot_system *sys);
+// Drops everything decoded from memory, for when memory was changed behind the bus's back
+void Pilot_mem_code_invalidate (Pilot_system *sys);
+// Host memory at addr if it's directly mapped there (for writing, it has to be both readable and writable),
+// or NULL; *len is set to the number of bytes from addr on that are mapped the same way in its page.
+// Blocks of accesses can go straight through the pointer, but writes have to be followed by
+// Pilot_mem_direct_written() on the same address
+uint8_t *Pilot_mem_direct_ptr (Pilot_system *sys, uint32_t addr, bool write, uint32_t *len);
+void Pilot_mem_direct_written (Pilot_system *sys, uint32_t addr);
+
 void Pilot_memctl_tick (Pilot_system *sys);
+// Same as num_cycles ticks of an idle memory controller
+void Pilot_memctl_tick_idle (Pilot_system *sys, uint64_t num_cycles);
 
 bool Pilot_mem_addr_read_assert (Pilot_system *sys, bool is_16bit, uint32_t addr);
 bool Pilot_mem_addr_write_assert (Pilot_system *sys, bool is_16bit, uint32_t addr, uint16_t data);
+// A 24-bit operand (low word at addr, high byte at addr + 2) as one transaction that holds the bus for the
+// two cycles its halves would take
+bool Pilot_mem_addr_read24_assert (Pilot_system *sys, uint32_t addr);
+bool Pilot_mem_addr_write24_assert (Pilot_system *sys, uint32_t addr, uint32_t data);
 bool Pilot_mem_data_wait (Pilot_system *sys);
-uint16_t Pilot_mem_get_data (Pilot_system *sys);
+uint32_t Pilot_mem_get_data (Pilot_system *sys);
+
+// Complete immediately without going through the memory controller (fast functional mode only)
+bool Pilot_mem_read_sync (Pilot_system *sys, bool is_16bit, uint32_t addr, uint16_t *data);
+bool Pilot_mem_write_sync (Pilot_system *sys, bool is_16bit, uint32_t addr, uint16_t data);
+bool Pilot_mem_read24_sync (Pilot_system *sys, uint32_t addr, uint32_t *data);
+bool Pilot_mem_write24_sync (Pilot_system *sys, uint32_t addr, uint32_t data);
 
 #endif
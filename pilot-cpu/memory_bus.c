@@ -1,6 +1,8 @@
 #include "memory.h"
-#include <stdio.h>
+#include "bus_trace.h"
+#include "perf_counters.h"
 #include <stddef.h>
+#include <string.h>
 
 #define WRAM_END	0x007fff
 #define VRAM_END	0x00ffff
@@ -14,100 +16,406 @@
 #define HRAM_START	0xfff400
 #define HRAM_END	0xffffff
 
-bool
-mem_read (Pilot_system *sys)
+#define VRAM_START	(WRAM_END + 1)
+#define TMRAM_START	(CART_ROM_END + 1)
+#define OAM_START	(TMRAM_END + 1)
+
+// Guest memory is little-endian; on a little-endian host a 16-bit access is one load or store
+static inline uint16_t
+mem_load16_ (const uint8_t *mem)
 {
-	uint32_t addr = sys->memctl.addr_reg;
-	if (addr <= WRAM_END)
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+	uint16_t data;
+	memcpy(&data, mem, sizeof(data));
+	return data;
+#else
+	return mem[0] | (mem[1] << 8);
+#endif
+}
+
+static inline void
+mem_store16_ (uint8_t *mem, uint16_t data)
+{
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+	memcpy(mem, &data, sizeof(data));
+#else
+	mem[0] = data & 0xff;
+	mem[1] = data >> 8;
+#endif
+}
+
+static inline void
+mem_code_written_ (Pilot_mem_page *page)
+{
+	if (page->has_code)
 	{
-		// try to read WRAM
+		page->has_code = FALSE;
+		page->code_gen++;
 	}
-	else if (addr <= VRAM_END)
+}
+
+// Bookkeeping for a direct write to a page
+static inline void
+mem_page_written_ (Pilot_mem_map *map, Pilot_mem_page *page)
+{
+	mem_code_written_(page);
+	
+	if (!page->dirty)
 	{
-		// try to read VRAM
+		page->dirty = TRUE;
+		map->dirty_pages[map->num_dirty++] = page - map->pages;
 	}
+}
+
+static Pilot_mem_region
+mem_region_of_ (uint32_t addr)
+{
+	if (addr <= WRAM_END)
+		return MREG_WRAM;
+	else if (addr <= VRAM_END)
+		return MREG_VRAM;
 	else if (addr <= CART_CS1_END)
+		return MREG_CART_CS1;
+	else if (addr <= CART_CS2_END)
+		return MREG_CART_CS2;
+	else if (addr <= CART_ROM_END)
+		return MREG_CART_ROM;
+	else if (addr <= TMRAM_END)
+		return MREG_TMRAM;
+	else if (addr <= OAM_END)
+		return MREG_OAM;
+	else if (addr <= LCDIO_END)
+		return MREG_LCDIO;
+	else if (addr <= HCIO_END)
+		return MREG_HCIO;
+	else
+		return MREG_HRAM;
+}
+
+static inline const Pilot_mem_handler *
+mem_handler_ (Pilot_system *sys, uint32_t addr)
+{
+	Pilot_mem_region region = sys->mem_map.pages[addr >> MEM_PAGE_SHIFT].region;
+	
+	// the OAM page also holds Radar's and the other I/O registers
+	if (region == MREG_OAM)
 	{
-		// call cartridge CS1 mapper
+		region = mem_region_of_(addr);
 	}
-	else if (addr <= CART_CS2_END)
+	
+	return &sys->mem_map.handlers[region];
+}
+
+static bool
+mem_read_byte_ (Pilot_system *sys, uint32_t addr, uint8_t *data)
+{
+	const Pilot_mem_page *page = &sys->mem_map.pages[addr >> MEM_PAGE_SHIFT];
+	uint32_t offset = addr & MEM_PAGE_MASK;
+	
+	if (offset < page->read_limit)
 	{
-		// call cartridge CS2 mapper
+		*data = page->mem[offset];
+		return TRUE;
 	}
-	else if (addr <= CART_ROM_END)
+	
+	const Pilot_mem_handler *handler = mem_handler_(sys, addr);
+	uint16_t word;
+	if (handler->read && handler->read(handler->ctx, addr, FALSE, &word))
 	{
-		// call cartridge ROM mapper
+		*data = word & 0xff;
+		return TRUE;
 	}
-	else if (addr <= TMRAM_END)
+	
+	return FALSE;
+}
+
+static bool
+mem_write_byte_ (Pilot_system *sys, uint32_t addr, uint8_t data)
+{
+	Pilot_mem_page *page = &sys->mem_map.pages[addr >> MEM_PAGE_SHIFT];
+	uint32_t offset = addr & MEM_PAGE_MASK;
+	
+	if (offset < page->write_limit)
 	{
-		// tilemap RAM
+		page->mem[offset] = data;
+		mem_page_written_(&sys->mem_map, page);
+		return TRUE;
 	}
-	else if (addr <= OAM_END)
+	
+	const Pilot_mem_handler *handler = mem_handler_(sys, addr);
+	return handler->write && handler->write(handler->ctx, addr, FALSE, data);
+}
+
+// Only succeeds if the access falls entirely within one directly mapped page
+static inline bool
+mem_read_direct_ (Pilot_system *sys, uint32_t addr, bool is_16bit, uint16_t *data)
+{
+	addr &= 0xffffff;
+	const Pilot_mem_page *page = &sys->mem_map.pages[addr >> MEM_PAGE_SHIFT];
+	uint32_t offset = addr & MEM_PAGE_MASK;
+	
+	if (offset + is_16bit < page->read_limit)
 	{
-		// sprite attribute RAM
+		*data = is_16bit ? mem_load16_(&page->mem[offset]) : page->mem[offset];
+		return TRUE;
 	}
-	else if (addr <= LCDIO_END)
+	
+	return FALSE;
+}
+
+static inline bool
+mem_write_direct_ (Pilot_system *sys, uint32_t addr, bool is_16bit, uint16_t data)
+{
+	addr &= 0xffffff;
+	Pilot_mem_page *page = &sys->mem_map.pages[addr >> MEM_PAGE_SHIFT];
+	uint32_t offset = addr & MEM_PAGE_MASK;
+	
+	if (offset + is_16bit < page->write_limit)
 	{
-		// Radar's I/O registers
+		if (is_16bit)
+		{
+			mem_store16_(&page->mem[offset], data);
+		}
+		else
+		{
+			page->mem[offset] = data & 0xff;
+		}
+		mem_page_written_(&sys->mem_map, page);
+		return TRUE;
 	}
-	else if (addr <= HCIO_END)
+	
+	return FALSE;
+}
+
+static bool
+mem_read (Pilot_system *sys, uint32_t addr, bool is_16bit, uint16_t *data)
+{
+	if (mem_read_direct_(sys, addr, is_16bit, data))
 	{
-		// other memory mapped I/O
+		return TRUE;
 	}
-	else if (addr <= HRAM_END)
+	
+	addr &= 0xffffff;
+	const Pilot_mem_page *page = &sys->mem_map.pages[addr >> MEM_PAGE_SHIFT];
+	uint32_t offset = addr & MEM_PAGE_MASK;
+	
+	if (is_16bit && (offset == MEM_PAGE_MASK || offset + 1 == page->read_limit))
 	{
-		sys->memctl.data_reg_in = sys->hram[addr - HRAM_START] | (sys->memctl.is_16bit ? (sys->hram[addr - HRAM_START + 1] << 8) : 0);
+		// the two bytes are served by different pages or handlers
+		uint8_t lo, hi;
+		if (!mem_read_byte_(sys, addr, &lo) || !mem_read_byte_(sys, (addr + 1) & 0xffffff, &hi))
+		{
+			return FALSE;
+		}
+		
+		*data = lo | (hi << 8);
 		return TRUE;
 	}
 	
-	return FALSE;
+	const Pilot_mem_handler *handler = mem_handler_(sys, addr);
+	return handler->read && handler->read(handler->ctx, addr, is_16bit, data);
 }
 
-bool
-mem_write (Pilot_system *sys)
+static bool
+mem_write (Pilot_system *sys, uint32_t addr, bool is_16bit, uint16_t data)
 {
-	uint32_t addr = sys->memctl.addr_reg;
+	if (mem_write_direct_(sys, addr, is_16bit, data))
+	{
+		return TRUE;
+	}
 	
-	if (addr <= WRAM_END)
+	addr &= 0xffffff;
+	const Pilot_mem_page *page = &sys->mem_map.pages[addr >> MEM_PAGE_SHIFT];
+	uint32_t offset = addr & MEM_PAGE_MASK;
+	
+	if (is_16bit && (offset == MEM_PAGE_MASK || offset + 1 == page->write_limit))
 	{
-		// try to write WRAM
+		// the two bytes are served by different pages or handlers
+		return mem_write_byte_(sys, addr, data & 0xff) && mem_write_byte_(sys, (addr + 1) & 0xffffff, data >> 8);
 	}
-	else if (addr <= VRAM_END)
+	
+	const Pilot_mem_handler *handler = mem_handler_(sys, addr);
+	return handler->write && handler->write(handler->ctx, addr, is_16bit, data);
+}
+
+// 24-bit operands are a 16-bit word with the high byte above it; within one directly mapped page, that's a
+// single lookup and a single copy
+static bool
+mem_read24_ (Pilot_system *sys, uint32_t addr, uint32_t *data)
+{
+	addr &= 0xffffff;
+	const Pilot_mem_page *page = &sys->mem_map.pages[addr >> MEM_PAGE_SHIFT];
+	uint32_t offset = addr & MEM_PAGE_MASK;
+	
+	if (offset + 2 < page->read_limit)
 	{
-		// try to write VRAM
+		*data = mem_load16_(&page->mem[offset]) | (page->mem[offset + 2] << 16);
+		return TRUE;
 	}
-	else if (addr <= CART_CS2_END)
+	
+	// otherwise it's a 16-bit access and an 8-bit one, each retried on its own; the low word waits in *data
+	Pilot_memctl *memctl = &sys->memctl;
+	if (!memctl->low_done)
 	{
-		// call cartridge chip select mapper
+		uint16_t lo;
+		if (!mem_read(sys, addr, TRUE, &lo))
+		{
+			return FALSE;
+		}
+		*data = lo;
+		memctl->low_done = TRUE;
 	}
-	else if (addr <= CART_ROM_END)
+	
+	uint16_t hi;
+	if (!mem_read(sys, addr + 2, FALSE, &hi))
 	{
-		// call cartridge ROM mapper
+		return FALSE;
 	}
-	else if (addr <= TMRAM_END)
+	
+	memctl->low_done = FALSE;
+	*data = (*data & 0xffff) | ((hi & 0xff) << 16);
+	return TRUE;
+}
+
+static bool
+mem_write24_ (Pilot_system *sys, uint32_t addr, uint32_t data)
+{
+	addr &= 0xffffff;
+	Pilot_mem_page *page = &sys->mem_map.pages[addr >> MEM_PAGE_SHIFT];
+	uint32_t offset = addr & MEM_PAGE_MASK;
+	
+	if (offset + 2 < page->write_limit)
 	{
-		// tilemap RAM
+		mem_store16_(&page->mem[offset], data & 0xffff);
+		page->mem[offset + 2] = (data >> 16) & 0xff;
+		mem_page_written_(&sys->mem_map, page);
+		return TRUE;
 	}
-	else if (addr <= OAM_END)
+	
+	Pilot_memctl *memctl = &sys->memctl;
+	if (!memctl->low_done)
 	{
-		// sprite attribute RAM
+		if (!mem_write(sys, addr, TRUE, data & 0xffff))
+		{
+			return FALSE;
+		}
+		memctl->low_done = TRUE;
 	}
-	else if (addr <= LCDIO_END)
+	
+	if (!mem_write(sys, addr + 2, FALSE, (data >> 16) & 0xff))
 	{
-		// Radar's I/O registers
+		return FALSE;
 	}
-	else if (addr <= HCIO_END)
+	
+	memctl->low_done = FALSE;
+	return TRUE;
+}
+
+void
+Pilot_mem_map_init (Pilot_system *sys)
+{
+	for (uint32_t i = 0; i < MEM_NUM_PAGES; i++)
 	{
-		// other memory mapped I/O
+		Pilot_mem_page *page = &sys->mem_map.pages[i];
+		page->mem = NULL;
+		page->read_limit = 0;
+		page->write_limit = 0;
+		page->region = mem_region_of_(i << MEM_PAGE_SHIFT);
+		page->has_code = FALSE;
+		page->code_gen = 0;
+		page->dirty = FALSE;
 	}
-	else if (addr <= HRAM_END)
+	sys->mem_map.num_dirty = 0;
+	
+	for (int i = 0; i < MREG_NUM_REGIONS; i++)
 	{
-		sys->hram[addr - HRAM_START] = sys->memctl.data_reg_out & 0xff;
-		if (sys->memctl.is_16bit) sys->hram[addr - HRAM_START + 1] = sys->memctl.data_reg_out >> 8;
-		return TRUE;
+		sys->mem_map.handlers[i] = (Pilot_mem_handler){NULL, NULL, NULL};
 	}
 	
-	return FALSE;
+	Pilot_mem_map_direct(sys, 0, WRAM_END, sys->wram, TRUE);
+	Pilot_mem_map_direct(sys, VRAM_START, VRAM_END, sys->vram, TRUE);
+	Pilot_mem_map_direct(sys, TMRAM_START, TMRAM_END, sys->tmram, TRUE);
+	Pilot_mem_map_direct(sys, OAM_START, OAM_END, sys->oam, TRUE);
+	Pilot_mem_map_direct(sys, HRAM_START, HRAM_END, sys->hram, TRUE);
+}
+
+void
+Pilot_mem_map_direct (Pilot_system *sys, uint32_t start, uint32_t end, uint8_t *mem, bool writable)
+{
+	for (uint32_t addr = start; addr <= end; addr += MEM_PAGE_SIZE)
+	{
+		Pilot_mem_page *page = &sys->mem_map.pages[addr >> MEM_PAGE_SHIFT];
+		uint16_t limit = (end - addr >= MEM_PAGE_MASK) ? MEM_PAGE_SIZE : (end - addr + 1);
+		
+		page->mem = mem + (addr - start);
+		page->read_limit = limit;
+		page->write_limit = writable ? limit : 0;
+		mem_code_written_(page);
+	}
+}
+
+void
+Pilot_mem_map_unmap (Pilot_system *sys, uint32_t start, uint32_t end)
+{
+	for (uint32_t addr = start; addr <= end; addr += MEM_PAGE_SIZE)
+	{
+		Pilot_mem_page *page = &sys->mem_map.pages[addr >> MEM_PAGE_SHIFT];
+		
+		page->mem = NULL;
+		page->read_limit = 0;
+		page->write_limit = 0;
+		mem_code_written_(page);
+	}
+}
+
+void
+Pilot_mem_set_handler (Pilot_system *sys, Pilot_mem_region region, Pilot_mem_read_handler read, Pilot_mem_write_handler write, void *ctx)
+{
+	sys->mem_map.handlers[region] = (Pilot_mem_handler){read, write, ctx};
+}
+
+void
+Pilot_mem_dirty_clear (Pilot_system *sys)
+{
+	Pilot_mem_map *map = &sys->mem_map;
+	
+	for (uint32_t i = 0; i < map->num_dirty; i++)
+	{
+		map->pages[map->dirty_pages[i]].dirty = FALSE;
+	}
+	map->num_dirty = 0;
+}
+
+void
+Pilot_mem_code_invalidate (Pilot_system *sys)
+{
+	for (int i = 0; i < MEM_NUM_PAGES; i++)
+	{
+		mem_code_written_(&sys->mem_map.pages[i]);
+	}
+}
+
+uint8_t *
+Pilot_mem_direct_ptr (Pilot_system *sys, uint32_t addr, bool write, uint32_t *len)
+{
+	addr &= 0xffffff;
+	const Pilot_mem_page *page = &sys->mem_map.pages[addr >> MEM_PAGE_SHIFT];
+	uint32_t offset = addr & MEM_PAGE_MASK;
+	uint32_t limit = (write && page->write_limit < page->read_limit) ? page->write_limit : page->read_limit;
+	
+	if (offset >= limit)
+	{
+		return NULL;
+	}
+	
+	*len = limit - offset;
+	return &page->mem[offset];
+}
+
+void
+Pilot_mem_direct_written (Pilot_system *sys, uint32_t addr)
+{
+	mem_page_written_(&sys->mem_map, &sys->mem_map.pages[(addr & 0xffffff) >> MEM_PAGE_SHIFT]);
 }
 
 /*
@@ -121,19 +429,38 @@ mem_write (Pilot_system *sys)
  * Writes:
  * Tick 0: Pilot_mem_addr_write_assert - assert the address to be accessed
  * 
+ * Directly mapped memory always answers on the next tick, so those accesses are carried out as soon as
+ * they're asserted and the tick only has to let the cycle pass; the data latch is then valid for exactly
+ * that cycle, same as if the tick had done the access. Everything else is left to the tick, which
+ * retries until the handler accepts it.
+ * 
+ * A 24-bit access stands in for a 16-bit access followed by an 8-bit one two bytes up: it's carried out
+ * in one go but keeps the bus for both cycles, and its data is only valid once the second one has passed.
+ * 
+ * Writes show up in the trace in the cycle they're asserted, reads in the cycle their data is latched, so
+ * that the record can carry it. Each half of a 24-bit access is its own record, a cycle after the other.
  */
 bool
 Pilot_mem_addr_read_assert (Pilot_system *sys, bool is_16bit, uint32_t addr)
 {
 	if (sys->memctl.state == MCTL_READY)
 	{
-		if (is_16bit) printf("RD16 $%06x\n", addr);
-		else printf("RD08 $%06x\n", addr);
-		
 		sys->memctl.addr_reg = addr;
 		sys->memctl.is_16bit = is_16bit;
-		sys->memctl.state = MCTL_MEM_R_BUSY;
-		sys->memctl.data_valid = FALSE;
+		sys->memctl.is_24bit = FALSE;
+		sys->memctl.is_write = FALSE;
+		uint16_t data;
+		if (mem_read_direct_(sys, addr, is_16bit, &data))
+		{
+			sys->memctl.data_reg_in = data;
+			sys->memctl.state = MCTL_MEM_DONE;
+			sys->memctl.data_cycle = sys->cycles + 1;
+		}
+		else
+		{
+			sys->memctl.state = MCTL_MEM_R_BUSY;
+			sys->memctl.data_cycle = UINT64_MAX;
+		}
 		
 		return TRUE;
 	}
@@ -146,14 +473,23 @@ Pilot_mem_addr_write_assert (Pilot_system *sys, bool is_16bit, uint32_t addr, ui
 {
 	if (sys->memctl.state == MCTL_READY)
 	{
-		if (is_16bit) printf("WR16 $%04x -> $%06x\n", data, addr);
-		else printf("WR08 $%02x -> $%06x\n", data & 0xff, addr);
+		PILOT_BUS_TRACE_(sys, BTRACE_WRITE, is_16bit, addr, data);
 		
 		sys->memctl.addr_reg = addr;
 		sys->memctl.data_reg_out = data;
 		sys->memctl.is_16bit = is_16bit;
-		sys->memctl.state = MCTL_MEM_W_BUSY;
-		sys->memctl.data_valid = FALSE;
+		sys->memctl.is_24bit = FALSE;
+		sys->memctl.is_write = TRUE;
+		if (mem_write_direct_(sys, addr, is_16bit, data))
+		{
+			sys->memctl.state = MCTL_MEM_DONE;
+			sys->memctl.data_cycle = sys->cycles + 1;
+		}
+		else
+		{
+			sys->memctl.state = MCTL_MEM_W_BUSY;
+			sys->memctl.data_cycle = UINT64_MAX;
+		}
 		
 		return TRUE;
 	}
@@ -162,39 +498,243 @@ Pilot_mem_addr_write_assert (Pilot_system *sys, bool is_16bit, uint32_t addr, ui
 }
 
 bool
-Pilot_mem_data_wait (Pilot_system *sys)
+Pilot_mem_addr_read24_assert (Pilot_system *sys, uint32_t addr)
 {
-	if (sys->memctl.data_valid)
+	if (sys->memctl.state == MCTL_READY)
 	{
+		sys->memctl.addr_reg = addr;
+		sys->memctl.is_16bit = TRUE;
+		sys->memctl.is_24bit = TRUE;
+		sys->memctl.low_done = FALSE;
+		sys->memctl.is_write = FALSE;
+		if (mem_read24_(sys, addr, &sys->memctl.data_reg_in))
+		{
+			sys->memctl.state = MCTL_MEM_DONE;
+			sys->memctl.data_cycle = sys->cycles + 2;
+		}
+		else
+		{
+			sys->memctl.state = MCTL_MEM_R_BUSY;
+			sys->memctl.data_cycle = UINT64_MAX;
+		}
+		
 		return TRUE;
 	}
 	
 	return FALSE;
 }
 
-void
-Pilot_memctl_tick (Pilot_system *sys)
+bool
+Pilot_mem_addr_write24_assert (Pilot_system *sys, uint32_t addr, uint32_t data)
 {
-	sys->memctl.data_valid = FALSE;
-	
 	if (sys->memctl.state == MCTL_READY)
 	{
-		printf("WAIT\n");
+		PILOT_BUS_TRACE_(sys, BTRACE_WRITE, TRUE, addr, data & 0xffff);
+		
+		sys->memctl.addr_reg = addr;
+		sys->memctl.data_reg_out = data;
+		sys->memctl.is_16bit = TRUE;
+		sys->memctl.is_24bit = TRUE;
+		sys->memctl.low_done = FALSE;
+		sys->memctl.is_write = TRUE;
+		if (mem_write24_(sys, addr, data))
+		{
+			sys->memctl.state = MCTL_MEM_DONE;
+			sys->memctl.data_cycle = sys->cycles + 2;
+		}
+		else
+		{
+			sys->memctl.state = MCTL_MEM_W_BUSY;
+			sys->memctl.data_cycle = UINT64_MAX;
+		}
+		
+		return TRUE;
 	}
-	if (sys->memctl.state == MCTL_MEM_R_BUSY && mem_read(sys))
+	
+	return FALSE;
+}
+
+bool
+Pilot_mem_data_wait (Pilot_system *sys)
+{
+	return sys->memctl.data_cycle == sys->cycles;
+}
+
+// Has another go at the access a busy memory controller is holding
+static bool
+memctl_retry_ (Pilot_system *sys)
+{
+	Pilot_memctl *memctl = &sys->memctl;
+	
+	if (memctl->is_write)
 	{
-		sys->memctl.state = MCTL_READY;
-		sys->memctl.data_valid = TRUE;
+		return memctl->is_24bit ? mem_write24_(sys, memctl->addr_reg, memctl->data_reg_out)
+			: mem_write(sys, memctl->addr_reg, memctl->is_16bit, memctl->data_reg_out & 0xffff);
 	}
-	if (sys->memctl.state == MCTL_MEM_W_BUSY && mem_write(sys))
+	
+	if (memctl->is_24bit)
+	{
+		return mem_read24_(sys, memctl->addr_reg, &memctl->data_reg_in);
+	}
+	
+	uint16_t data;
+	if (!mem_read(sys, memctl->addr_reg, memctl->is_16bit, &data))
+	{
+		return FALSE;
+	}
+	memctl->data_reg_in = data;
+	return TRUE;
+}
+
+// Traces the access the memory controller is holding, or just the high byte of a 24-bit one
+static inline void
+memctl_trace_ (Pilot_system *sys, bool high)
+{
+	const Pilot_memctl *memctl = &sys->memctl;
+	Pilot_bus_trace_dir dir = memctl->is_write ? BTRACE_WRITE : BTRACE_READ;
+	uint32_t data = memctl->is_write ? memctl->data_reg_out : memctl->data_reg_in;
+	
+	if (high)
+	{
+		PILOT_BUS_TRACE_(sys, dir, FALSE, (memctl->addr_reg + 2) & 0xffffff, (data >> 16) & 0xff);
+	}
+	else
+	{
+		PILOT_BUS_TRACE_(sys, dir, memctl->is_16bit, memctl->addr_reg, data & 0xffff);
+	}
+}
+
+void
+Pilot_memctl_tick (Pilot_system *sys)
+{
+	sys->cycles++;
+	
+	switch (sys->memctl.state)
 	{
-		sys->memctl.state = MCTL_READY;
-		sys->memctl.data_valid = TRUE;
+		case MCTL_READY:
+			PILOT_PERF_(sys, memctl_idle);
+			PILOT_BUS_TRACE_(sys, BTRACE_IDLE, FALSE, 0, 0);
+			break;
+		
+		case MCTL_MEM_DONE:
+			PILOT_PERF_(sys, memctl_busy);
+			if (sys->cycles >= sys->memctl.data_cycle)
+			{
+				if (!sys->memctl.is_write)
+				{
+					memctl_trace_(sys, sys->memctl.is_24bit);
+				}
+				sys->memctl.state = MCTL_READY;
+			}
+			else
+			{
+				// halfway through a 24-bit access: the low word of a read is latched, the high byte of a write goes out
+				memctl_trace_(sys, sys->memctl.is_write);
+			}
+			break;
+		
+		case MCTL_MEM_R_BUSY:
+		case MCTL_MEM_W_BUSY:
+			PILOT_PERF_(sys, memctl_busy);
+			if (memctl_retry_(sys))
+			{
+				if (sys->memctl.is_24bit)
+				{
+					// the high byte still takes its own cycle
+					memctl_trace_(sys, sys->memctl.is_write);
+					sys->memctl.state = MCTL_MEM_DONE;
+					sys->memctl.data_cycle = sys->cycles + 1;
+				}
+				else
+				{
+					if (!sys->memctl.is_write)
+					{
+						memctl_trace_(sys, FALSE);
+					}
+					sys->memctl.state = MCTL_READY;
+					sys->memctl.data_cycle = sys->cycles;
+				}
+			}
+			break;
 	}
 }
 
-uint16_t
+void
+Pilot_memctl_tick_idle (Pilot_system *sys, uint64_t num_cycles)
+{
+	if (PILOT_BUS_TRACE && sys->trace.mode != BTRACE_OFF && sys->trace.record_idle)
+	{
+		// every idle cycle has to show up in the trace
+		while (num_cycles--)
+		{
+			Pilot_memctl_tick(sys);
+		}
+		return;
+	}
+	
+#if PILOT_PERF_COUNTERS
+	sys->perf.memctl_idle += num_cycles;
+#endif
+	sys->cycles += num_cycles;
+}
+
+uint32_t
 Pilot_mem_get_data (Pilot_system *sys)
 {
 	return sys->memctl.data_reg_in;
 }
+
+/*
+ * Synchronous accesses bypass the memory controller and complete on the spot; they're only for the fast
+ * functional execution mode, where nothing else is contending for the bus. FALSE means the access couldn't
+ * be carried out yet and has to be retried.
+ */
+bool
+Pilot_mem_read_sync (Pilot_system *sys, bool is_16bit, uint32_t addr, uint16_t *data)
+{
+	if (!mem_read(sys, addr, is_16bit, data))
+	{
+		return FALSE;
+	}
+	
+	PILOT_BUS_TRACE_(sys, BTRACE_READ, is_16bit, addr, *data);
+	return TRUE;
+}
+
+bool
+Pilot_mem_write_sync (Pilot_system *sys, bool is_16bit, uint32_t addr, uint16_t data)
+{
+	if (!mem_write(sys, addr, is_16bit, data))
+	{
+		return FALSE;
+	}
+	
+	PILOT_BUS_TRACE_(sys, BTRACE_WRITE, is_16bit, addr, data);
+	return TRUE;
+}
+
+bool
+Pilot_mem_read24_sync (Pilot_system *sys, uint32_t addr, uint32_t *data)
+{
+	if (!mem_read24_(sys, addr, data))
+	{
+		return FALSE;
+	}
+	
+	PILOT_BUS_TRACE_(sys, BTRACE_READ, TRUE, addr, *data & 0xffff);
+	PILOT_BUS_TRACE_(sys, BTRACE_READ, FALSE, (addr + 2) & 0xffffff, (*data >> 16) & 0xff);
+	return TRUE;
+}
+
+bool
+Pilot_mem_write24_sync (Pilot_system *sys, uint32_t addr, uint32_t data)
+{
+	if (!mem_write24_(sys, addr, data))
+	{
+		return FALSE;
+	}
+	
+	PILOT_BUS_TRACE_(sys, BTRACE_WRITE, TRUE, addr, data & 0xffff);
+	PILOT_BUS_TRACE_(sys, BTRACE_WRITE, FALSE, (addr + 2) & 0xffffff, (data >> 16) & 0xff);
+	return TRUE;
+}
@@ -0,0 +1,26 @@
+#include "perf_counters.h"
+#include <string.h>
+
+void
+Pilot_perf_reset (Pilot_system *sys)
+{
+#if PILOT_PERF_COUNTERS
+	memset(&sys->perf, 0, sizeof(sys->perf));
+	sys->perf.reset_cycle = sys->cycles;
+#else
+	(void)sys;
+#endif
+}
+
+void
+Pilot_perf_snapshot (const Pilot_system *sys, Pilot_perf_counters *out)
+{
+#if PILOT_PERF_COUNTERS
+	*out = sys->perf;
+	// loading a save state can take the cycle count back past the last reset
+	out->cycles = (sys->cycles > sys->perf.reset_cycle) ? sys->cycles - sys->perf.reset_cycle : 0;
+#else
+	(void)sys;
+	memset(out, 0, sizeof(*out));
+#endif
+}
@@ -0,0 +1,19 @@
+#ifndef __PERF_COUNTERS_H__
+#define __PERF_COUNTERS_H__
+
+#include <stdint.h>
+#include "pilot.h"
+
+// Zeroes every counter and starts counting cycles from here
+void Pilot_perf_reset (Pilot_system *sys);
+
+// Copies the counters out; all zero if PILOT_PERF_COUNTERS is 0
+void Pilot_perf_snapshot (const Pilot_system *sys, Pilot_perf_counters *out);
+
+#if PILOT_PERF_COUNTERS
+#define PILOT_PERF_(sys, counter)	do { (sys)->perf.counter++; } while (0)
+#else
+#define PILOT_PERF_(sys, counter)	do { } while (0)
+#endif
+
+#endif
@@ -2,6 +2,7 @@
 #define __PILOT_H__
 
 #include <stdint.h>
+#include <stdio.h>
 #include "cpu_regs.h"
 #include "cpu_interconnect.h"
 
@@ -9,25 +10,228 @@ typedef enum
 {
 	MCTL_READY = 0,
 	MCTL_MEM_R_BUSY,
-	MCTL_MEM_W_BUSY
+	MCTL_MEM_W_BUSY,
+	// Already carried out on directly mapped memory; only the cycle it takes is left to run
+	MCTL_MEM_DONE
 } Pilot_memctl_state;
 
 typedef struct
 {
 	Pilot_memctl_state state;
-	bool data_valid;
 	bool is_16bit;
+	bool is_24bit;
+	bool is_write;
+	// The low word of a 24-bit access has been carried out, and only the high byte is left to retry
+	bool low_done;
 	uint32_t addr_reg;
-	uint16_t data_reg_in;
-	uint16_t data_reg_out;
+	uint32_t data_reg_in;
+	uint32_t data_reg_out;
+	// The data latch is only valid during this cycle
+	uint64_t data_cycle;
 } Pilot_memctl;
 
+// The 24-bit address space is decoded through a table of 1 KiB pages
+#define MEM_PAGE_SHIFT	10
+#define MEM_PAGE_SIZE	(1 << MEM_PAGE_SHIFT)
+#define MEM_PAGE_MASK	(MEM_PAGE_SIZE - 1)
+#define MEM_NUM_PAGES	(0x1000000 >> MEM_PAGE_SHIFT)
+
+#define WRAM_SIZE	0x8000
+#define VRAM_SIZE	0x8000
+#define TMRAM_SIZE	0x1000
+#define OAM_SIZE	0x280
+#define HRAM_SIZE	0xc00
+
+typedef enum
+{
+	MREG_UNMAPPED = 0,
+	MREG_WRAM,
+	MREG_VRAM,
+	MREG_CART_CS1,
+	MREG_CART_CS2,
+	MREG_CART_ROM,
+	MREG_TMRAM,
+	MREG_OAM,
+	MREG_LCDIO,
+	MREG_HCIO,
+	MREG_HRAM,
+	
+	MREG_NUM_REGIONS
+} Pilot_mem_region;
+
+// Handlers return FALSE if the access hasn't completed yet; the memory controller will retry it on the next tick
+typedef bool (*Pilot_mem_read_handler) (void *ctx, uint32_t addr, bool is_16bit, uint16_t *data);
+typedef bool (*Pilot_mem_write_handler) (void *ctx, uint32_t addr, bool is_16bit, uint16_t data);
+
+typedef struct
+{
+	Pilot_mem_read_handler read;
+	Pilot_mem_write_handler write;
+	void *ctx;
+} Pilot_mem_handler;
+
+typedef struct
+{
+	// Host memory backing this page; page offsets below read_limit / write_limit are accessed directly through it
+	uint8_t *mem;
+	uint16_t read_limit;
+	uint16_t write_limit;
+	
+	// Region whose handler serves the rest of the page
+	uint8_t region;
+	
+	// Set once something has cached code from this page; writes and remaps then bump code_gen,
+	// which retires everything cached under the old generation. It's 64 bits wide so that it never
+	// wraps around to a generation that something may still have cached
+	bool has_code;
+	uint64_t code_gen;
+	
+	// Set by the first direct write since the dirty list was last cleared
+	bool dirty;
+} Pilot_mem_page;
+
+typedef struct
+{
+	Pilot_mem_page pages[MEM_NUM_PAGES];
+	Pilot_mem_handler handlers[MREG_NUM_REGIONS];
+	
+	// Indices of the dirty pages, in the order they were first written
+	uint16_t dirty_pages[MEM_NUM_PAGES];
+	uint32_t num_dirty;
+} Pilot_mem_map;
+
+typedef enum
+{
+	BTRACE_OFF = 0,
+	// records are stored in a caller-supplied ring buffer
+	BTRACE_RING,
+	// records are formatted into a caller-supplied text buffer, which is written out when it fills up
+	BTRACE_TEXT
+} Pilot_bus_trace_mode;
+
+typedef enum
+{
+	BTRACE_READ = 0,
+	BTRACE_WRITE,
+	// memory controller was clocked without an access pending
+	BTRACE_IDLE
+} Pilot_bus_trace_dir;
+
+typedef struct
+{
+	uint64_t cycle;
+	uint32_t addr;
+	uint16_t data;
+	uint8_t is_16bit;
+	uint8_t dir;
+} Pilot_bus_trace_record;
+
+typedef struct
+{
+	Pilot_bus_trace_mode mode;
+	bool record_idle;
+	
+	// BTRACE_RING: the number of records must be a power of 2; ring_head counts every record ever written,
+	// so the newest record is at (ring_head - 1) & ring_mask
+	Pilot_bus_trace_record *ring;
+	uint32_t ring_mask;
+	uint64_t ring_head;
+	
+	// BTRACE_TEXT
+	FILE *text_out;
+	char *text_buf;
+	size_t text_size;
+	size_t text_len;
+} Pilot_bus_trace;
+
+// Set PILOT_PERF_COUNTERS to 0 to drop the counter block and every hook that updates it
+#ifndef PILOT_PERF_COUNTERS
+#define PILOT_PERF_COUNTERS 1
+#endif
+
+typedef struct
+{
+	// Cycles since the last reset; only filled in by Pilot_perf_snapshot
+	uint64_t cycles;
+	// Instructions taken by the execute sequencer, in total and by decoder group (inst_class)
+	uint64_t insts;
+	uint64_t inst_mix[INST_NUM_CLASSES];
+	// Control words run from each microcode entry point
+	uint64_t mucode_steps[MU_NUM_ENTRIES];
+	
+	// Fast mode: times a repeated instruction skipped ahead over iterations carried out on host memory
+	uint64_t repeat_blocks;
+	// Fast mode: multiply and divide loops carried out with one host operation
+	uint64_t host_muldiv;
+	
+	// The rest only count in cycle-accurate mode
+	// Branches the decoder redirected the fetch unit to, and how many of those the execute unit overruled
+	uint64_t branches_predicted;
+	uint64_t branch_mispredicts;
+	// Cycles the decoder was flushed by a misprediction
+	uint64_t decode_stalls;
+	// Cycles the fetch unit held off the bus for the execute unit
+	uint64_t fetch_backoffs;
+	// Memory controller cycles with and without an access in progress
+	uint64_t memctl_busy;
+	uint64_t memctl_idle;
+	
+	// Pilot_system.cycles at the last reset
+	uint64_t reset_cycle;
+} Pilot_perf_counters;
+
+// Set PILOT_PROFILER to 0 to compile out the guest profiler's call tracking
+#ifndef PILOT_PROFILER
+#define PILOT_PROFILER 1
+#endif
+
+struct Pilot_profiler_;
+
+#define PILOT_MAX_EVENTS	16
+
+struct Pilot_system_;
+typedef void (*Pilot_event_callback) (struct Pilot_system_ *sys, void *ctx);
+
 typedef struct
+{
+	uint64_t cycle;
+	Pilot_event_callback callback;
+	void *ctx;
+} Pilot_event;
+
+typedef struct
+{
+	// Unordered; next_cycle caches the earliest pending event (UINT64_MAX if there are none)
+	Pilot_event events[PILOT_MAX_EVENTS];
+	int num_events;
+	uint64_t next_cycle;
+} Pilot_scheduler;
+
+typedef struct Pilot_system_
 {
 	Pilot_cpu_regs core;
 	Pilot_memctl memctl;
 	pilot_interconnect interconnects;
-	uint8_t hram[0xc00];
+	Pilot_bus_trace trace;
+#if PILOT_PERF_COUNTERS
+	Pilot_perf_counters perf;
+#endif
+#if PILOT_PROFILER
+	// Guest profiler being fed by the execute unit, or NULL
+	struct Pilot_profiler_ *profiler;
+#endif
+	Pilot_mem_map mem_map;
+	
+	// Number of cycles the memory controller has been clocked for
+	uint64_t cycles;
+	Pilot_scheduler sched;
+	
+	// Backing memory, aligned so that aligned 16-bit accesses are single host loads and stores
+	_Alignas(64) uint8_t wram[WRAM_SIZE];
+	_Alignas(64) uint8_t vram[VRAM_SIZE];
+	_Alignas(64) uint8_t tmram[TMRAM_SIZE];
+	_Alignas(64) uint8_t oam[OAM_SIZE];
+	_Alignas(64) uint8_t hram[HRAM_SIZE];
 } Pilot_system;
 
 #endif
@@ -0,0 +1,412 @@
+#include "profiler.h"
+#include "scheduler.h"
+#include <string.h>
+
+#define PROF_EMPTY	UINT32_MAX
+
+// longest frame name that's written out, symbols included
+#define PROF_NAME_MAX	64
+
+#if PILOT_PROFILER
+static inline uint32_t
+prof_hash_ (uint32_t parent, uint32_t pc)
+{
+	uint32_t h = (parent * 0x9e3779b1) ^ (pc * 0x85ebca6b);
+	return h ^ (h >> 15);
+}
+
+// Finds or adds the node for pc under parent; the parent itself if the table is full
+static uint32_t
+prof_child_ (Pilot_profiler *prof, uint32_t parent, uint32_t pc)
+{
+	uint32_t i = prof_hash_(parent, pc) & prof->node_mask;
+	
+	while (TRUE)
+	{
+		// node 0 is the root and is never probed
+		if (i)
+		{
+			Pilot_prof_node *node = &prof->nodes[i];
+			if (node->pc == pc && node->parent == parent)
+			{
+				return i;
+			}
+			if (node->pc == PROF_EMPTY)
+			{
+				break;
+			}
+		}
+		i = (i + 1) & prof->node_mask;
+	}
+	
+	// keep a quarter of the table free so that probes stay short
+	if (prof->num_nodes >= prof->node_mask - prof->node_mask / 4)
+	{
+		prof->dropped++;
+		return parent;
+	}
+	
+	prof->nodes[i] = (Pilot_prof_node){parent, pc, 0};
+	prof->num_nodes++;
+	return i;
+}
+
+// Pops the frames whose return addresses are no longer on the stack
+static inline void
+prof_unwind_ (Pilot_profiler *prof, uint32_t sp)
+{
+	while (prof->depth && sp > prof->frames[prof->depth - 1].sp)
+	{
+		prof->depth--;
+	}
+}
+
+static inline uint32_t
+prof_top_ (const Pilot_profiler *prof)
+{
+	return prof->depth ? prof->frames[prof->depth - 1].node : 0;
+}
+
+static void
+prof_sample_ (Pilot_system *sys, void *ctx)
+{
+	Pilot_profiler *prof = ctx;
+	uint32_t pc = sys->core.disable_clk ? PILOT_PROF_PC_HALTED : sys->core.pgc;
+	
+	prof_unwind_(prof, sys->core.regs[7]);
+	prof->nodes[prof_child_(prof, prof_top_(prof), pc)].samples++;
+	prof->samples++;
+	
+	// a late event (a long halt skip, say) doesn't make up for the samples it missed
+	do
+	{
+		prof->next_sample += prof->period;
+	} while (prof->next_sample <= sys->cycles);
+	Pilot_sched_add(sys, prof->next_sample, prof_sample_, prof);
+}
+#endif
+
+bool
+Pilot_profiler_start (Pilot_system *sys, Pilot_profiler *prof, Pilot_prof_node *nodes, uint32_t num_nodes, uint64_t period)
+{
+#if PILOT_PROFILER
+	Pilot_profiler_stop(sys);
+	
+	// round down to a power of 2
+	while (num_nodes & (num_nodes - 1))
+	{
+		num_nodes &= num_nodes - 1;
+	}
+	if (num_nodes < 2 || !period)
+	{
+		return FALSE;
+	}
+	
+	memset(prof, 0, sizeof(*prof));
+	prof->period = period;
+	prof->next_sample = sys->cycles + period;
+	prof->nodes = nodes;
+	prof->node_mask = num_nodes - 1;
+	prof->num_nodes = 1;
+	
+	for (uint32_t i = 0; i < num_nodes; i++)
+	{
+		nodes[i] = (Pilot_prof_node){0, PROF_EMPTY, 0};
+	}
+	nodes[0].pc = 0;
+	
+	if (!Pilot_sched_add(sys, prof->next_sample, prof_sample_, prof))
+	{
+		return FALSE;
+	}
+	sys->profiler = prof;
+	return TRUE;
+#else
+	(void)sys;
+	(void)prof;
+	(void)nodes;
+	(void)num_nodes;
+	(void)period;
+	return FALSE;
+#endif
+}
+
+void
+Pilot_profiler_stop (Pilot_system *sys)
+{
+#if PILOT_PROFILER
+	if (sys->profiler)
+	{
+		Pilot_sched_cancel(sys, prof_sample_, sys->profiler);
+		sys->profiler = NULL;
+	}
+#else
+	(void)sys;
+#endif
+}
+
+void
+Pilot_profiler_set_symbols (Pilot_profiler *prof, const Pilot_prof_symbol *symbols, uint32_t num_symbols)
+{
+	prof->symbols = symbols;
+	prof->num_symbols = symbols ? num_symbols : 0;
+}
+
+void
+Pilot_profiler_call (Pilot_system *sys, uint32_t call_pgc)
+{
+#if PILOT_PROFILER
+	Pilot_profiler *prof = sys->profiler;
+	uint32_t sp = sys->core.regs[7];
+	
+	prof_unwind_(prof, sp);
+	if (prof->depth < PILOT_PROF_MAX_DEPTH)
+	{
+		uint32_t node = prof_child_(prof, prof_top_(prof), call_pgc);
+		prof->frames[prof->depth++] = (Pilot_prof_frame){sp, node};
+	}
+#else
+	(void)sys;
+	(void)call_pgc;
+#endif
+}
+
+/*
+ * Output
+ */
+
+static void
+prof_name_ (const Pilot_profiler *prof, uint32_t pc, char *name)
+{
+	if (pc == PILOT_PROF_PC_HALTED)
+	{
+		strcpy(name, "[halted]");
+		return;
+	}
+	
+	// last symbol at or below pc
+	uint32_t lo = 0, hi = prof->num_symbols;
+	while (lo < hi)
+	{
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (prof->symbols[mid].addr <= pc)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	
+	if (lo)
+	{
+		snprintf(name, PROF_NAME_MAX, "%s", prof->symbols[lo - 1].name);
+	}
+	else
+	{
+		snprintf(name, PROF_NAME_MAX, "$%06x", pc);
+	}
+}
+
+// Fills path with the nodes from node up to (not including) the root, leaf first
+static uint32_t
+prof_path_ (const Pilot_profiler *prof, uint32_t node, uint32_t *path)
+{
+	uint32_t depth = 0;
+	while (node && depth <= PILOT_PROF_MAX_DEPTH)
+	{
+		path[depth++] = node;
+		node = prof->nodes[node].parent;
+	}
+	return depth;
+}
+
+bool
+Pilot_profiler_write_folded (const Pilot_profiler *prof, FILE *out)
+{
+	uint32_t path[PILOT_PROF_MAX_DEPTH + 1];
+	char name[PROF_NAME_MAX];
+	
+	for (uint32_t i = 1; i <= prof->node_mask; i++)
+	{
+		if (prof->nodes[i].pc == PROF_EMPTY || !prof->nodes[i].samples)
+		{
+			continue;
+		}
+		
+		uint32_t depth = prof_path_(prof, i, path);
+		while (depth--)
+		{
+			prof_name_(prof, prof->nodes[path[depth]].pc, name);
+			fprintf(out, depth ? "%s;" : "%s", name);
+		}
+		fprintf(out, " %llu\n", (unsigned long long)prof->nodes[i].samples);
+	}
+	
+	return !ferror(out);
+}
+
+/*
+ * Just enough of the protobuf wire format for profile.proto: every nested message is built in a local
+ * buffer first, since it has to be preceded by its length
+ */
+
+enum
+{
+	PPROF_PROFILE_SAMPLE_TYPE = 1,
+	PPROF_PROFILE_SAMPLE = 2,
+	PPROF_PROFILE_LOCATION = 4,
+	PPROF_PROFILE_FUNCTION = 5,
+	PPROF_PROFILE_STRING_TABLE = 6,
+	PPROF_PROFILE_PERIOD_TYPE = 11,
+	PPROF_PROFILE_PERIOD = 12,
+	
+	PPROF_VALUE_TYPE_TYPE = 1,
+	PPROF_VALUE_TYPE_UNIT = 2,
+	
+	PPROF_SAMPLE_LOCATION_ID = 1,
+	PPROF_SAMPLE_VALUE = 2,
+	
+	PPROF_LOCATION_ID = 1,
+	PPROF_LOCATION_ADDRESS = 3,
+	PPROF_LOCATION_LINE = 4,
+	
+	PPROF_LINE_FUNCTION_ID = 1,
+	
+	PPROF_FUNCTION_ID = 1,
+	PPROF_FUNCTION_NAME = 2
+};
+
+// Fixed entries of the string table; the function names follow
+enum
+{
+	PPROF_STR_EMPTY = 0,
+	PPROF_STR_SAMPLES,
+	PPROF_STR_COUNT,
+	PPROF_STR_CYCLES,
+	
+	PPROF_NUM_STRS
+};
+
+static const char *const pprof_strs_[PPROF_NUM_STRS] = {"", "samples", "count", "cycles"};
+
+static inline uint8_t *
+pprof_varint_ (uint8_t *p, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		*p++ = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	*p++ = value;
+	return p;
+}
+
+static inline uint8_t *
+pprof_field_varint_ (uint8_t *p, uint32_t field, uint64_t value)
+{
+	p = pprof_varint_(p, field << 3);
+	return pprof_varint_(p, value);
+}
+
+static inline uint8_t *
+pprof_field_bytes_ (uint8_t *p, uint32_t field, const void *data, size_t size)
+{
+	p = pprof_varint_(p, (field << 3) | 2);
+	p = pprof_varint_(p, size);
+	memcpy(p, data, size);
+	return p + size;
+}
+
+static bool
+pprof_write_ (FILE *out, uint32_t field, const uint8_t *msg, const uint8_t *end)
+{
+	uint8_t header[16];
+	uint8_t *p = pprof_varint_(header, (field << 3) | 2);
+	p = pprof_varint_(p, end - msg);
+	
+	return fwrite(header, 1, p - header, out) == (size_t)(p - header) && fwrite(msg, 1, end - msg, out) == (size_t)(end - msg);
+}
+
+static bool
+pprof_write_value_type_ (FILE *out, uint32_t field, uint32_t type, uint32_t unit)
+{
+	uint8_t msg[16];
+	uint8_t *p = pprof_field_varint_(msg, PPROF_VALUE_TYPE_TYPE, type);
+	p = pprof_field_varint_(p, PPROF_VALUE_TYPE_UNIT, unit);
+	return pprof_write_(out, field, msg, p);
+}
+
+bool
+Pilot_profiler_write_pprof (const Pilot_profiler *prof, FILE *out)
+{
+	bool ok = TRUE;
+	uint8_t msg[16 + (PILOT_PROF_MAX_DEPTH + 1) * 10 + PROF_NAME_MAX];
+	uint8_t *p;
+	
+	for (int i = 0; i < PPROF_NUM_STRS; i++)
+	{
+		ok = ok && pprof_write_(out, PPROF_PROFILE_STRING_TABLE, (const uint8_t *)pprof_strs_[i], (const uint8_t *)pprof_strs_[i] + strlen(pprof_strs_[i]));
+	}
+	
+	// samples are counted, but what they stand for is cycles
+	ok = ok && pprof_write_value_type_(out, PPROF_PROFILE_SAMPLE_TYPE, PPROF_STR_SAMPLES, PPROF_STR_COUNT);
+	ok = ok && pprof_write_value_type_(out, PPROF_PROFILE_SAMPLE_TYPE, PPROF_STR_CYCLES, PPROF_STR_COUNT);
+	ok = ok && pprof_write_value_type_(out, PPROF_PROFILE_PERIOD_TYPE, PPROF_STR_CYCLES, PPROF_STR_COUNT);
+	p = pprof_field_varint_(msg, PPROF_PROFILE_PERIOD, prof->period);
+	ok = ok && fwrite(msg, 1, p - msg, out) == (size_t)(p - msg);
+	
+	// one location and one function per node, both with the node's index as their ID
+	uint64_t next_str = PPROF_NUM_STRS;
+	for (uint32_t i = 1; i <= prof->node_mask && ok; i++)
+	{
+		if (prof->nodes[i].pc == PROF_EMPTY)
+		{
+			continue;
+		}
+		
+		char name[PROF_NAME_MAX];
+		prof_name_(prof, prof->nodes[i].pc, name);
+		ok = pprof_write_(out, PPROF_PROFILE_STRING_TABLE, (const uint8_t *)name, (const uint8_t *)name + strlen(name));
+		
+		p = pprof_field_varint_(msg, PPROF_FUNCTION_ID, i);
+		p = pprof_field_varint_(p, PPROF_FUNCTION_NAME, next_str++);
+		ok = ok && pprof_write_(out, PPROF_PROFILE_FUNCTION, msg, p);
+		
+		uint8_t line[16];
+		uint8_t *line_end = pprof_field_varint_(line, PPROF_LINE_FUNCTION_ID, i);
+		p = pprof_field_varint_(msg, PPROF_LOCATION_ID, i);
+		p = pprof_field_varint_(p, PPROF_LOCATION_ADDRESS, prof->nodes[i].pc);
+		p = pprof_field_bytes_(p, PPROF_LOCATION_LINE, line, line_end - line);
+		ok = ok && pprof_write_(out, PPROF_PROFILE_LOCATION, msg, p);
+	}
+	
+	uint32_t path[PILOT_PROF_MAX_DEPTH + 1];
+	for (uint32_t i = 1; i <= prof->node_mask && ok; i++)
+	{
+		if (prof->nodes[i].pc == PROF_EMPTY || !prof->nodes[i].samples)
+		{
+			continue;
+		}
+		
+		// pprof wants the leaf first, which is the order the path is in
+		uint8_t ids[(PILOT_PROF_MAX_DEPTH + 1) * 10];
+		uint8_t *ids_end = ids;
+		uint32_t depth = prof_path_(prof, i, path);
+		for (uint32_t j = 0; j < depth; j++)
+		{
+			ids_end = pprof_varint_(ids_end, path[j]);
+		}
+		
+		uint8_t values[20];
+		uint8_t *values_end = pprof_varint_(values, prof->nodes[i].samples);
+		values_end = pprof_varint_(values_end, prof->nodes[i].samples * prof->period);
+		
+		p = pprof_field_bytes_(msg, PPROF_SAMPLE_LOCATION_ID, ids, ids_end - ids);
+		p = pprof_field_bytes_(p, PPROF_SAMPLE_VALUE, values, values_end - values);
+		ok = pprof_write_(out, PPROF_PROFILE_SAMPLE, msg, p);
+	}
+	
+	return ok && !ferror(out);
+}
@@ -0,0 +1,91 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include "pilot.h"
+
+/*
+ * Sampling guest profiler
+ *
+ * Every period cycles, a scheduled event records core.pgc under the current call stack. The call stack
+ * is a shadow of the guest's: a frame is pushed whenever the execute unit stores a return address
+ * (calls, RST and interrupts all go through MU_PUSH_PGC_WR_PGC), and frames are popped once SP has
+ * risen above where their return address was stored, however the guest got back out.
+ *
+ * Samples are kept as a calling context tree in a caller-supplied node table. Each node is a PGC under
+ * its parent: the call site for frames, the sampled PGC for leaves.
+ */
+
+#define PILOT_PROF_MAX_DEPTH	64
+
+// PGC recorded for samples taken while the core is halted
+#define PILOT_PROF_PC_HALTED	0x1000000
+
+// Optional symbol map; sorted by address, each symbol runs up to the next one
+typedef struct
+{
+	uint32_t addr;
+	const char *name;
+} Pilot_prof_symbol;
+
+typedef struct
+{
+	uint32_t parent;
+	uint32_t pc;
+	// Samples taken right at this node (not counting its children)
+	uint64_t samples;
+} Pilot_prof_node;
+
+typedef struct
+{
+	// SP just after the return address was pushed
+	uint32_t sp;
+	uint32_t node;
+} Pilot_prof_frame;
+
+typedef struct Pilot_profiler_
+{
+	uint64_t period;
+	uint64_t next_sample;
+	
+	// Open addressing on (parent, pc); the number of nodes is a power of 2 and node 0 is the root
+	Pilot_prof_node *nodes;
+	uint32_t node_mask;
+	uint32_t num_nodes;
+	
+	Pilot_prof_frame frames[PILOT_PROF_MAX_DEPTH];
+	uint32_t depth;
+	
+	const Pilot_prof_symbol *symbols;
+	uint32_t num_symbols;
+	
+	uint64_t samples;
+	// Samples and calls that didn't fit in the node table (calls are then charged to the caller)
+	uint64_t dropped;
+} Pilot_profiler;
+
+// Starts sampling every period cycles; num_nodes is rounded down to a power of 2
+// Returns FALSE if the profiler couldn't be started (no nodes, or the event table is full)
+bool Pilot_profiler_start (Pilot_system *sys, Pilot_profiler *prof, Pilot_prof_node *nodes, uint32_t num_nodes, uint64_t period);
+// Stops sampling; whatever was collected can still be written out
+void Pilot_profiler_stop (Pilot_system *sys);
+
+void Pilot_profiler_set_symbols (Pilot_profiler *prof, const Pilot_prof_symbol *symbols, uint32_t num_symbols);
+
+// Folded stacks ("outer;inner;leaf count" per line), as taken by flamegraph.pl and most viewers
+bool Pilot_profiler_write_folded (const Pilot_profiler *prof, FILE *out);
+// Uncompressed profile.proto message, as read by pprof
+bool Pilot_profiler_write_pprof (const Pilot_profiler *prof, FILE *out);
+
+// Called by the execute unit as it stores a return address for the instruction at call_pgc
+void Pilot_profiler_call (Pilot_system *sys, uint32_t call_pgc);
+
+#if PILOT_PROFILER
+#define PILOT_PROF_CALL_(sys, call_pgc) \
+	do { if ((sys)->profiler) Pilot_profiler_call((sys), (call_pgc)); } while (0)
+#else
+#define PILOT_PROF_CALL_(sys, call_pgc) do { } while (0)
+#endif
+
+#endif
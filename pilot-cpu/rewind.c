@@ -0,0 +1,288 @@
+#include "rewind.h"
+#include "savestate.h"
+#include "memory.h"
+#include <string.h>
+
+/*
+ * Each frame is one record in the ring buffer, aligned to 8 bytes:
+ *
+ * header (pilot_rewind_record)
+ * save state: the whole machine for keyframes, CPU and pipeline only otherwise
+ * for other frames, each RAM page written during the frame: a pilot_rewind_page, then its contents
+ *
+ * The newest frame is rebuilt from the keyframe it follows plus the pages of every frame after that.
+ * Page writes are only seen on the bus, so RAM changed by the host between frames isn't recorded.
+ */
+
+typedef struct
+{
+	uint32_t size;
+	uint32_t prev;
+	uint32_t next;
+	uint32_t state_size;
+	uint32_t num_pages;
+	bool keyframe;
+} pilot_rewind_record;
+
+typedef struct
+{
+	uint8_t ram;
+	uint16_t size;
+	uint32_t offset;
+} pilot_rewind_page;
+
+#define REWIND_ALIGN_(size)	(((size) + 7) & ~(size_t)7)
+
+static inline pilot_rewind_record *
+rewind_record_ (Pilot_rewind *rw, size_t pos)
+{
+	return (pilot_rewind_record *)(rw->buf + pos);
+}
+
+// Finds the RAM region behind a dirty page; FALSE if the page is mapped to memory outside the system
+static bool
+rewind_page_ram_ (Pilot_system *sys, const Pilot_mem_page *page, pilot_rewind_page *entry)
+{
+	uint8_t *rams[] = {sys->wram, sys->vram, sys->tmram, sys->oam, sys->hram};
+	const uint32_t sizes[] = {WRAM_SIZE, VRAM_SIZE, TMRAM_SIZE, OAM_SIZE, HRAM_SIZE};
+	
+	for (uint8_t ram = 0; ram < sizeof(sizes) / sizeof(sizes[0]); ram++)
+	{
+		if (page->mem >= rams[ram] && page->mem < rams[ram] + sizes[ram])
+		{
+			uint32_t offset = page->mem - rams[ram];
+			entry->ram = ram;
+			entry->offset = offset;
+			entry->size = (sizes[ram] - offset < page->write_limit) ? sizes[ram] - offset : page->write_limit;
+			return TRUE;
+		}
+	}
+	
+	return FALSE;
+}
+
+static uint8_t *
+rewind_ram_ (Pilot_system *sys, const pilot_rewind_page *entry)
+{
+	uint8_t *rams[] = {sys->wram, sys->vram, sys->tmram, sys->oam, sys->hram};
+	return rams[entry->ram] + entry->offset;
+}
+
+static size_t
+rewind_record_size_ (Pilot_cpu *cpu, bool keyframe, uint32_t *num_pages)
+{
+	Pilot_mem_map *map = &cpu->sys.mem_map;
+	size_t size = sizeof(pilot_rewind_record);
+	
+	*num_pages = 0;
+	if (keyframe)
+	{
+		return REWIND_ALIGN_(size + Pilot_savestate_size(cpu, PILOT_SAVESTATE_ALL));
+	}
+	
+	size += Pilot_savestate_size(cpu, PILOT_SAVESTATE_NO_RAM);
+	for (uint32_t i = 0; i < map->num_dirty; i++)
+	{
+		pilot_rewind_page entry;
+		if (rewind_page_ram_(&cpu->sys, &map->pages[map->dirty_pages[i]], &entry))
+		{
+			size += sizeof(entry) + entry.size;
+			(*num_pages)++;
+		}
+	}
+	
+	return REWIND_ALIGN_(size);
+}
+
+static void
+rewind_drop_oldest_ (Pilot_rewind *rw)
+{
+	rw->head = rewind_record_(rw, rw->head)->next;
+	rw->num_frames--;
+}
+
+// Finds room for a record after the newest one, dropping the oldest frames in the way
+static size_t
+rewind_place_ (Pilot_rewind *rw, size_t size)
+{
+	size_t pos = 0;
+	if (rw->num_frames)
+	{
+		pos = rw->tail + rewind_record_(rw, rw->tail)->size;
+	}
+	if (pos + size > rw->size)
+	{
+		pos = 0;
+	}
+	
+	while (rw->num_frames && rw->head >= pos && rw->head < pos + size)
+	{
+		rewind_drop_oldest_(rw);
+	}
+	
+	// frames before the oldest keyframe can't be rebuilt
+	while (rw->num_frames && !rewind_record_(rw, rw->head)->keyframe)
+	{
+		rewind_drop_oldest_(rw);
+	}
+	
+	return pos;
+}
+
+void
+Pilot_rewind_init (Pilot_rewind *rw, uint8_t *buf, size_t size, uint32_t keyframe_interval)
+{
+	memset(rw, 0, sizeof(*rw));
+	rw->buf = buf;
+	rw->size = size;
+	rw->keyframe_interval = keyframe_interval ? keyframe_interval : 1;
+}
+
+bool
+Pilot_rewind_push (Pilot_rewind *rw, Pilot_cpu *cpu)
+{
+	Pilot_mem_map *map = &cpu->sys.mem_map;
+	bool keyframe = !rw->num_frames || rw->since_keyframe + 1 >= rw->keyframe_interval;
+	uint32_t num_pages;
+	size_t size;
+	size_t pos;
+	
+	while (TRUE)
+	{
+		size = rewind_record_size_(cpu, keyframe, &num_pages);
+		if (size > rw->size)
+		{
+			return FALSE;
+		}
+		
+		pos = rewind_place_(rw, size);
+		if (keyframe || rw->num_frames)
+		{
+			break;
+		}
+		
+		// everything this frame would have been built on was dropped
+		keyframe = TRUE;
+	}
+	
+	pilot_rewind_record *record = rewind_record_(rw, pos);
+	record->size = size;
+	record->prev = rw->tail;
+	record->next = 0;
+	record->keyframe = keyframe;
+	record->num_pages = num_pages;
+	
+	uint8_t *data = rw->buf + pos + sizeof(*record);
+	size_t state_size = Pilot_savestate_size(cpu, keyframe ? PILOT_SAVESTATE_ALL : PILOT_SAVESTATE_NO_RAM);
+	record->state_size = Pilot_savestate_save(cpu, keyframe ? PILOT_SAVESTATE_ALL : PILOT_SAVESTATE_NO_RAM, data, state_size);
+	data += state_size;
+	
+	for (uint32_t i = 0; i < map->num_dirty && !keyframe; i++)
+	{
+		pilot_rewind_page entry;
+		if (rewind_page_ram_(&cpu->sys, &map->pages[map->dirty_pages[i]], &entry))
+		{
+			memcpy(data, &entry, sizeof(entry));
+			memcpy(data + sizeof(entry), rewind_ram_(&cpu->sys, &entry), entry.size);
+			data += sizeof(entry) + entry.size;
+		}
+	}
+	
+	if (rw->num_frames)
+	{
+		rewind_record_(rw, rw->tail)->next = pos;
+	}
+	else
+	{
+		rw->head = pos;
+	}
+	rw->tail = pos;
+	rw->num_frames++;
+	rw->since_keyframe = keyframe ? 0 : rw->since_keyframe + 1;
+	rw->at_tail = FALSE;
+	
+	Pilot_mem_dirty_clear(&cpu->sys);
+	return TRUE;
+}
+
+static void
+rewind_apply_pages_ (Pilot_rewind *rw, Pilot_cpu *cpu, size_t pos)
+{
+	pilot_rewind_record *record = rewind_record_(rw, pos);
+	const uint8_t *data = rw->buf + pos + sizeof(*record) + record->state_size;
+	
+	for (uint32_t i = 0; i < record->num_pages; i++)
+	{
+		pilot_rewind_page entry;
+		memcpy(&entry, data, sizeof(entry));
+		memcpy(rewind_ram_(&cpu->sys, &entry), data + sizeof(entry), entry.size);
+		data += sizeof(entry) + entry.size;
+	}
+}
+
+bool
+Pilot_rewind_step_back (Pilot_rewind *rw, Pilot_cpu *cpu)
+{
+	size_t tail = rw->tail;
+	uint32_t num_frames = rw->num_frames;
+	
+	if (rw->at_tail)
+	{
+		if (num_frames < 2)
+		{
+			return FALSE;
+		}
+		
+		tail = rewind_record_(rw, tail)->prev;
+		num_frames--;
+	}
+	else if (!num_frames)
+	{
+		return FALSE;
+	}
+	
+	size_t key = tail;
+	uint32_t since_keyframe = 0;
+	while (!rewind_record_(rw, key)->keyframe)
+	{
+		key = rewind_record_(rw, key)->prev;
+		since_keyframe++;
+	}
+	
+	// both states are checked before either is loaded, so a bad one leaves the machine as it was
+	pilot_rewind_record *record = rewind_record_(rw, tail);
+	if (key != tail && !Pilot_savestate_check(cpu, rw->buf + tail + sizeof(*record), record->state_size))
+	{
+		return FALSE;
+	}
+	
+	record = rewind_record_(rw, key);
+	if (!Pilot_savestate_load(cpu, rw->buf + key + sizeof(*record), record->state_size))
+	{
+		return FALSE;
+	}
+	
+	if (key != tail)
+	{
+		for (size_t pos = key; pos != tail; )
+		{
+			pos = rewind_record_(rw, pos)->next;
+			rewind_apply_pages_(rw, cpu, pos);
+		}
+		
+		record = rewind_record_(rw, tail);
+		if (!Pilot_savestate_load(cpu, rw->buf + tail + sizeof(*record), record->state_size))
+		{
+			return FALSE;
+		}
+	}
+	
+	rw->tail = tail;
+	rw->num_frames = num_frames;
+	rw->since_keyframe = since_keyframe;
+	
+	// RAM now matches the newest frame, so the next one only has to record what changes from here
+	Pilot_mem_dirty_clear(&cpu->sys);
+	rw->at_tail = TRUE;
+	return TRUE;
+}
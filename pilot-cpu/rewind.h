@@ -0,0 +1,40 @@
+#ifndef __REWIND_H__
+#define __REWIND_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "types.h"
+#include "cpu.h"
+
+// Frame history kept in a caller-supplied ring buffer. Every pushed frame stores the CPU and pipeline
+// state plus the RAM pages written since the previous frame; every keyframe_interval-th frame is a
+// keyframe holding all of RAM. The oldest frames are dropped to make room.
+typedef struct
+{
+	uint8_t *buf;
+	size_t size;
+	uint32_t keyframe_interval;
+	
+	// Offsets of the oldest and newest records
+	size_t head;
+	size_t tail;
+	uint32_t num_frames;
+	// Frames pushed since the newest keyframe
+	uint32_t since_keyframe;
+	
+	// Set while the machine is in the state of the newest frame, after stepping back
+	bool at_tail;
+} Pilot_rewind;
+
+void Pilot_rewind_init (Pilot_rewind *rw, uint8_t *buf, size_t size, uint32_t keyframe_interval);
+
+// Records the machine's current state as a new frame
+// Returns FALSE if the frame doesn't fit in the buffer even on its own
+bool Pilot_rewind_push (Pilot_rewind *rw, Pilot_cpu *cpu);
+
+// Puts the machine back into the state of the newest frame; once it's there, drops that frame and goes
+// back one more. Returns FALSE, changing nothing, if there's nothing older to go back to or a stored
+// state won't load
+bool Pilot_rewind_step_back (Pilot_rewind *rw, Pilot_cpu *cpu);
+
+#endif
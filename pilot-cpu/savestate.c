@@ -0,0 +1,645 @@
+#include "savestate.h"
+#include "cpu_mucode.h"
+#include "memory.h"
+#include <string.h>
+
+/*
+ * Save state format (all header fields little-endian):
+ *
+ * magic, version, layout signature, total size     4 x uint32
+ * then for each section: id, payload size          2 x uint32, followed by the payload
+ *
+ * Sections are read by id, so their order doesn't matter and unknown ones are skipped. Every section
+ * this version knows about has to be present with exactly the expected size (the RAM sections may be
+ * left out altogether), and everything is checked before the machine is touched.
+ *
+ * Pointers are never stored. The execute stage's control word, control status and microcode entry,
+ * and the decoded instruction on the interconnect, are stored as links (which field or which microcode
+ * ROM entry they point at) and fixed up after everything else has been loaded.
+ */
+
+#define SAVESTATE_ID_(a, b, c, d)	((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+#define SAVESTATE_MAGIC	SAVESTATE_ID_('P', 'L', 'S', 'T')
+#define SAVESTATE_HEADER_SIZE	16
+#define SAVESTATE_SECTION_HEADER_SIZE	8
+
+// Reads or writes (or just measures) one save state
+typedef struct
+{
+	bool loading;
+	// NULL when measuring
+	uint8_t *out;
+	const uint8_t *in;
+	size_t size;
+	size_t pos;
+} savestate_io;
+
+enum
+{
+	SS_LINK_NONE = 0,
+	SS_LINK_CORE_OP,
+	SS_LINK_MUCODE,
+	SS_LINK_DECODER
+};
+
+#define SS_MUCODE_NONE	UINT32_MAX
+
+typedef struct
+{
+	uint8_t decoded_inst;
+	uint8_t control;
+	uint8_t control_status;
+	uint32_t mucode_decoded;
+} savestate_links;
+
+static void
+savestate_bytes_ (savestate_io *io, void *data, size_t len)
+{
+	if (io->loading)
+	{
+		// bounds have already been checked
+		memcpy(data, io->in + io->pos, len);
+	}
+	else if (io->out && io->pos + len <= io->size)
+	{
+		memcpy(io->out + io->pos, data, len);
+	}
+	io->pos += len;
+}
+
+#define SAVESTATE_FIELD_(io, field)	savestate_bytes_((io), &(field), sizeof(field))
+
+static void
+savestate_u32_ (savestate_io *io, uint32_t *value)
+{
+	uint8_t bytes[4] = {*value, *value >> 8, *value >> 16, *value >> 24};
+	savestate_bytes_(io, bytes, sizeof(bytes));
+	*value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static uint32_t
+savestate_get_u32_ (const uint8_t *buf)
+{
+	return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+#define SAVESTATE_OFFSET_(type, member)	((uint32_t)offsetof(type, member))
+
+// Identifies the layout of everything stored raw, byte order included: the size of each structure, and
+// where each of its members is in it (structures that are only ever stored member by member just need
+// their size, as a member that changes size changes the size of its section)
+static uint32_t
+savestate_layout_ (void)
+{
+	const uint32_t layout[] =
+	{
+		0x01020304,
+		sizeof(Pilot_cpu_regs),
+		sizeof(Pilot_memctl),
+		sizeof(pilot_interconnect),
+		sizeof(inst_decoded_flags),
+		sizeof(execute_control_word),
+		sizeof(alu_src_control),
+		sizeof(alu_operand_access),
+		sizeof(execute_control_status),
+		sizeof(mucode_entry_spec),
+		sizeof(pilot_fetch_state),
+		sizeof(Pilot_exec_mode),
+		
+		SAVESTATE_OFFSET_(Pilot_cpu_regs, regs),
+		SAVESTATE_OFFSET_(Pilot_cpu_regs, wf),
+		SAVESTATE_OFFSET_(Pilot_cpu_regs, pgc),
+		SAVESTATE_OFFSET_(Pilot_cpu_regs, repi),
+		SAVESTATE_OFFSET_(Pilot_cpu_regs, repr),
+		SAVESTATE_OFFSET_(Pilot_cpu_regs, factor_a),
+		SAVESTATE_OFFSET_(Pilot_cpu_regs, factor_b),
+		SAVESTATE_OFFSET_(Pilot_cpu_regs, latch_aux),
+		SAVESTATE_OFFSET_(Pilot_cpu_regs, disable_clk),
+		SAVESTATE_OFFSET_(Pilot_memctl, state),
+		SAVESTATE_OFFSET_(Pilot_memctl, is_16bit),
+		SAVESTATE_OFFSET_(Pilot_memctl, is_24bit),
+		SAVESTATE_OFFSET_(Pilot_memctl, is_write),
+		SAVESTATE_OFFSET_(Pilot_memctl, low_done),
+		SAVESTATE_OFFSET_(Pilot_memctl, addr_reg),
+		SAVESTATE_OFFSET_(Pilot_memctl, data_reg_in),
+		SAVESTATE_OFFSET_(Pilot_memctl, data_reg_out),
+		SAVESTATE_OFFSET_(Pilot_memctl, data_cycle),
+		SAVESTATE_OFFSET_(pilot_interconnect, fetch_word_semaph),
+		SAVESTATE_OFFSET_(pilot_interconnect, fetch_addr),
+		SAVESTATE_OFFSET_(pilot_interconnect, fetch_word),
+		SAVESTATE_OFFSET_(pilot_interconnect, decode_branch),
+		SAVESTATE_OFFSET_(pilot_interconnect, decode_branch_addr),
+		SAVESTATE_OFFSET_(pilot_interconnect, decode_stall),
+		SAVESTATE_OFFSET_(pilot_interconnect, decoded_inst_semaph),
+		SAVESTATE_OFFSET_(pilot_interconnect, decoded_inst),
+		SAVESTATE_OFFSET_(pilot_interconnect, execute_branch),
+		SAVESTATE_OFFSET_(pilot_interconnect, execute_branch_addr),
+		SAVESTATE_OFFSET_(pilot_interconnect, execute_memory_backoff),
+		SAVESTATE_OFFSET_(inst_decoded_flags, imm_words),
+		SAVESTATE_OFFSET_(inst_decoded_flags, inst_pgc),
+		SAVESTATE_OFFSET_(inst_decoded_flags, inst_length),
+		SAVESTATE_OFFSET_(inst_decoded_flags, next_pgc),
+		SAVESTATE_OFFSET_(inst_decoded_flags, run_before),
+		SAVESTATE_OFFSET_(inst_decoded_flags, core_op),
+		SAVESTATE_OFFSET_(inst_decoded_flags, run_after),
+		SAVESTATE_OFFSET_(inst_decoded_flags, repeat_op),
+		SAVESTATE_OFFSET_(inst_decoded_flags, interrupt),
+		SAVESTATE_OFFSET_(inst_decoded_flags, interrupt_cond),
+		SAVESTATE_OFFSET_(inst_decoded_flags, rm2_offset),
+		SAVESTATE_OFFSET_(inst_decoded_flags, inst_class),
+		SAVESTATE_OFFSET_(inst_decoded_flags, operand_regs),
+		SAVESTATE_OFFSET_(inst_decoded_flags, operand_imms),
+		SAVESTATE_OFFSET_(inst_decoded_flags, restart),
+		SAVESTATE_OFFSET_(inst_decoded_flags, div_zero),
+		SAVESTATE_OFFSET_(inst_decoded_flags, illegal),
+		SAVESTATE_OFFSET_(inst_decoded_flags, disable_clk),
+		SAVESTATE_OFFSET_(execute_control_word, srcs),
+		SAVESTATE_OFFSET_(execute_control_word, dest),
+		SAVESTATE_OFFSET_(execute_control_word, src_access),
+		SAVESTATE_OFFSET_(execute_control_word, dest_access),
+		SAVESTATE_OFFSET_(execute_control_word, alu_kernel),
+		SAVESTATE_OFFSET_(execute_control_word, operation),
+		SAVESTATE_OFFSET_(execute_control_word, src2_add1),
+		SAVESTATE_OFFSET_(execute_control_word, src2_add_carry),
+		SAVESTATE_OFFSET_(execute_control_word, src2_negate),
+		SAVESTATE_OFFSET_(execute_control_word, src2_and_with_aux),
+		SAVESTATE_OFFSET_(execute_control_word, shifter_mode),
+		SAVESTATE_OFFSET_(execute_control_word, latch_aux_mode),
+		SAVESTATE_OFFSET_(execute_control_word, flag_write_mask),
+		SAVESTATE_OFFSET_(execute_control_word, invert_carries),
+		SAVESTATE_OFFSET_(execute_control_word, flag_z_mode),
+		SAVESTATE_OFFSET_(execute_control_word, flag_v_mode),
+		SAVESTATE_OFFSET_(execute_control_word, mem_latch_ctl),
+		SAVESTATE_OFFSET_(execute_control_word, mem_access_suppress),
+		SAVESTATE_OFFSET_(execute_control_word, mem_write_ctl),
+		SAVESTATE_OFFSET_(execute_control_word, is_16bit),
+		SAVESTATE_OFFSET_(execute_control_word, is_24bit),
+		SAVESTATE_OFFSET_(execute_control_word, is_24bit_high),
+		SAVESTATE_OFFSET_(alu_src_control, location),
+		SAVESTATE_OFFSET_(alu_src_control, size),
+		SAVESTATE_OFFSET_(alu_src_control, sign_extend),
+		SAVESTATE_OFFSET_(alu_operand_access, kind),
+		SAVESTATE_OFFSET_(alu_operand_access, index),
+		SAVESTATE_OFFSET_(alu_operand_access, shift),
+		SAVESTATE_OFFSET_(alu_operand_access, mask),
+		SAVESTATE_OFFSET_(execute_control_status, alu_done),
+		SAVESTATE_OFFSET_(execute_control_status, mem_done),
+		SAVESTATE_OFFSET_(mucode_entry_spec, entry_idx),
+		SAVESTATE_OFFSET_(mucode_entry_spec, reg_select),
+		SAVESTATE_OFFSET_(mucode_entry_spec, size),
+		SAVESTATE_OFFSET_(mucode_entry_spec, is_write),
+		SAVESTATE_OFFSET_(mucode_entry_spec, mem_access_suppress)
+	};
+	const uint8_t *bytes = (const uint8_t *)layout;
+	uint32_t hash = 0x811c9dc5;
+	
+	for (size_t i = 0; i < sizeof(layout); i++)
+	{
+		hash = (hash ^ bytes[i]) * 0x01000193;
+	}
+	
+	return hash;
+}
+
+static void
+savestate_links_get_ (const Pilot_cpu *cpu, savestate_links *links)
+{
+	const pilot_execute_state *execute = &cpu->execute;
+	
+	links->decoded_inst = cpu->sys.interconnects.decoded_inst ? SS_LINK_DECODER : SS_LINK_NONE;
+	links->mucode_decoded = execute->mucode_decoded ? mucode_rom_index(execute->mucode_decoded) : SS_MUCODE_NONE;
+	
+	links->control = SS_LINK_NONE;
+	if (execute->control == &execute->decoded_inst.core_op)
+	{
+		links->control = SS_LINK_CORE_OP;
+	}
+	else if (execute->control)
+	{
+		links->control = SS_LINK_MUCODE;
+	}
+	
+	links->control_status = SS_LINK_NONE;
+	if (execute->control_status == &execute->core_op_status)
+	{
+		links->control_status = SS_LINK_CORE_OP;
+	}
+	else if (execute->control_status)
+	{
+		links->control_status = SS_LINK_MUCODE;
+	}
+}
+
+static bool
+savestate_links_valid_ (const savestate_links *links)
+{
+	if (links->decoded_inst != SS_LINK_NONE && links->decoded_inst != SS_LINK_DECODER)
+	{
+		return FALSE;
+	}
+	if (links->control > SS_LINK_MUCODE || links->control_status > SS_LINK_MUCODE)
+	{
+		return FALSE;
+	}
+	if (links->mucode_decoded == SS_MUCODE_NONE)
+	{
+		return links->control != SS_LINK_MUCODE;
+	}
+	
+	return mucode_rom_entry(links->mucode_decoded) != NULL;
+}
+
+static void
+savestate_links_apply_ (Pilot_cpu *cpu, const savestate_links *links)
+{
+	pilot_execute_state *execute = &cpu->execute;
+	
+	cpu->sys.interconnects.decoded_inst = (links->decoded_inst == SS_LINK_DECODER) ? &cpu->decode.decoded_inst : NULL;
+	execute->mucode_decoded = (links->mucode_decoded == SS_MUCODE_NONE) ? NULL : mucode_rom_entry(links->mucode_decoded);
+	
+	switch (links->control)
+	{
+		case SS_LINK_CORE_OP:
+			execute->control = &execute->decoded_inst.core_op;
+			break;
+		case SS_LINK_MUCODE:
+			execute->control = &execute->mucode_decoded->operation;
+			break;
+		default:
+			execute->control = NULL;
+			break;
+	}
+	
+	switch (links->control_status)
+	{
+		case SS_LINK_CORE_OP:
+			execute->control_status = &execute->core_op_status;
+			break;
+		case SS_LINK_MUCODE:
+			execute->control_status = &execute->mucode_status;
+			break;
+		default:
+			execute->control_status = NULL;
+			break;
+	}
+}
+
+static void
+savestate_system_ (savestate_io *io, Pilot_cpu *cpu)
+{
+	Pilot_system *sys = &cpu->sys;
+	
+	// flags still pending aren't part of the state, so F is stored with them worked out
+	Pilot_cpu_regs core = sys->core;
+	if (!io->loading)
+	{
+		core.wf = pilot_execute_flags_value(&cpu->execute);
+	}
+	SAVESTATE_FIELD_(io, core);
+	SAVESTATE_FIELD_(io, sys->memctl);
+	SAVESTATE_FIELD_(io, sys->cycles);
+	
+	// the decoded instruction pointer is a link
+	pilot_interconnect interconnects = sys->interconnects;
+	interconnects.decoded_inst = NULL;
+	SAVESTATE_FIELD_(io, interconnects);
+	
+	if (io->loading)
+	{
+		sys->core = core;
+		sys->interconnects = interconnects;
+	}
+	
+	SAVESTATE_FIELD_(io, cpu->exec_mode);
+	SAVESTATE_FIELD_(io, cpu->exec_mode_requested);
+	SAVESTATE_FIELD_(io, cpu->fast_pgc);
+}
+
+static void
+savestate_links_ (savestate_io *io, Pilot_cpu *cpu, savestate_links *links)
+{
+	if (!io->loading)
+	{
+		savestate_links_get_(cpu, links);
+	}
+	
+	SAVESTATE_FIELD_(io, links->decoded_inst);
+	SAVESTATE_FIELD_(io, links->control);
+	SAVESTATE_FIELD_(io, links->control_status);
+	savestate_u32_(io, &links->mucode_decoded);
+}
+
+static void
+savestate_fetch_ (savestate_io *io, Pilot_cpu *cpu)
+{
+	pilot_fetch_state *fetch = &cpu->fetch;
+	
+	SAVESTATE_FIELD_(io, fetch->queue_words);
+	SAVESTATE_FIELD_(io, fetch->queue_head);
+	SAVESTATE_FIELD_(io, fetch->queue_tail);
+	SAVESTATE_FIELD_(io, fetch->queue_full);
+	SAVESTATE_FIELD_(io, fetch->mem_addr);
+	SAVESTATE_FIELD_(io, fetch->mem_access_waiting);
+	SAVESTATE_FIELD_(io, fetch->fetch_phase);
+}
+
+static void
+savestate_decode_ (savestate_io *io, Pilot_cpu *cpu)
+{
+	pilot_decode_state *decode = &cpu->decode;
+	
+	// in fast mode the execute stage may have been handed an instruction out of the decode cache;
+	// it's stored as the decoder's own output, which is where the link points after loading
+	inst_decoded_flags *decoded_inst = &decode->decoded_inst;
+	if (!io->loading && cpu->sys.interconnects.decoded_inst)
+	{
+		decoded_inst = cpu->sys.interconnects.decoded_inst;
+	}
+	
+	SAVESTATE_FIELD_(io, decode->work_regs);
+	SAVESTATE_FIELD_(io, *decoded_inst);
+	SAVESTATE_FIELD_(io, decode->pgc);
+	SAVESTATE_FIELD_(io, decode->inst_length);
+	SAVESTATE_FIELD_(io, decode->words_to_read);
+	SAVESTATE_FIELD_(io, decode->branch_predicted);
+	SAVESTATE_FIELD_(io, decode->decoding_phase);
+	SAVESTATE_FIELD_(io, decode->rm_ops);
+	SAVESTATE_FIELD_(io, decode->no_cache);
+}
+
+static void
+savestate_execute_ (savestate_io *io, Pilot_cpu *cpu)
+{
+	pilot_execute_state *execute = &cpu->execute;
+	
+	SAVESTATE_FIELD_(io, execute->decoded_inst);
+	SAVESTATE_FIELD_(io, execute->mucode_control);
+	SAVESTATE_FIELD_(io, execute->core_op_status);
+	SAVESTATE_FIELD_(io, execute->mucode_status);
+	SAVESTATE_FIELD_(io, execute->repeat_type);
+	SAVESTATE_FIELD_(io, execute->branched);
+	SAVESTATE_FIELD_(io, execute->branch_addr);
+	SAVESTATE_FIELD_(io, execute->alu_input_latches);
+	SAVESTATE_FIELD_(io, execute->alu_src2_sign_extend);
+	SAVESTATE_FIELD_(io, execute->alu_output_latch);
+	SAVESTATE_FIELD_(io, execute->alu_shifter_carry_bit);
+	SAVESTATE_FIELD_(io, execute->used_z);
+	SAVESTATE_FIELD_(io, execute->mem_addr);
+	SAVESTATE_FIELD_(io, execute->mem_data);
+	SAVESTATE_FIELD_(io, execute->mem_access_waiting);
+	SAVESTATE_FIELD_(io, execute->mem_access_was_read);
+	SAVESTATE_FIELD_(io, execute->mem_sync_data);
+	SAVESTATE_FIELD_(io, execute->mem_high_done);
+	SAVESTATE_FIELD_(io, execute->inst_latched);
+	SAVESTATE_FIELD_(io, execute->repeat_latched);
+	SAVESTATE_FIELD_(io, execute->repeat_iterations);
+	SAVESTATE_FIELD_(io, execute->repeat_mark);
+	SAVESTATE_FIELD_(io, execute->repeat_cycle);
+	SAVESTATE_FIELD_(io, execute->repeat_regs);
+	SAVESTATE_FIELD_(io, execute->execution_phase);
+	SAVESTATE_FIELD_(io, execute->sequencer_phase);
+}
+
+enum
+{
+	SS_SECT_SYSTEM = 0,
+	SS_SECT_LINKS,
+	SS_SECT_FETCH,
+	SS_SECT_DECODE,
+	SS_SECT_EXECUTE,
+	SS_SECT_WRAM,
+	SS_SECT_VRAM,
+	SS_SECT_TMRAM,
+	SS_SECT_OAM,
+	SS_SECT_HRAM,
+	
+	SS_NUM_SECTS
+};
+
+#define SS_SECT_IS_RAM_(sect)	((sect) >= SS_SECT_WRAM)
+
+static const uint32_t savestate_ids_[SS_NUM_SECTS] =
+{
+	[SS_SECT_SYSTEM] = SAVESTATE_ID_('S', 'Y', 'S', ' '),
+	[SS_SECT_LINKS] = SAVESTATE_ID_('L', 'I', 'N', 'K'),
+	[SS_SECT_FETCH] = SAVESTATE_ID_('F', 'E', 'T', 'C'),
+	[SS_SECT_DECODE] = SAVESTATE_ID_('D', 'E', 'C', 'O'),
+	[SS_SECT_EXECUTE] = SAVESTATE_ID_('E', 'X', 'E', 'C'),
+	[SS_SECT_WRAM] = SAVESTATE_ID_('W', 'R', 'A', 'M'),
+	[SS_SECT_VRAM] = SAVESTATE_ID_('V', 'R', 'A', 'M'),
+	[SS_SECT_TMRAM] = SAVESTATE_ID_('T', 'M', 'R', 'M'),
+	[SS_SECT_OAM] = SAVESTATE_ID_('O', 'A', 'M', ' '),
+	[SS_SECT_HRAM] = SAVESTATE_ID_('H', 'R', 'A', 'M')
+};
+
+static void
+savestate_section_ (savestate_io *io, Pilot_cpu *cpu, int sect, savestate_links *links)
+{
+	switch (sect)
+	{
+		case SS_SECT_SYSTEM:
+			savestate_system_(io, cpu);
+			break;
+		case SS_SECT_LINKS:
+			savestate_links_(io, cpu, links);
+			break;
+		case SS_SECT_FETCH:
+			savestate_fetch_(io, cpu);
+			break;
+		case SS_SECT_DECODE:
+			savestate_decode_(io, cpu);
+			break;
+		case SS_SECT_EXECUTE:
+			savestate_execute_(io, cpu);
+			break;
+		case SS_SECT_WRAM:
+			SAVESTATE_FIELD_(io, cpu->sys.wram);
+			break;
+		case SS_SECT_VRAM:
+			SAVESTATE_FIELD_(io, cpu->sys.vram);
+			break;
+		case SS_SECT_TMRAM:
+			SAVESTATE_FIELD_(io, cpu->sys.tmram);
+			break;
+		case SS_SECT_OAM:
+			SAVESTATE_FIELD_(io, cpu->sys.oam);
+			break;
+		case SS_SECT_HRAM:
+			SAVESTATE_FIELD_(io, cpu->sys.hram);
+			break;
+	}
+}
+
+// Payload size of a section; they're all fixed
+static size_t
+savestate_section_size_ (Pilot_cpu *cpu, int sect)
+{
+	savestate_io io = {FALSE, NULL, NULL, 0, 0};
+	savestate_links links;
+	
+	savestate_section_(&io, cpu, sect, &links);
+	return io.pos;
+}
+
+static int
+savestate_find_section_ (uint32_t id)
+{
+	for (int sect = 0; sect < SS_NUM_SECTS; sect++)
+	{
+		if (savestate_ids_[sect] == id)
+		{
+			return sect;
+		}
+	}
+	
+	return -1;
+}
+
+// Writes a whole save state, or measures it if io->out is NULL. cpu is only read from; it isn't const
+// because loading goes through the same section functions
+static void
+savestate_write_ (savestate_io *io, Pilot_cpu *cpu, Pilot_savestate_flags flags)
+{
+	uint32_t magic = SAVESTATE_MAGIC;
+	uint32_t version = PILOT_SAVESTATE_VERSION;
+	uint32_t layout = savestate_layout_();
+	uint32_t total = 0;
+	savestate_links links;
+	
+	savestate_u32_(io, &magic);
+	savestate_u32_(io, &version);
+	savestate_u32_(io, &layout);
+	size_t total_pos = io->pos;
+	savestate_u32_(io, &total);
+	
+	for (int sect = 0; sect < SS_NUM_SECTS; sect++)
+	{
+		if ((flags & PILOT_SAVESTATE_NO_RAM) && SS_SECT_IS_RAM_(sect))
+		{
+			continue;
+		}
+		
+		uint32_t id = savestate_ids_[sect];
+		uint32_t size = savestate_section_size_(cpu, sect);
+		
+		savestate_u32_(io, &id);
+		savestate_u32_(io, &size);
+		savestate_section_(io, cpu, sect, &links);
+	}
+	
+	total = io->pos;
+	io->pos = total_pos;
+	savestate_u32_(io, &total);
+	io->pos = total;
+}
+
+size_t
+Pilot_savestate_size (const Pilot_cpu *cpu, Pilot_savestate_flags flags)
+{
+	savestate_io io = {FALSE, NULL, NULL, 0, 0};
+	
+	savestate_write_(&io, (Pilot_cpu *)cpu, flags);
+	return io.pos;
+}
+
+size_t
+Pilot_savestate_save (const Pilot_cpu *cpu, Pilot_savestate_flags flags, uint8_t *buf, size_t size)
+{
+	savestate_io io = {FALSE, buf, NULL, size, 0};
+	
+	savestate_write_(&io, (Pilot_cpu *)cpu, flags);
+	return (io.pos <= size) ? io.pos : 0;
+}
+
+// Finds where each section of buf starts, and reads the links; returns FALSE if this build can't load it
+static bool
+savestate_check_ (Pilot_cpu *cpu, const uint8_t *buf, size_t size, size_t offsets[SS_NUM_SECTS], savestate_links *links)
+{
+	if (size < SAVESTATE_HEADER_SIZE
+		|| savestate_get_u32_(buf) != SAVESTATE_MAGIC
+		|| savestate_get_u32_(buf + 4) != PILOT_SAVESTATE_VERSION
+		|| savestate_get_u32_(buf + 8) != savestate_layout_()
+		|| savestate_get_u32_(buf + 12) != size)
+	{
+		return FALSE;
+	}
+	
+	for (size_t pos = SAVESTATE_HEADER_SIZE; pos < size; )
+	{
+		if (size - pos < SAVESTATE_SECTION_HEADER_SIZE)
+		{
+			return FALSE;
+		}
+		
+		uint32_t id = savestate_get_u32_(buf + pos);
+		uint32_t sect_size = savestate_get_u32_(buf + pos + 4);
+		pos += SAVESTATE_SECTION_HEADER_SIZE;
+		if (sect_size > size - pos)
+		{
+			return FALSE;
+		}
+		
+		int sect = savestate_find_section_(id);
+		if (sect >= 0)
+		{
+			if (offsets[sect] || sect_size != savestate_section_size_(cpu, sect))
+			{
+				return FALSE;
+			}
+			offsets[sect] = pos;
+		}
+		pos += sect_size;
+	}
+	
+	for (int sect = 0; sect < SS_NUM_SECTS; sect++)
+	{
+		if (!offsets[sect] && !SS_SECT_IS_RAM_(sect))
+		{
+			return FALSE;
+		}
+	}
+	
+	savestate_io io = {TRUE, NULL, buf, size, offsets[SS_SECT_LINKS]};
+	savestate_links_(&io, cpu, links);
+	return savestate_links_valid_(links);
+}
+
+bool
+Pilot_savestate_check (const Pilot_cpu *cpu, const uint8_t *buf, size_t size)
+{
+	size_t offsets[SS_NUM_SECTS] = {0};
+	savestate_links links;
+	
+	return savestate_check_((Pilot_cpu *)cpu, buf, size, offsets, &links);
+}
+
+bool
+Pilot_savestate_load (Pilot_cpu *cpu, const uint8_t *buf, size_t size)
+{
+	size_t offsets[SS_NUM_SECTS] = {0};
+	savestate_links links;
+	
+	if (!savestate_check_(cpu, buf, size, offsets, &links))
+	{
+		return FALSE;
+	}
+	
+	savestate_io io = {TRUE, NULL, buf, size, 0};
+	for (int sect = 0; sect < SS_NUM_SECTS; sect++)
+	{
+		if (offsets[sect])
+		{
+			io.pos = offsets[sect];
+			savestate_section_(&io, cpu, sect, &links);
+		}
+	}
+	
+	savestate_links_apply_(cpu, &links);
+	cpu->execute.flags_pending = FALSE;
+	
+	// RAM was replaced behind the bus's back
+	Pilot_mem_code_invalidate(&cpu->sys);
+	
+	return TRUE;
+}
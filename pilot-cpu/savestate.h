@@ -0,0 +1,37 @@
+#ifndef __SAVESTATE_H__
+#define __SAVESTATE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "types.h"
+#include "cpu.h"
+
+// Bumped whenever the layout of a section changes
+#define PILOT_SAVESTATE_VERSION	10
+
+// A save state holds the registers, memory controller, pipeline stages and RAM of a Pilot_cpu.
+// It doesn't hold anything the host sets up: the memory map and handlers, bus trace settings and
+// scheduled events stay as they are in the machine being loaded into (sys.cycles does go back, so
+// events may need re-arming). Pipeline state is stored in host layout, so a save state only loads
+// into a build with the same structure layout; anything else is rejected.
+
+typedef enum
+{
+	PILOT_SAVESTATE_ALL = 0,
+	// Leave out the RAM regions; loading such a state leaves RAM as it is
+	PILOT_SAVESTATE_NO_RAM = 1 << 0
+} Pilot_savestate_flags;
+
+// Exact size of a save state of this machine
+size_t Pilot_savestate_size (const Pilot_cpu *cpu, Pilot_savestate_flags flags);
+
+// Returns the number of bytes written, or 0 if buf is too small
+size_t Pilot_savestate_save (const Pilot_cpu *cpu, Pilot_savestate_flags flags, uint8_t *buf, size_t size);
+
+// Whether Pilot_savestate_load would take buf, without loading it
+bool Pilot_savestate_check (const Pilot_cpu *cpu, const uint8_t *buf, size_t size);
+
+// Returns FALSE, leaving the machine untouched, if buf isn't a save state this build can load
+bool Pilot_savestate_load (Pilot_cpu *cpu, const uint8_t *buf, size_t size);
+
+#endif
@@ -0,0 +1,94 @@
+#include "scheduler.h"
+
+static void
+sched_update_next_ (Pilot_scheduler *sched)
+{
+	sched->next_cycle = UINT64_MAX;
+	
+	for (int i = 0; i < sched->num_events; i++)
+	{
+		if (sched->events[i].cycle < sched->next_cycle)
+		{
+			sched->next_cycle = sched->events[i].cycle;
+		}
+	}
+}
+
+void
+Pilot_sched_init (Pilot_system *sys)
+{
+	sys->sched.num_events = 0;
+	sys->sched.next_cycle = UINT64_MAX;
+}
+
+bool
+Pilot_sched_add (Pilot_system *sys, uint64_t cycle, Pilot_event_callback callback, void *ctx)
+{
+	Pilot_scheduler *sched = &sys->sched;
+	
+	if (sched->num_events == PILOT_MAX_EVENTS)
+	{
+		return FALSE;
+	}
+	
+	sched->events[sched->num_events++] = (Pilot_event){cycle, callback, ctx};
+	
+	if (cycle < sched->next_cycle)
+	{
+		sched->next_cycle = cycle;
+	}
+	
+	return TRUE;
+}
+
+void
+Pilot_sched_cancel (Pilot_system *sys, Pilot_event_callback callback, void *ctx)
+{
+	Pilot_scheduler *sched = &sys->sched;
+	
+	for (int i = 0; i < sched->num_events; )
+	{
+		if (sched->events[i].callback == callback && sched->events[i].ctx == ctx)
+		{
+			sched->events[i] = sched->events[--sched->num_events];
+		}
+		else
+		{
+			i++;
+		}
+	}
+	
+	sched_update_next_(sched);
+}
+
+void
+Pilot_sched_dispatch (Pilot_system *sys)
+{
+	Pilot_scheduler *sched = &sys->sched;
+	
+	while (sched->next_cycle <= sys->cycles)
+	{
+		int due = -1;
+		for (int i = 0; i < sched->num_events; i++)
+		{
+			if (sched->events[i].cycle == sched->next_cycle)
+			{
+				due = i;
+				break;
+			}
+		}
+		
+		if (due < 0)
+		{
+			sched_update_next_(sched);
+			continue;
+		}
+		
+		// take the event out first, so that its callback can schedule it again
+		Pilot_event event = sched->events[due];
+		sched->events[due] = sched->events[--sched->num_events];
+		sched_update_next_(sched);
+		
+		event.callback(sys, event.ctx);
+	}
+}
@@ -0,0 +1,22 @@
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <stdint.h>
+#include "types.h"
+#include "pilot.h"
+
+// Timers, video lines, IRQ assertions and the like are scheduled as events on the system's cycle counter.
+// A halted core (core.disable_clk) sleeps straight through to the next event, so an event that should
+// wake it has to clear core.disable_clk from its callback.
+
+void Pilot_sched_init (Pilot_system *sys);
+
+// Returns FALSE if the event table is full
+bool Pilot_sched_add (Pilot_system *sys, uint64_t cycle, Pilot_event_callback callback, void *ctx);
+// Removes every pending event with this callback and context
+void Pilot_sched_cancel (Pilot_system *sys, Pilot_event_callback callback, void *ctx);
+
+// Runs every event that is due; the run loops call this whenever sys->cycles reaches sched.next_cycle
+void Pilot_sched_dispatch (Pilot_system *sys);
+
+#endif
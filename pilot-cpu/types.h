@@ -53,30 +53,53 @@ typedef enum
 	MU_ADJUST_PGC,
 	
 	// MULS / MULU setup steps
-	MU_MUL_LD_FACTOR_A,
-	MU_MUL_LD_PRODUCT_LO,
-	MU_MUL_LD_PRODUCT_HI,
+	MU_MUL_LD_FACTOR_A,		// factorA = r
+	MU_MUL_LD_PRODUCT_LO,		// r = factorB
+	MU_MUL_LD_PRODUCT_HI,		// R0 = 0
 	MU_MUL_LD_REPI,
 	
-	// MULS / MULU loop steps
-	MU_MUL_SHIFT_PRODUCT_LO_LEFT,
-	MU_MUL_SHIFT_PRODUCT_HI_LEFT,
-	MU_MUL_SHIFT_FACTOR_B_LEFT,
-	MU_MUL_ADD_PRODUCT_LO,
-	MU_MUL_ADD_PRODUCT_HI,
+	// MULS / MULU loop steps (the multiplier is shifted out of r as the product is shifted in)
+	MU_MUL_TEST_MULTIPLIER,		// aux = r & 1
+	MU_MUL_ADD_PRODUCT_HI,		// R0 = R0 + (factorA && aux); aux = carry
+	MU_MUL_SHIFT_PRODUCT_HI_RIGHT,	// R0 = aux:R0 >> 1; aux = R0 & 1
+	MU_MUL_SHIFT_PRODUCT_LO_RIGHT,	// r = aux:r >> 1
 	MU_MUL_LOOP,
 	
-	// DIV setup steps, maybe?
-	MU_DIV_TEST_DIVIDEND_HI,
-	MU_DIV_TEST_FACTOR_B,
+	// MULS sign correction steps
+	MU_MUL_TEST_FACTOR_A_SIGN,	// aux = sign of factorA
+	MU_MUL_SUB_FACTOR_B,		// R0 = R0 - (factorB && aux)
+	MU_MUL_TEST_FACTOR_B_SIGN,	// aux = sign of factorB
+	MU_MUL_SUB_FACTOR_A,		// R0 = R0 - (factorA && aux)
+	
+	// MULS / MULU final steps
+	MU_MUL_TEST_PRODUCT_LO,
+	MU_MUL_TEST_PRODUCT_HI,
+	
+	// DIVS / DIVU setup steps
+	MU_DIV_TEST_FACTOR_B,		// aux = (factorB == 0), from the core op
+	MU_DIV_TEST_DIVIDEND_SIGN,	// DIVS: aux = sign of R0
+	MU_DIV_NEG_DIVIDEND_TEST_LO,	// aux = (r != 0)
+	MU_DIV_NEG_DIVIDEND_HI,		// R0 = -(R0 + aux)
+	MU_DIV_NEG_DIVIDEND_LO,		// r = -r
+	MU_DIV_TEST_FACTOR_B_SIGN,	// DIVS: aux = sign of factorB
+	MU_DIV_NEG_FACTOR_B,		// factorB = -factorB
+	MU_DIV_TEST_DIVIDEND_HI,	// aux = (R0 >= factorB), i.e. the quotient doesn't fit
 	MU_DIV_LD_REPI,
 	
-	// DIVU loop steps (todo: sign handling, somehow??)
+	// DIVS / DIVU loop steps
 	MU_DIV_SHIFT_DIVIDEND_LO_LEFT,	// r = r << 1; aux = carry
-	MU_DIV_SHIFT_DIVIDEND_HI_LEFT,	// R0 = R0 << 1 | aux; VP = VP | carry
-	MU_DIV_SUB_FACTOR_B,		// R0 - factorB; aux = ~borrow
+	MU_DIV_SHIFT_DIVIDEND_HI_LEFT,	// R0 = R0 << 1 | aux; aux = ~carry
+	MU_DIV_SUB_FACTOR_B,		// R0 - factorB; aux = ~borrow || ~aux (the quotient bit)
 	MU_DIV_ADD_DIVIDEND_LO_CARRY,	// r = r + aux
 	MU_DIV_ST_DIVIDEND_HI,		// R0 = R0 - (factorB && aux)
+	MU_DIV_LOOP,
+	
+	// DIVS / DIVU final steps
+	MU_DIV_TEST_QUOTIENT_SIGN,	// DIVS, positive quotient: overflow if r is negative
+	MU_DIV_NEG_QUOTIENT,		// DIVS, negative quotient: r = -r; overflow if r is positive
+	MU_DIV_NEG_REMAINDER,		// DIVS, negative dividend: R0 = -R0
+	MU_DIV_TEST_QUOTIENT,
+	MU_DIV_OVERFLOW,		// V = 1
 	
 	// used for calls and exceptions/interrupts
 	MU_PUSH_PGC_IND_SP_AUTO,
@@ -92,14 +115,18 @@ typedef enum
 	MU_BR_HML_TEST_HML,	// JP hml / JR.L / CALL hml / CR.L (deferred resolution, since the specific type depends on bit 0 of HML)
 	MU_BR_HML_ADD_PGC,
 	MU_BR_DIV_ZERO,		// Divide by Zero Exception
-	MU_BR_ILLEGAL		// Illegal Instruction Exception
+	MU_BR_ILLEGAL,		// Illegal Instruction Exception
+	
+	// number of microcode entry points (used to size the microcode ROM)
+	MU_NUM_ENTRIES
 } mucode_entry_idx;
 
 typedef struct
 {
 	mucode_entry_idx entry_idx;
-	// bit 3: sign extend
-	// bit 4: RM operand number, or "first loop" flag for MULS
+	// bit 3: sign extend, or signed for MULS / DIVS
+	// bit 4: RM operand number
+	// in DIVS, bits 0 and 1 are set once the dividend and the divisor have been negated
 	// in branch instructions, bits 0-4 are used as the branch condition
 	
 	uint8_t reg_select;
@@ -122,6 +149,9 @@ typedef enum
 	// the number of bits in the current ALU destination size (used for MULS / MULU / DIVS / DIVU initialization)
 	DATA_NUM_BITS,
 	
+	// the Divide by Zero exception vector
+	DATA_VEC_DIV_ZERO,
+	
 	// 8-bit registers
 	DATA_REG_L0,
 	DATA_REG_L1,
@@ -205,11 +235,70 @@ typedef struct
 	bool sign_extend;
 } alu_src_control;
 
+// An alu_src_control resolved ahead of time, so the operand latch and writeback don't decode it every cycle
+typedef struct
+{
+	enum
+	{
+		// has side effects or depends on machine state; decoded in full every time
+		OPERAND_GENERIC = 0,
+		// core.reg_bytes[index], core.reg_words[index] or core.regs[index] (in the same order as data_size_spec)
+		OPERAND_REG_8,
+		OPERAND_REG_16,
+		OPERAND_REG_24,
+		// the low 8, 16 or 24 bits of the register the instruction selects (inst_decoded_flags.operand_regs[index])
+		OPERAND_INST_REG_8,
+		OPERAND_INST_REG_16,
+		OPERAND_INST_REG_24,
+		// bits of an immediate latch (inst_decoded_flags.operand_imms[index])
+		OPERAND_INST_IMM,
+		// MAR if index is 0, MDR otherwise
+		OPERAND_MEM_LATCH,
+		// mask is the value itself; as a destination, the write is dropped
+		OPERAND_CONST
+	} kind;
+	uint8_t index;
+	uint8_t shift;
+	uint32_t mask;
+} alu_operand_access;
+
+// Registers selected by the instruction words, as read through DATA_REG_IMM_* and DATA_REG_RM_*
+enum
+{
+	OPERAND_REG_IMM_0_8 = 0,
+	OPERAND_REG_IMM_1_8,
+	OPERAND_REG_IMM_1_2,
+	OPERAND_REG_RM_1_8,
+	OPERAND_REG_RM_1_2,
+	OPERAND_NUM_REGS
+};
+
+// Immediate latches, as read through DATA_LATCH_* and DATA_DMX_IMM_BITS
+enum
+{
+	OPERAND_IMM_0 = 0,
+	OPERAND_IMM_1,
+	OPERAND_IMM_2,
+	OPERAND_IMM_HML,
+	OPERAND_IMM_HML_RM,
+	OPERAND_IMM_RM_1,
+	OPERAND_IMM_RM_2,
+	OPERAND_IMM_RM_HML,
+	OPERAND_IMM_DMX,
+	OPERAND_NUM_IMMS
+};
+
 typedef struct
 {
 	alu_src_control srcs[2];
 	alu_src_control dest;
 	
+	// srcs and dest as compiled by pilot_execute_compile_control()
+	alu_operand_access src_access[2];
+	alu_operand_access dest_access;
+	// ALU kernel picked by pilot_execute_compile_control(); 0 interprets the whole control word
+	uint8_t alu_kernel;
+	
 	enum
 	{
 		ALU_OFF,
@@ -307,6 +396,10 @@ typedef struct
 	
 	// The Pilot has a 24-bit internal data bus, but this is reduced by glue logic to 16 bits for any accesses outside the CPU.
 	bool is_16bit;
+	// Low half of a 24-bit access: the high byte goes out in the same bus transaction...
+	bool is_24bit;
+	// ...so the MAR step chained after it (the high half) only takes up the cycle
+	bool is_24bit_high;
 } execute_control_word;
 
 typedef struct
@@ -340,6 +433,19 @@ typedef struct
 	mucode_entry_spec next_no_branch;	// If branch is not taken
 } mucode_entry;
 
+// Instruction groups, as split up by the top of the decoder
+typedef enum
+{
+	INST_CLASS_BRANCH = 0,
+	INST_CLASS_BIT,
+	INST_CLASS_LD_OTHER,
+	INST_CLASS_ARITHLOGIC,
+	INST_CLASS_LD_GROUP,
+	INST_CLASS_OTHER,
+	
+	INST_NUM_CLASSES
+} inst_class;
+
 typedef struct
 {
 	// Immediate data sources
@@ -347,6 +453,10 @@ typedef struct
 	
 	// PGC for this instruction
 	uint32_t inst_pgc;
+	// Length in words, and where the decoder went on to decode from after this instruction: the next one,
+	// or the target of a branch it predicted. The execute unit sends the fetch unit elsewhere if that's wrong
+	uint8_t inst_length;
+	uint32_t next_pgc;
 	
 	// Sequencer control
 	// run_before: if not MU_NONE, is executed before core_op - usually for memory reads
@@ -376,6 +486,13 @@ typedef struct
 	// Offset of the second RM operand
 	uint8_t rm2_offset;
 	
+	// Which group the opcode was decoded by (an inst_class)
+	uint8_t inst_class;
+	
+	// Operands taken from imm_words, filled in at dispatch by pilot_execute_latch_operands()
+	uint8_t operand_regs[OPERAND_NUM_REGS];
+	uint32_t operand_imms[OPERAND_NUM_IMMS];
+	
 	// Special branch flags
 	bool restart;
 	bool div_zero;
@@ -0,0 +1,334 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+
+/*
+ * Cycle / fast mode differential test
+ *
+ * Each guest program below is copied into HRAM and run from a freshly reset machine in both execution
+ * modes. Every time the execute stage takes a new instruction, its address, the registers and the flags are
+ * recorded; the two modes have to agree on all of them, instruction for instruction. After the fixed
+ * programs come random ones, made of instructions whose encodings are known to be implemented: quick
+ * loads, register to register ALU ops, and conditional branches and DJNZ that stay inside the program.
+ * Exits with 1 if any program differs.
+ */
+
+// Build from this directory with
+//   cc -O2 -I../pilot-cpu -o pilot-fastdiff fastdiff.c ../pilot-cpu/*.c -pthread
+// and run as
+//   pilot-fastdiff [random programs] [seed]
+
+#define DIFF_LOAD_ADDR	0xfff400
+#define DIFF_HRAM_START	0xfff400
+#define DIFF_INSTS	2000
+// Far more than DIFF_INSTS instructions can take; a machine that gets here has stopped running code
+#define DIFF_MAX_CYCLES	1000000
+#define DIFF_DEFAULT_RANDOM	200
+#define DIFF_RANDOM_WORDS	24
+
+typedef struct
+{
+	const char *name;
+	const uint16_t *code;
+	uint16_t num_words;
+} diff_program;
+
+typedef struct
+{
+	uint32_t pgc;
+	uint32_t regs[8];
+	uint16_t wf;
+} diff_point;
+
+typedef struct
+{
+	diff_point points[DIFF_INSTS];
+	uint32_t num_points;
+	uint64_t last_insts;
+} diff_trace;
+
+/*
+ * Guest programs
+ */
+
+// A not-taken conditional branch right before an unconditional one
+static const uint16_t diff_cond_then_jr_[] =
+{
+	0xc801,			// ldq r0, 1
+	// top:
+	0x7844,			// xor.w r1, r0
+	0xecff,			// jr z, top
+	0xeefe			// jr top
+};
+
+// Forward and backward branches back to back, taken and not
+static const uint16_t diff_branch_chain_[] =
+{
+	0xc801,			// ldq r0, 1
+	// top:
+	0x7844,			// xor.w r1, r0
+	0xec03,			// jr z, skip
+	0xe802,			// jr m, skip
+	0xc9ff,			// ldq r1, -1
+	// skip:
+	0xecfc,			// jr z, top
+	0xedfb,			// jr nz, top
+	0xeefa			// jr top
+};
+
+// DJNZ falling through into a branch, and a branch onto a DJNZ
+static const uint16_t diff_djnz_exit_[] =
+{
+	0xc801,			// ldq r0, 1
+	// top:
+	0xca03,			// ldq r2, 3
+	// inner:
+	0x7004,			// add.w r1, r0
+	0xf2ff,			// djnz r2, inner
+	0xeefd			// jr top
+};
+
+// A branch to the next instruction, and one to itself once the counter runs out
+static const uint16_t diff_jr_next_[] =
+{
+	0xc801,			// ldq r0, 1
+	0xcb40,			// ldq r3, 64
+	// top:
+	0xee01,			// jr next
+	// next:
+	0xb08c,			// sub.p r3, r0
+	0xedfe,			// jr nz, top
+	0xee00			// jr $
+};
+
+static const uint16_t diff_alu_[] =
+{
+	0xc801,			// ldq r0, 1
+	0xc903,			// ldq r1, 3
+	// top:
+	0x7004,			// add.w r1, r0
+	0x7948,			// xor.w r2, r1
+	0xb08c,			// sub.p r3, r0
+	0x3910,			// and.b r4, r1
+	0x7a94,			// or.w r5, r2
+	0xb358,			// adx.p r6, r3
+	0xeefa			// jr top
+};
+
+static const uint16_t diff_muldiv_[] =
+{
+	0xca07,			// ldq r2, 7
+	// top:
+	0xc907,			// ldq r1, 7
+	0x4908,			// mulu.w r1, r2
+	0xc800,			// ldq r0, 0
+	0x4988,			// divu.w r1, r2
+	0xcbfd,			// ldq r3, -3
+	0x4b48,			// muls.w r3, r2
+	0xeefa			// jr top
+};
+
+// A block copy repeated by register, which has to carry on after the copy once the count runs out
+static const uint16_t diff_repr_[] =
+{
+	// top:
+	0xc000, 0x0100,		// ld.p r0, $000100
+	0xc100, 0x0400,		// ld.p r1, $000400
+	0xcc0f,			// ldq r4, 15
+	0xf400,			// repr r4
+	0x5920,			// ld.w (r1+), (r0+)
+	0xeef9			// jr top
+};
+
+#define DIFF_PROGRAM_(name)	{#name, diff_##name##_, sizeof(diff_##name##_) / sizeof(uint16_t)}
+
+static const diff_program diff_programs_[] =
+{
+	DIFF_PROGRAM_(cond_then_jr),
+	DIFF_PROGRAM_(branch_chain),
+	DIFF_PROGRAM_(djnz_exit),
+	DIFF_PROGRAM_(jr_next),
+	DIFF_PROGRAM_(alu),
+	DIFF_PROGRAM_(muldiv),
+	DIFF_PROGRAM_(repr)
+};
+
+#define DIFF_NUM_PROGRAMS	(sizeof(diff_programs_) / sizeof(diff_program))
+
+// Register to register ALU ops: add.w, xor.w, sub.p, and.b, or.w, adx.p with both registers cleared
+static const uint16_t diff_alu_ops_[] = {0x7000, 0x7840, 0xb080, 0x3800, 0x7880, 0xb040};
+
+#define DIFF_NUM_ALU_OPS	(sizeof(diff_alu_ops_) / sizeof(uint16_t))
+
+/*
+ * Core hooks
+ */
+
+void
+decode_unreachable_ (void)
+{
+	fprintf(stderr, "pilot-fastdiff: the decoder reached a path it doesn't implement\n");
+	exit(1);
+}
+
+void
+execute_unreachable_ (void)
+{
+	fprintf(stderr, "pilot-fastdiff: the execute unit reached a path it doesn't implement\n");
+	exit(1);
+}
+
+/*
+ * Test
+ */
+
+static bool
+diff_record_ (Pilot_cpu *cpu, void *ctx)
+{
+	diff_trace *trace = ctx;
+	
+	if (cpu->sys.perf.insts != trace->last_insts)
+	{
+		trace->last_insts = cpu->sys.perf.insts;
+		
+		diff_point *point = &trace->points[trace->num_points++];
+		point->pgc = cpu->execute.decoded_inst.inst_pgc;
+		memcpy(point->regs, cpu->sys.core.regs, sizeof(point->regs));
+		point->wf = Pilot_cpu_wf(cpu);
+	}
+	
+	return trace->num_points == DIFF_INSTS || cpu->sys.cycles >= DIFF_MAX_CYCLES || cpu->sys.core.disable_clk;
+}
+
+static void
+diff_run_ (Pilot_cpu *cpu, const uint16_t *code, uint16_t num_words, Pilot_exec_mode mode, diff_trace *trace)
+{
+	uint16_t offset = DIFF_LOAD_ADDR - DIFF_HRAM_START;
+	
+	Pilot_cpu_init(cpu, DIFF_LOAD_ADDR);
+	for (uint16_t i = 0; i < num_words; i++)
+	{
+		cpu->sys.hram[offset + 2 * i] = code[i] & 0xff;
+		cpu->sys.hram[offset + 2 * i + 1] = code[i] >> 8;
+	}
+	Pilot_set_exec_mode(cpu, mode);
+	
+	trace->num_points = 0;
+	trace->last_insts = cpu->sys.perf.insts;
+	Pilot_run_until(cpu, diff_record_, trace);
+}
+
+static void
+diff_print_point_ (const char *mode, const diff_point *point)
+{
+	fprintf(stderr, "\t%-5s pgc %06x wf %04x", mode, point->pgc, point->wf);
+	for (int i = 0; i < 8; i++)
+	{
+		fprintf(stderr, " r%d %06x", i, point->regs[i]);
+	}
+	fprintf(stderr, "\n");
+}
+
+// Returns FALSE (after saying why) if the two modes disagree anywhere
+static bool
+diff_program_ (Pilot_cpu *cpu, diff_trace traces[2], const char *name, const uint16_t *code, uint16_t num_words)
+{
+	diff_run_(cpu, code, num_words, PILOT_EXEC_CYCLE, &traces[0]);
+	diff_run_(cpu, code, num_words, PILOT_EXEC_FAST, &traces[1]);
+	
+	uint32_t num_points = (traces[0].num_points < traces[1].num_points) ? traces[0].num_points : traces[1].num_points;
+	for (uint32_t i = 0; i < num_points; i++)
+	{
+		const diff_point *cycle = &traces[0].points[i];
+		const diff_point *fast = &traces[1].points[i];
+		
+		if (cycle->pgc != fast->pgc || cycle->wf != fast->wf || memcmp(cycle->regs, fast->regs, sizeof(cycle->regs)))
+		{
+			fprintf(stderr, "%s: the modes disagree at instruction %u\n", name, i);
+			diff_print_point_("cycle", cycle);
+			diff_print_point_("fast", fast);
+			return FALSE;
+		}
+	}
+	
+	if (traces[0].num_points != traces[1].num_points)
+	{
+		fprintf(stderr, "%s: cycle mode ran %u instructions, fast mode %u\n", name, traces[0].num_points, traces[1].num_points);
+		return FALSE;
+	}
+	
+	return TRUE;
+}
+
+// Fills code with instructions that are all implemented; branches never leave the program
+static void
+diff_random_program_ (uint16_t *code, uint16_t num_words)
+{
+	for (uint16_t i = 0; i < num_words; i++)
+	{
+		int kind = rand() % 8;
+		
+		if (kind == 0)
+		{
+			// JR cond, anywhere in the program (0xef is CR.S)
+			int offset = rand() % num_words - i;
+			code[i] = 0xe000 | ((rand() % 15) << 8) | (offset & 0xff);
+		}
+		else if (kind == 1 && i > 0)
+		{
+			// DJNZ only goes backwards
+			int offset = -(rand() % i) - 1;
+			code[i] = 0xf000 | ((rand() % 8) << 8) | (offset & 0xff);
+		}
+		else if (kind <= 3)
+		{
+			code[i] = 0xc800 | ((rand() % 8) << 8) | (rand() & 0xff);
+		}
+		else
+		{
+			code[i] = diff_alu_ops_[rand() % DIFF_NUM_ALU_OPS] | ((rand() % 8) << 8) | ((rand() % 8) << 2);
+		}
+	}
+	
+	// the last word loops back to the start
+	code[num_words - 1] = 0xee00 | ((-(num_words - 1)) & 0xff);
+}
+
+int
+main (int argc, char **argv)
+{
+	int num_random = (argc > 1) ? atoi(argv[1]) : DIFF_DEFAULT_RANDOM;
+	unsigned seed = (argc > 2) ? strtoul(argv[2], NULL, 0) : 1;
+	int failed = 0;
+	
+	Pilot_cpu *cpu = aligned_alloc(_Alignof(Pilot_cpu), sizeof(Pilot_cpu));
+	diff_trace *traces = malloc(2 * sizeof(diff_trace));
+	if (!cpu || !traces)
+	{
+		return 1;
+	}
+	
+	for (size_t i = 0; i < DIFF_NUM_PROGRAMS; i++)
+	{
+		failed += !diff_program_(cpu, traces, diff_programs_[i].name, diff_programs_[i].code, diff_programs_[i].num_words);
+	}
+	
+	srand(seed);
+	for (int i = 0; i < num_random; i++)
+	{
+		uint16_t code[DIFF_RANDOM_WORDS];
+		char name[32];
+		
+		diff_random_program_(code, DIFF_RANDOM_WORDS);
+		snprintf(name, sizeof(name), "random %d", i);
+		failed += !diff_program_(cpu, traces, name, code, DIFF_RANDOM_WORDS);
+	}
+	
+	printf("pilot-fastdiff: %d of %d programs differ\n", failed, (int)DIFF_NUM_PROGRAMS + num_random);
+	
+	free(traces);
+	free(cpu);
+	return failed ? 1 : 0;
+}